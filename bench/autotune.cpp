@@ -0,0 +1,71 @@
+#include <autotune.hpp>
+#include <netsim.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Compares the throughput of bulk transfers across a simulated 50ms round
+ * trip, 50 MB/s link, with buffers fixed at the autotuner's minimum, fixed at
+ * well beyond the bandwidth-delay product, and autotuned.
+ */
+
+static const std::chrono::seconds kDuration(4);
+
+static void transfer(const std::string& mode, int buffer, bool autotuned)
+{
+   Impairment impairment;
+   impairment.latency = std::chrono::milliseconds(25);
+   impairment.bandwidth = 50000000;
+   auto net = simulate_network(impairment, 1);
+   auto listener = net->listen_tcp("tcp://10.0.0.1:5001");
+   std::shared_ptr<TCPConnection> client = net->dial_tcp("tcp://10.0.0.1:5001");
+   std::shared_ptr<TCPConnection> server = listener->accept().get();
+   client->buffer_sizes(buffer, buffer);
+
+   BufferAutotuner tuner(256 << 20);
+   if (autotuned)
+      tuner.track(client);
+
+   std::atomic<bool> stopped(false);
+   std::thread writing([&](){
+      const std::vector<uint8_t> chunk(256 << 10, 'x');
+      while (!stopped)
+         client->write(chunk, std::chrono::milliseconds(100));
+   });
+
+   uint64_t received = 0;
+   std::vector<uint8_t> b(1 << 20);
+   auto begin = std::chrono::steady_clock::now();
+   auto tuned = begin;
+   while (std::chrono::steady_clock::now() - begin < kDuration) {
+      auto read = server->read(b, std::chrono::milliseconds(100));
+      if (!read.erred())
+         received += read.get();
+      if (autotuned && std::chrono::steady_clock::now() - tuned >= std::chrono::milliseconds(100)) {
+         tuner.tune();
+         tuned = std::chrono::steady_clock::now();
+      }
+   }
+   std::chrono::duration<double> took = std::chrono::steady_clock::now() - begin;
+   stopped = true;
+   writing.join();
+
+   size_t memory = autotuned ? tuner.committed() : 2 * buffer;
+   std::cout << mode << "\t"
+      << static_cast<int64_t>(received / took.count() / (1024 * 1024)) << "\t"
+      << (memory >> 10) << std::endl;
+}
+
+int main()
+{
+   std::cout << "buffers\tMiB/s\tmemory(KiB)" << std::endl;
+   transfer("fixed-64KiB", BufferAutotuner::kMinBuffer, false);
+   transfer("fixed-16MiB", 16 << 20, false);
+   transfer("autotuned", BufferAutotuner::kMinBuffer, true);
+   return 0;
+}
@@ -0,0 +1,302 @@
+#include <address.hpp>
+#include <cppsocket.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Measures what the library adds on top of the syscalls it wraps: each
+ * cppsocket path is paired with the equivalent hand-written one, doing the
+ * same syscalls on the same kind of sockets.
+ *
+ * Next to the time per operation, `allocs/op` reports the amount of heap
+ * allocations per operation, counted by replacing the global operator new.
+ */
+
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t n)
+{
+   allocations.fetch_add(1, std::memory_order_relaxed);
+   void* p = std::malloc(n ? n : 1);
+   if (p == NULL)
+      throw std::bad_alloc();
+   return p;
+}
+
+void operator delete(void* p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+   std::free(p);
+}
+
+/**
+ * Allocations counts the allocations made during a benchmark's iterations.
+ */
+struct Allocations
+{
+   Allocations()
+      : __begin(allocations.load(std::memory_order_relaxed))
+   {}
+
+   void report(benchmark::State& state)
+   {
+      state.counters["allocs/op"] = benchmark::Counter(
+         allocations.load(std::memory_order_relaxed) - __begin,
+         benchmark::Counter::kAvgIterations
+      );
+   }
+
+private:
+   uint64_t __begin;
+};
+
+/**
+ * Pair is a connected pair of TCP connections on loopback.
+ */
+struct Pair
+{
+   Pair(const std::string& addr)
+      : listener(listen_tcp(addr))
+      , dialed(dial_tcp(addr))
+      , accepted(listener->accept_socket(std::chrono::seconds(1)).get())
+   {
+      dialed->no_delay(true);
+   }
+
+   std::unique_ptr<TCPSocketListener> listener;
+   std::shared_ptr<TCPSocket> dialed;
+   std::shared_ptr<TCPSocket> accepted;
+};
+
+static void BM_TCPReadWrite_Raw(benchmark::State& state)
+{
+   Pair p("tcp://127.0.0.1:3330");
+   std::vector<uint8_t> b(state.range(0), 'x');
+   std::vector<uint8_t> r(b.size());
+   int out = p.dialed->fd();
+   int in = p.accepted->fd();
+   Allocations a;
+   for (auto _ : state) {
+      if (::send(out, b.data(), b.size(), MSG_NOSIGNAL) != (ssize_t)b.size()) {
+         state.SkipWithError("write failed");
+         break;
+      }
+      ssize_t got = 0;
+      for (size_t n = 0; n < r.size(); n += got) {
+         got = ::read(in, r.data() + n, r.size() - n);
+         if (got <= 0)
+            break;
+      }
+      if (got <= 0) {
+         state.SkipWithError("read failed");
+         break;
+      }
+   }
+   a.report(state);
+   state.SetBytesProcessed(state.iterations() * b.size());
+}
+BENCHMARK(BM_TCPReadWrite_Raw)->Arg(64)->Arg(4096);
+
+static void BM_TCPReadWrite_Cppsocket(benchmark::State& state)
+{
+   Pair p("tcp://127.0.0.1:3331");
+   std::vector<uint8_t> b(state.range(0), 'x');
+   std::vector<uint8_t> r(b.size());
+   Allocations a;
+   for (auto _ : state) {
+      if (p.dialed->write(b).get() != b.size())
+         state.SkipWithError("write failed");
+      for (size_t n = 0; n < r.size();)
+         n += p.accepted->read(r).get();
+   }
+   a.report(state);
+   state.SetBytesProcessed(state.iterations() * b.size());
+}
+BENCHMARK(BM_TCPReadWrite_Cppsocket)->Arg(64)->Arg(4096);
+
+// Through the interfaces rather than the concrete types, as code which is to
+// work on any transport would.
+static void BM_TCPReadWrite_CppsocketVirtual(benchmark::State& state)
+{
+   Pair p("tcp://127.0.0.1:3336");
+   Writer& out = *p.dialed;
+   Reader& in = *p.accepted;
+   std::vector<uint8_t> b(state.range(0), 'x');
+   std::vector<uint8_t> r(b.size());
+   Allocations a;
+   for (auto _ : state) {
+      if (out.write(b).get() != b.size())
+         state.SkipWithError("write failed");
+      for (size_t n = 0; n < r.size();)
+         n += in.read(r).get();
+   }
+   a.report(state);
+   state.SetBytesProcessed(state.iterations() * b.size());
+}
+BENCHMARK(BM_TCPReadWrite_CppsocketVirtual)->Arg(64)->Arg(4096);
+
+static void BM_UDPSend_Raw(benchmark::State& state)
+{
+   auto sink = listen_udp("udp://127.0.0.1:3332");
+   int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+   struct sockaddr_in to;
+   std::memset(&to, 0, sizeof(to));
+   to.sin_family = AF_INET;
+   to.sin_port = htons(3332);
+   inet_pton(AF_INET, "127.0.0.1", &to.sin_addr);
+   std::vector<uint8_t> b(64, 'x');
+   Allocations a;
+   for (auto _ : state)
+      benchmark::DoNotOptimize(::sendto(fd, b.data(), b.size(), 0, (struct sockaddr*)&to, sizeof(to)));
+   a.report(state);
+   ::close(fd);
+}
+BENCHMARK(BM_UDPSend_Raw);
+
+static void BM_UDPSend_CppsocketAddressed(benchmark::State& state)
+{
+   auto sink = listen_udp("udp://127.0.0.1:3333");
+   auto conn = listen_udp("udp://127.0.0.1:3334");
+   const std::string to = "udp://127.0.0.1:3333";
+   std::vector<uint8_t> b(64, 'x');
+   Allocations a;
+   for (auto _ : state)
+      benchmark::DoNotOptimize(conn->write(b, to));
+   a.report(state);
+}
+BENCHMARK(BM_UDPSend_CppsocketAddressed);
+
+static void BM_UDPSend_CppsocketDialed(benchmark::State& state)
+{
+   auto sink = listen_udp("udp://127.0.0.1:3335");
+   auto conn = dial_udp("udp://127.0.0.1:3335");
+   std::vector<uint8_t> b(64, 'x');
+   Allocations a;
+   for (auto _ : state)
+      benchmark::DoNotOptimize(conn->write(b));
+   a.report(state);
+}
+BENCHMARK(BM_UDPSend_CppsocketDialed);
+
+static void BM_Expected_Success(benchmark::State& state)
+{
+   size_t i = 0;
+   Allocations a;
+   for (auto _ : state) {
+      Expected<size_t> e(i++);
+      benchmark::DoNotOptimize(e.get());
+   }
+   a.report(state);
+}
+BENCHMARK(BM_Expected_Success);
+
+static void BM_Expected_Error(benchmark::State& state)
+{
+   Allocations a;
+   for (auto _ : state) {
+      auto e = Expected<size_t>::unexpected(std::runtime_error("read: unable to read - Resource temporarily unavailable"));
+      benchmark::DoNotOptimize(e.erred());
+   }
+   a.report(state);
+}
+BENCHMARK(BM_Expected_Error);
+
+static void BM_Expected_ErrorRethrown(benchmark::State& state)
+{
+   Allocations a;
+   for (auto _ : state) {
+      auto e = Expected<size_t>::unexpected(std::runtime_error("read: unable to read - Resource temporarily unavailable"));
+      try {
+         e.get();
+      } catch (const std::runtime_error& err) {
+         benchmark::DoNotOptimize(err.what());
+      }
+   }
+   a.report(state);
+}
+BENCHMARK(BM_Expected_ErrorRethrown);
+
+static void BM_Netaddr_Raw(benchmark::State& state)
+{
+   struct sockaddr_in sa;
+   std::memset(&sa, 0, sizeof(sa));
+   sa.sin_family = AF_INET;
+   sa.sin_port = htons(8080);
+   inet_pton(AF_INET, "192.168.100.200", &sa.sin_addr);
+   char ip[INET6_ADDRSTRLEN];
+   char formatted[INET6_ADDRSTRLEN + 8];
+   Allocations a;
+   for (auto _ : state) {
+      inet_ntop(AF_INET, &sa.sin_addr, ip, sizeof(ip));
+      std::snprintf(formatted, sizeof(formatted), "%s:%d", ip, ntohs(sa.sin_port));
+      benchmark::DoNotOptimize(formatted);
+   }
+   a.report(state);
+}
+BENCHMARK(BM_Netaddr_Raw);
+
+static void BM_Netaddr_Cppsocket(benchmark::State& state)
+{
+   struct sockaddr_in sa;
+   std::memset(&sa, 0, sizeof(sa));
+   sa.sin_family = AF_INET;
+   sa.sin_port = htons(8080);
+   inet_pton(AF_INET, "192.168.100.200", &sa.sin_addr);
+   Allocations a;
+   for (auto _ : state) {
+      auto formatted = netaddr(reinterpret_cast<const struct sys::sockaddr*>(&sa));
+      benchmark::DoNotOptimize(formatted.get());
+   }
+   a.report(state);
+}
+BENCHMARK(BM_Netaddr_Cppsocket);
+
+static void BM_Resolve_Raw(benchmark::State& state)
+{
+   struct addrinfo hints;
+   std::memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   Allocations a;
+   for (auto _ : state) {
+      struct addrinfo* resolved;
+      if (getaddrinfo("127.0.0.1", "8080", &hints, &resolved) != 0)
+         state.SkipWithError("getaddrinfo failed");
+      freeaddrinfo(resolved);
+   }
+   a.report(state);
+}
+BENCHMARK(BM_Resolve_Raw);
+
+static void BM_Resolve_Cppsocket(benchmark::State& state)
+{
+   const std::string addr = "tcp://127.0.0.1:8080";
+   Allocations a;
+   for (auto _ : state) {
+      auto resolved = resolve(addr);
+      benchmark::DoNotOptimize(resolved.get());
+   }
+   a.report(state);
+}
+BENCHMARK(BM_Resolve_Cppsocket);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,109 @@
+#include <cppsocket.hpp>
+#include <proxy.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Compares talking to an echo server directly with talking to it through a
+ * TCP proxy: throughput of a bulk transfer, and round-trip latency of
+ * single-byte ping-pongs.
+ */
+
+static void echo(std::shared_ptr<TCPConnection> conn)
+{
+   std::vector<uint8_t> buffer(256 * 1024);
+   for (;;) {
+      buffer.resize(256 * 1024);
+      auto read = conn->read(buffer);
+      if (read.erred() || read.get() == 0)
+         return;
+      buffer.resize(read.get());
+      while (!buffer.empty()) {
+         auto written = conn->write(buffer);
+         if (written.erred())
+            return;
+         buffer.erase(buffer.begin(), buffer.begin() + written.get());
+      }
+   }
+}
+
+static double throughput(const std::string& addr, size_t total)
+{
+   auto conn = dial_tcp(addr);
+   auto begin = std::chrono::steady_clock::now();
+   std::thread writing([&](){
+      const std::vector<uint8_t> chunk(64 * 1024, 'x');
+      for (size_t written = 0; written < total;)
+         written += conn->write(chunk).get();
+   });
+   std::vector<uint8_t> buffer(256 * 1024);
+   for (size_t read = 0; read < total;)
+      read += conn->read(buffer).get();
+   writing.join();
+   std::chrono::duration<double> took = std::chrono::steady_clock::now() - begin;
+   return total / took.count() / (1024 * 1024);
+}
+
+static std::vector<double> latencies(const std::string& addr, int n)
+{
+   auto conn = dial_tcp(addr);
+   conn->no_delay(true);
+   const std::vector<uint8_t> ping(1, 'p');
+   std::vector<uint8_t> pong(1);
+   std::vector<double> took;
+   for (int i = 0; i < n; i++) {
+      auto begin = std::chrono::steady_clock::now();
+      conn->write(ping).get();
+      conn->read(pong).get();
+      took.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+   }
+   std::sort(took.begin(), took.end());
+   return took;
+}
+
+int main()
+{
+   const std::string upstream = "tcp://127.0.0.1:3220";
+   const std::string proxied = "tcp://127.0.0.1:3221";
+   constexpr size_t total = 1024 * 1024 * 1024;
+   constexpr int pings = 20000;
+
+   std::atomic<bool> stopped(false);
+   auto listener = listen_tcp(upstream);
+   std::vector<std::thread> echoing;
+   std::thread accepting([&](){
+      while (!stopped) {
+         auto accepted = listener->accept(std::chrono::milliseconds(50));
+         if (!accepted.erred()) {
+            accepted.get()->no_delay(true);
+            echoing.push_back(std::thread(echo, accepted.get()));
+         }
+      }
+   });
+   auto proxy = proxy_tcp(listen_tcp(proxied), upstream);
+   std::thread serving([&](){ proxy->serve().get(); });
+
+   std::cout << "path\tMiB/s\tp50(us)\tp99(us)" << std::endl;
+   for (const auto& addr : {upstream, proxied}) {
+      double mibs = throughput(addr, total);
+      auto took = latencies(addr, pings);
+      std::cout << (addr == upstream ? "direct" : "proxied") << "\t"
+         << static_cast<int64_t>(mibs) << "\t"
+         << took[took.size() / 2] << "\t"
+         << took[took.size() * 99 / 100] << std::endl;
+   }
+
+   proxy->close();
+   serving.join();
+   stopped = true;
+   accepting.join();
+   for (auto& e : echoing)
+      e.join();
+   return 0;
+}
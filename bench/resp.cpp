@@ -0,0 +1,37 @@
+#include <cppsocket.hpp>
+#include <resp.hpp>
+
+#include <resp_server.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+/**
+ * Measures the amount of INCRs per second a pipelining client gets out of the
+ * stand-in server, for a growing pipeline depth.
+ */
+int main()
+{
+   const std::string addr = "tcp://127.0.0.1:6381";
+   constexpr int operations = 100000;
+
+   RESPServer server(addr);
+   auto conn = dial_tcp(addr);
+   conn->no_delay(true);
+   RESPClient client(conn);
+
+   std::cout << "depth\tops/sec" << std::endl;
+   for (int depth = 1; depth <= 1024; depth *= 2) {
+      int64_t replies = 0;
+      auto begin = std::chrono::steady_clock::now();
+      for (int done = 0; done < operations; done += depth) {
+         for (int i = 0; i < depth; i++)
+            client.append({"INCR", "bench"});
+         client.flush([&](const RESPReply&){ replies++; }).get();
+      }
+      std::chrono::duration<double> took = std::chrono::steady_clock::now() - begin;
+      std::cout << depth << "\t" << static_cast<int64_t>(replies / took.count()) << std::endl;
+   }
+   return 0;
+}
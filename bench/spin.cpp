@@ -0,0 +1,73 @@
+#include <cppsocket.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Measures the round-trip latency of single-byte ping-pongs over loopback
+ * for growing spin budgets on both ends, along with the CPU it costs: the
+ * amount of cores kept busy over the run.
+ *
+ * Spinning only pays off with a core to spare for every spinning thread;
+ * with fewer, the spinning end holds up the one it's waiting for.
+ */
+
+static void pong(std::shared_ptr<TCPSocket> conn)
+{
+   const std::vector<uint8_t> reply(1, 'q');
+   std::vector<uint8_t> b(1);
+   for (;;) {
+      auto read = conn->read(b);
+      if (read.erred() || read.get() == 0)
+         return;
+      conn->write(reply);
+   }
+}
+
+int main()
+{
+   const std::string addr = "tcp://127.0.0.1:3350";
+   constexpr int pings = 20000;
+
+   auto listener = listen_tcp(addr);
+   const std::vector<uint8_t> ping(1, 'p');
+   std::vector<uint8_t> b(1);
+
+   std::cout << "spin(us)\tp50(us)\tp99(us)\tcores" << std::endl;
+   for (int spin : {0, 5, 20, 100}) {
+      SocketTuning tuning;
+      tuning.no_delay = true;
+      tuning.spin = std::chrono::microseconds(spin);
+      auto conn = dial_tcp(addr, tuning);
+      auto peer = listener->accept_socket().get();
+      peer->no_delay(true);
+      peer->spin(tuning.spin);
+      std::thread ponging(pong, peer);
+
+      std::vector<double> took;
+      std::clock_t cpu = std::clock();
+      auto began = std::chrono::steady_clock::now();
+      for (int i = 0; i < pings; i++) {
+         auto begin = std::chrono::steady_clock::now();
+         conn->write(ping).get();
+         conn->read(b).get();
+         took.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+      }
+      std::chrono::duration<double> wall = std::chrono::steady_clock::now() - began;
+      double cores = (std::clock() - cpu) / static_cast<double>(CLOCKS_PER_SEC) / wall.count();
+
+      conn.reset();
+      ponging.join();
+      std::sort(took.begin(), took.end());
+      std::cout << spin << "\t"
+         << took[took.size() / 2] << "\t"
+         << took[took.size() * 99 / 100] << "\t"
+         << cores << std::endl;
+   }
+   return 0;
+}
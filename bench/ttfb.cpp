@@ -0,0 +1,84 @@
+#include <cppsocket.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Measures the time to first byte of short-lived request connections over
+ * loopback: from dialing until the first byte of the response arrived. The
+ * requests are either written once connected, or handed to `dial_tcp` to go
+ * along with the SYN through TCP Fast Open, to a listener which also defers
+ * accepting until the request arrived.
+ *
+ * Fast Open only kicks in with `net.ipv4.tcp_fastopen` set to 3; with the
+ * default of 1, both paths take the same round trips.
+ */
+
+static void respond(std::unique_ptr<TCPSocketListener> listener, const std::atomic<bool>& stopped)
+{
+   std::vector<uint8_t> request(4096);
+   const std::vector<uint8_t> response(1, 'r');
+   while (!stopped) {
+      auto accepted = listener->accept_unique(std::chrono::milliseconds(50));
+      if (accepted.erred())
+         continue;
+      auto conn = std::move(accepted.get());
+      auto read = conn->read(request, std::chrono::seconds(1));
+      if (!read.erred() && read.get() > 0)
+         conn->write(response);
+   }
+}
+
+static std::vector<double> ttfb(const std::string& addr, bool fast_open, int n)
+{
+   const std::vector<uint8_t> request(512, 'q');
+   std::vector<uint8_t> response(1);
+   std::vector<double> took;
+   for (int i = 0; i < n; i++) {
+      auto begin = std::chrono::steady_clock::now();
+      auto conn = fast_open ? dial_tcp_unique(addr, request) : dial_tcp_unique(addr);
+      if (!fast_open)
+         conn->write(request).get();
+      conn->read(response).get();
+      took.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+   }
+   std::sort(took.begin(), took.end());
+   return took;
+}
+
+int main()
+{
+   const std::string plain = "tcp://127.0.0.1:3340";
+   const std::string tuned = "tcp://127.0.0.1:3341";
+   constexpr int connections = 2000;
+
+   TCPListenOptions options;
+   options.fast_open = 256;
+   options.defer_accept = std::chrono::seconds(1);
+
+   std::atomic<bool> stopped(false);
+   std::thread plain_server(respond, listen_tcp(plain), std::cref(stopped));
+   std::thread tuned_server(respond, listen_tcp(tuned, options), std::cref(stopped));
+
+   // The first connection fetches the Fast Open cookie.
+   ttfb(tuned, true, 1);
+
+   std::cout << "path\tp50(us)\tp99(us)" << std::endl;
+   auto print = [](const char* path, const std::vector<double>& took) {
+      std::cout << path << "\t"
+         << took[took.size() / 2] << "\t"
+         << took[took.size() * 99 / 100] << std::endl;
+   };
+   print("connect+write", ttfb(plain, false, connections));
+   print("fast-open", ttfb(tuned, true, connections));
+
+   stopped = true;
+   plain_server.join();
+   tuned_server.join();
+   return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef _CPPSOCKET_ACCOUNTING
+#define _CPPSOCKET_ACCOUNTING
+
+#include <cstdint>
+
+/**
+ * Accounting holds the amount of syscalls the library made and heap
+ * allocations the process made, on a single thread.
+ */
+struct Accounting
+{
+   uint64_t syscalls;
+   uint64_t allocations;
+};
+
+inline Accounting operator-(const Accounting& a, const Accounting& b)
+{
+   return Accounting{a.syscalls - b.syscalls, a.allocations - b.allocations};
+}
+
+/**
+ * accounting_enabled returns whether the library was built with the
+ * CPPSOCKET_ACCOUNTING option. Without it, all accounting remains zero.
+ *
+ * Accounting replaces the global `operator new` and intercepts the libc
+ * functions the library calls, hence it is meant for tests and benchmarks
+ * only.
+ */
+bool accounting_enabled();
+
+/**
+ * accounting returns what the calling thread accounted for so far. As only
+ * the calling thread is accounted for, subtracting the accounting before an
+ * operation from the one after it yields the cost of that operation, even
+ * while other threads are busy.
+ */
+Accounting accounting();
+
+#endif
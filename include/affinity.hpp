@@ -0,0 +1,92 @@
+#ifndef _CPPSOCKET_AFFINITY
+#define _CPPSOCKET_AFFINITY
+
+#include <expected.hpp>
+#include <socket.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/**
+ * cpus returns the CPUs the process is allowed to run on, in ascending
+ * order.
+ */
+std::vector<int> cpus();
+
+/**
+ * numa_node returns the NUMA node `cpu` belongs to, or -1 when it isn't
+ * known, like for CPUs which don't exist.
+ */
+int numa_node(int cpu);
+
+/**
+ * pin_thread has the calling thread, or `thread`, only run on `cpu` from now
+ * on.
+ */
+Expected<bool> pin_thread(int cpu);
+Expected<bool> pin_thread(std::thread& thread, int cpu);
+
+/**
+ * CPURouter places connections with the worker thread pinned to the CPU which
+ * handled their packets, as the kernel reports it through `incoming_cpu`, so
+ * that a connection is handled where its data is already in the cache. With
+ * no worker on that CPU, it's placed with one of the workers on the CPU's
+ * NUMA node, and with none there either, or when the CPU isn't known, with
+ * any of them.
+ *
+ * Placement pays off most when the NIC's receive queues are spread over the
+ * same CPUs as the workers, each worker running its own listener of those
+ * `listen_tcp_sharded` sets up.
+ */
+struct CPURouter
+{
+   /**
+    * CPURouter creates a router for the workers pinned to `cpus`, the i-th
+    * worker to the i-th CPU. The NUMA nodes of the CPUs are looked up once,
+    * or given as `nodes`, indexed by CPU.
+    */
+   explicit CPURouter(const std::vector<int>& cpus);
+   CPURouter(const std::vector<int>& cpus, const std::vector<int>& nodes);
+
+   CPURouter(const CPURouter&) = delete;
+   CPURouter& operator=(const CPURouter&) = delete;
+
+   /**
+    * route returns the index of the worker to handle what came in on `cpu`.
+    * Negative CPUs are placed round robin.
+    */
+   size_t route(int cpu) const;
+
+   /**
+    * route returns the index of the worker to handle `conn`.
+    */
+   size_t route(const TCPSocket& conn) const;
+
+   /**
+    * size returns the amount of workers routed to.
+    */
+   size_t size() const noexcept
+   {
+      return __cpus.size();
+   }
+
+private:
+   /**
+    * __workers holds, for each CPU, the index of the worker pinned to it, or
+    * -1.
+    */
+   std::vector<int> __workers;
+
+   /**
+    * __nodes holds, for each CPU, the indices of the workers on its NUMA
+    * node.
+    */
+   std::vector<std::vector<size_t>> __nodes;
+
+   std::vector<int> __cpus;
+   mutable std::atomic<size_t> __next;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _CPPSOCKET_AUTOTUNE
+#define _CPPSOCKET_AUTOTUNE
+
+#include <cppsocket.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * BufferAutotuner sizes the buffers of the connections it tracks after their
+ * bandwidth-delay product, as measured from their `info`, within a memory
+ * budget shared by all of them.
+ *
+ * Each connection's rate is the highest of the delivery rate the kernel
+ * estimates and the rates at which bytes were acknowledged and received
+ * since the previous tune. Its buffers are sized at twice the product of that
+ * rate and the round-trip time, so that a connection held back by its buffers
+ * gets to double them each tune until the path holds it back instead. When
+ * the connections want more than the budget, they're scaled down alike, but
+ * not below `kMinBuffer`.
+ *
+ * Tuning is opt-in per connection, as sized buffers are no longer autotuned
+ * by the kernel.
+ *
+ * The kernel clamps the buffers a socket asks for to `net.core.wmem_max` and
+ * `net.core.rmem_max`, about 208 KiB by default, and then doubles them for
+ * its bookkeeping. Sockets are therefore granted no more than the lower of
+ * the two limits, which caps the bandwidth-delay product they're tuned for,
+ * and count twice what they're granted against the budget. Raise the limits
+ * for long, fat paths. Simulated connections know no such limits.
+ */
+struct BufferAutotuner
+{
+   static const size_t kMinBuffer = 64 << 10;
+   static const size_t kMaxBuffer = 64 << 20;
+
+   /**
+    * BufferAutotuner creates an autotuner of which the connections' send and
+    * receive buffers together take up to `budget` bytes.
+    */
+   BufferAutotuner(size_t budget);
+
+   /**
+    * track adds `conn` to the connections to tune. Connections which are gone
+    * are forgotten during tune.
+    */
+   void track(const std::shared_ptr<TCPConnection>& conn);
+
+   /**
+    * tracked returns the amount of connections tracked, some of which might
+    * be gone already.
+    */
+   size_t tracked();
+
+   /**
+    * tune samples every tracked connection and resizes the buffers of those
+    * of which the size to be granted moved by more than a quarter, returning
+    * how many it resized. It's meant to be called periodically, from a single
+    * thread, at intervals of a few round trips.
+    */
+   size_t tune();
+
+   /**
+    * committed returns the bytes the buffers of the connections take up, as
+    * read back from the sockets, as of the last tune.
+    */
+   size_t committed();
+
+private:
+   struct Tuned
+   {
+      std::weak_ptr<TCPConnection> conn;
+      std::chrono::steady_clock::time_point sampled;
+      uint64_t acked;
+      uint64_t received;
+      size_t wanted;
+      size_t granted;
+      size_t effective;
+      bool socket;
+   };
+
+   size_t __budget;
+   size_t __committed;
+   size_t __limit;
+   std::mutex __lock;
+   std::vector<std::weak_ptr<TCPConnection>> __added;
+   std::vector<Tuned> __tuned;
+};
+
+#endif
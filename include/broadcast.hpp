@@ -0,0 +1,104 @@
+#ifndef _CPPSOCKET_BROADCAST
+#define _CPPSOCKET_BROADCAST
+
+#include <cppsocket.hpp>
+#include <expected.hpp>
+#include <histogram.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Message is an immutable payload shared by all the subscribers it is queued
+ * for, no matter how long it takes each of them to receive it.
+ */
+typedef std::shared_ptr<const std::vector<uint8_t>> Message;
+
+/**
+ * make_message wraps `b` into a Message without copying it.
+ */
+Message make_message(std::vector<uint8_t>&& b);
+
+/**
+ * LagPolicy determines what happens to a subscriber which has the maximum
+ * amount of messages queued when another one is published.
+ */
+enum class LagPolicy
+{
+   /**
+    * drop_oldest drops the oldest message which isn't being written yet.
+    */
+   drop_oldest,
+   /**
+    * drop_newest doesn't queue the message which was just published.
+    */
+   drop_newest,
+   /**
+    * disconnect unsubscribes the subscriber, which closes its connection
+    * unless it is referenced elsewhere.
+    */
+   disconnect,
+};
+
+struct BroadcastStats
+{
+   uint64_t published;
+   uint64_t delivered;
+   uint64_t dropped;
+   uint64_t disconnected;
+   /**
+    * latency holds the nanoseconds between publishing a message and it being
+    * completely written, for each delivery.
+    */
+   Histogram latency;
+};
+
+/**
+ * Broadcaster writes every published message to all of its subscribers.
+ *
+ * Messages are written right away for the subscribers which keep up. Those
+ * which can't keep up get a reference to the message queued, which `serve`
+ * writes in batches once they're writable again.
+ */
+struct Broadcaster
+{
+   /**
+    * kMaxBatch bounds the amount of queued messages written at once.
+    */
+   static const int kMaxBatch = 64;
+
+   virtual ~Broadcaster() {}
+
+   /**
+    * subscribe adds `conn` to the subscribers. The connection is put into
+    * non-blocking mode.
+    */
+   virtual void subscribe(const std::shared_ptr<TCPConnection>& conn) = 0;
+   virtual void unsubscribe(const std::shared_ptr<TCPConnection>& conn) = 0;
+   virtual size_t subscribers() = 0;
+
+   /**
+    * publish queues `m` for every subscriber and writes as much of it as
+    * the subscribers allow without blocking.
+    */
+   virtual void publish(const Message& m) = 0;
+
+   /**
+    * serve writes the queued messages as subscribers become writable, until
+    * `close` is called.
+    */
+   virtual Expected<bool> serve() = 0;
+   virtual void close() = 0;
+
+   virtual BroadcastStats stats() = 0;
+};
+
+/**
+ * broadcast_tcp creates a new Broadcaster which queues at most `max_queued`
+ * messages per subscriber and applies `policy` to subscribers which exceed
+ * it.
+ */
+std::unique_ptr<Broadcaster> broadcast_tcp(size_t max_queued, LagPolicy policy);
+
+#endif
@@ -2,8 +2,10 @@
 #define _CPPSOCKET
 
 #include <expected.hpp>
+#include <stats.hpp>
 
 #include <chrono>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -17,6 +19,9 @@ struct Reader
     *
     * Omitting `t` or providing a negative value for `t` will block until the
     * underlaying target is available for reading.
+    *
+    * Failures, timeouts among them, are reported as such, as is reading into
+    * an empty buffer. What reading zero bytes means is up to the target.
     */
    virtual Expected<size_t> read(std::vector<uint8_t>& b, const std::chrono::milliseconds& t) = 0;
    virtual Expected<size_t> read(std::vector<uint8_t>& b) = 0;
@@ -35,6 +40,21 @@ struct Writer
    virtual Expected<size_t> write(const std::vector<uint8_t>& b) = 0;
 };
 
+/**
+ * SentTimestamp is the moment the kernel handed written data to the network
+ * device, as reported through the socket's error queue.
+ */
+struct SentTimestamp
+{
+   /**
+    * id identifies the write: it counts the writes on a UDP connection and is
+    * the offset of a write's last byte on a TCP connection, both starting at
+    * zero when timestamping was enabled.
+    */
+   uint32_t id;
+   std::chrono::system_clock::time_point at;
+};
+
 struct Connection
    : Reader
    , Writer
@@ -56,8 +76,82 @@ struct Connection
    virtual void timeout(const std::chrono::microseconds& t) = 0;
    virtual void read_timeout(const std::chrono::microseconds& t) = 0;
    virtual void write_timeout(const std::chrono::microseconds& t) = 0;
+
+   /**
+    * fd returns the underlaying file descriptor, which remains owned by the
+    * connection.
+    */
+   virtual int fd() const = 0;
+
+   /**
+    * stats returns what was counted on this connection so far. The counters
+    * remain zero when the library was built without statistics. They're kept
+    * exact for one thread reading and another writing at a time.
+    */
+   virtual IOCounters stats() const = 0;
+
+   /**
+    * timestamping enables the kernel's software timestamps of received and
+    * sent data, to tell how long data spent queued in the kernel.
+    */
+   virtual void timestamping(bool enable) = 0;
+
+   /**
+    * received_at returns when the kernel received the data returned by the
+    * latest read, or the epoch when timestamping isn't enabled. The kernel
+    * enables timestamping system wide in the background, so data received
+    * right after enabling it might not be timestamped either.
+    */
+   virtual std::chrono::system_clock::time_point received_at() const = 0;
+
+   /**
+    * sent_at returns the timestamps of the writes which were handed to the
+    * network device since the previous call.
+    */
+   virtual Expected<std::vector<SentTimestamp>> sent_at() = 0;
+};
+
+/**
+ * TCPInfo is a snapshot of the kernel's view on a TCP connection, as reported
+ * by `TCP_INFO`. Fields the running kernel doesn't report are zero.
+ */
+struct TCPInfo
+{
+   uint8_t state;
+   std::chrono::microseconds rtt;
+   std::chrono::microseconds rtt_var;
+   std::chrono::microseconds min_rtt;
+   std::chrono::microseconds rto;
+   /**
+    * retransmits is the amount of segments currently being retransmitted,
+    * total_retransmits the amount over the lifetime of the connection.
+    */
+   uint32_t retransmits;
+   uint32_t total_retransmits;
+   uint32_t lost;
+   uint32_t unacked;
+   /**
+    * cwnd and ssthresh are expressed in segments of `mss` bytes.
+    */
+   uint32_t cwnd;
+   uint32_t ssthresh;
+   uint32_t mss;
+   /**
+    * pacing_rate and delivery_rate are expressed in bytes per second.
+    */
+   uint64_t pacing_rate;
+   uint64_t delivery_rate;
+   uint64_t bytes_sent;
+   uint64_t bytes_acked;
+   uint64_t bytes_received;
+   uint64_t bytes_retransmitted;
+   uint32_t notsent_bytes;
 };
 
+/**
+ * TCPConnection is a connected TCP stream. Reading zero bytes from it means
+ * the end of the stream was reached, which isn't an error.
+ */
 struct TCPConnection
    : Connection
 {
@@ -67,7 +161,33 @@ struct TCPConnection
     *
     * NODELAY is disabled by default.
     */
-   void no_delay(bool d);
+   virtual void no_delay(bool d) = 0;
+
+   /**
+    * buffer_sizes sizes the send and receive buffers of the connection in
+    * bytes, zero leaving either be. Sizing a buffer stops the kernel from
+    * autotuning it.
+    */
+   virtual void buffer_sizes(int send, int receive) = 0;
+
+   /**
+    * info returns a snapshot of the connection's transport metrics.
+    */
+   virtual Expected<TCPInfo> info() const = 0;
+
+   /**
+    * close_write closes the connection for writing: the peer reads the end
+    * of the stream once it read everything written before, whilst it may
+    * still write back, like a client signalling the end of its request
+    * whilst awaiting the reply. Writing afterwards fails.
+    */
+   virtual Expected<bool> close_write() = 0;
+
+   /**
+    * close_read closes the connection for reading: reads return the end of
+    * the stream from now on, whilst writing remains possible.
+    */
+   virtual Expected<bool> close_read() = 0;
 };
 
 /**
@@ -75,7 +195,9 @@ struct TCPConnection
  */
 struct TCPListener
 {
-   const int kDefaultListenBacklog = 512;
+   static const int kDefaultListenBacklog = 512;
+
+   virtual ~TCPListener() {}
 
    /**
     * accept listens for a new connection and returns a new Connection when
@@ -97,19 +219,241 @@ struct TCPListener
     * calling accept without its `t` argument.
     */
    virtual void timeout(const std::chrono::milliseconds& t) = 0;
+
+   /**
+    * fd returns the underlaying file descriptor, which remains owned by the
+    * listener, or -1 when the listener isn't backed by a socket of its own.
+    */
+   virtual int fd() const = 0;
+
+   /**
+    * stats returns what was counted on this listener so far, kept exact for
+    * one thread accepting at a time.
+    */
+   virtual IOCounters stats() const = 0;
+};
+
+// The concrete types the functions below return are defined in socket.hpp,
+// which is included at the end.
+struct TCPSocket;
+struct TCPSocketListener;
+struct UDPSocket;
+
+/**
+ * SocketTuning holds the socket options to set on a TCP socket as it's
+ * created, rather than one by one once it's connected. The defaults leave
+ * the kernel's defaults be.
+ */
+struct SocketTuning
+{
+   SocketTuning();
+
+   /**
+    * send_buffer and receive_buffer size the socket's buffers in bytes, which
+    * the kernel doubles for its bookkeeping and caps at `net.core.wmem_max`
+    * and `net.core.rmem_max`. Zero leaves them autotuned.
+    */
+   int send_buffer;
+   int receive_buffer;
+
+   /**
+    * no_delay disables Nagle's algorithm, like `TCPConnection::no_delay`.
+    */
+   bool no_delay;
+
+   /**
+    * quick_ack acknowledges received segments right away rather than
+    * delaying the acknowledgements, for as long as the kernel keeps to it.
+    */
+   bool quick_ack;
+
+   /**
+    * keepalive_idle enables keepalive probes once the connection has been
+    * idle for the given duration, which are sent every `keepalive_interval`
+    * until `keepalive_count` went unanswered. Zero leaves keepalive disabled,
+    * zeroes for the others the kernel's defaults.
+    */
+   std::chrono::seconds keepalive_idle;
+   std::chrono::seconds keepalive_interval;
+   int keepalive_count;
+
+   /**
+    * user_timeout bounds how long sent data may remain unacknowledged before
+    * the connection is dropped. Zero leaves it to the retransmission limits.
+    */
+   std::chrono::milliseconds user_timeout;
+
+   /**
+    * busy_poll has blocking reads poll the device for the given duration
+    * before sleeping, which takes `CAP_NET_ADMIN` beyond
+    * `net.core.busy_read`. Zero leaves it disabled.
+    */
+   std::chrono::microseconds busy_poll;
+
+   /**
+    * prefer_busy_poll has the device's interrupts deferred while busy polling
+    * keeps up, where the kernel supports it.
+    */
+   bool prefer_busy_poll;
+
+   /**
+    * spin is the budget of connections dialed or accepted with this tuning
+    * to spin for on reads, see `TCPSocket::spin`.
+    */
+   std::chrono::microseconds spin;
+
+   /**
+    * congestion names the congestion control algorithm, like "cubic" or
+    * "bbr", of those allowed by `net.ipv4.tcp_allowed_congestion_control`.
+    * Empty leaves the kernel's default.
+    */
+   std::string congestion;
+
+   /**
+    * priority sets the queueing priority of the socket's packets, from 0 to
+    * 6 without `CAP_NET_ADMIN`. A negative priority leaves the default.
+    */
+   int priority;
+};
+
+/**
+ * tuning_profile returns one of the named tunings: "default", "low-latency"
+ * (no delays, quick acknowledgements and an interactive priority), "bulk"
+ * (large buffers) or "mobile" (keepalives to hold on to NAT mappings and a
+ * bound on how long a vanished peer goes unnoticed).
+ */
+Expected<SocketTuning> tuning_profile(const std::string& name);
+
+/**
+ * TCPListenOptions tunes how a TCP listener is set up.
+ */
+struct TCPListenOptions
+{
+   TCPListenOptions();
+
+   /**
+    * backlog bounds the amount of connections awaiting `accept`, which
+    * defaults to `TCPListener::kDefaultListenBacklog`.
+    */
+   int backlog;
+
+   /**
+    * fast_open bounds the amount of pending TCP Fast Open requests, zero, the
+    * default, disabling Fast Open. With it, clients which connected before
+    * may send their first request along with the SYN, saving a round trip.
+    * The kernel only grants it once bit 2 of `net.ipv4.tcp_fastopen` is set.
+    */
+   int fast_open;
+
+   /**
+    * defer_accept holds back connections until their first bytes arrived, or
+    * until roughly the given duration passed, so that `accept` doesn't wake
+    * up for connections with nothing to read yet. Zero, the default,
+    * disables it.
+    */
+   std::chrono::seconds defer_accept;
+
+   /**
+    * reuse_port lets several listeners, of this process or others, bind the
+    * same address, the kernel spreading the incoming connections over them.
+    * It's off by default.
+    */
+   bool reuse_port;
+
+   /**
+    * tuning is set on the listening socket, from which the accepted sockets
+    * inherit all but `quick_ack` and `priority`, which are set on each of
+    * them instead.
+    */
+   SocketTuning tuning;
 };
 
 /**
  * listen_tcp creates a new listener which'll start listening for TCP
  * connections on the given address.
  */
-std::unique_ptr<TCPListener> listen_tcp(const std::string& address);
+std::unique_ptr<TCPSocketListener> listen_tcp(const std::string& address);
+std::unique_ptr<TCPSocketListener> listen_tcp(const std::string& address, const TCPListenOptions& options);
+
+/**
+ * listen_tcp_activated adopts the listening socket passed to the process
+ * through socket activation, as systemd does with `LISTEN_FDS`, which is
+ * called `name` in `LISTEN_FDNAMES` or, with an empty name, is bound to the
+ * given address. When there's none, it listens on the address like
+ * `listen_tcp` does. The adopted socket is set up with `options`, aside from
+ * `reuse_port`.
+ *
+ * The sockets passed, and the variables describing them, are taken out of
+ * the process's environment the first time this, or `listen_udp_activated`,
+ * is called, so that they're passed no further to any child processes.
+ */
+std::unique_ptr<TCPSocketListener> listen_tcp_activated(const std::string& address, const std::string& name);
+std::unique_ptr<TCPSocketListener> listen_tcp_activated(const std::string& address, const std::string& name, const TCPListenOptions& options);
+
+/**
+ * listen_tcp_sharded creates `shards` listeners sharing the given address,
+ * for each worker to accept on its own listener rather than all of them
+ * contending on one. They're set up with `options`, `reuse_port` aside. An
+ * address with port 0 has all of them listen on the port the first one got.
+ */
+std::vector<std::unique_ptr<TCPSocketListener>> listen_tcp_sharded(const std::string& address, size_t shards, const TCPListenOptions& options);
+
+/**
+ * Steering picks what a group of listeners sharing an address is steered by.
+ */
+enum class Steering
+{
+   /**
+    * cpu steers connections to the listener of which the index in the group
+    * is the CPU which handled the SYN, modulo the size of the group, to be
+    * accepted by a worker pinned to that CPU.
+    */
+   cpu,
+   /**
+    * remote_address steers all connections from the same address to the same
+    * listener.
+    */
+   remote_address,
+   /**
+    * remote_port steers by the remote port, which spreads a client's
+    * connections evenly over the listeners.
+    */
+   remote_port,
+};
+
+/**
+ * steer_reuseport attaches a classic BPF program to the `group` of listeners,
+ * as set up by `listen_tcp_sharded`, which picks the listener of each new
+ * connection by `key` rather than by the kernel's hash. The remote address or
+ * port is hashed along with `seed`, so that every process steering with the
+ * same seed picks the same listener; steering needs no privileges.
+ *
+ * The kernel indexes the group in the order the listeners were bound, and
+ * moves the last one into the place of one which is closed, so the group is
+ * to be steered again once its listeners changed.
+ */
+Expected<bool> steer_reuseport(const std::vector<std::unique_ptr<TCPSocketListener>>& group, Steering key);
+Expected<bool> steer_reuseport(const std::vector<std::unique_ptr<TCPSocketListener>>& group, Steering key, uint32_t seed);
 
 /**
  * dial_tcp creates a new TCP connection which'll try to connect to the given
- * address.
+ * address. dial_tcp_unique hands it to a single owner.
+ *
+ * The `tuning` is set on the socket before it connects.
+ *
+ * Given an `initial` payload, it's sent along with the SYN through TCP Fast
+ * Open when the server handed out a cookie on an earlier connection, and
+ * right after the handshake otherwise; either way, it's been sent in full
+ * once the connection is returned.
  */
-std::shared_ptr<TCPConnection> dial_tcp(const std::string& address);
+std::shared_ptr<TCPSocket> dial_tcp(const std::string& address);
+std::shared_ptr<TCPSocket> dial_tcp(const std::string& address, const std::vector<uint8_t>& initial);
+std::shared_ptr<TCPSocket> dial_tcp(const std::string& address, const SocketTuning& tuning);
+std::shared_ptr<TCPSocket> dial_tcp(const std::string& address, const SocketTuning& tuning, const std::vector<uint8_t>& initial);
+std::unique_ptr<TCPSocket> dial_tcp_unique(const std::string& address);
+std::unique_ptr<TCPSocket> dial_tcp_unique(const std::string& address, const std::vector<uint8_t>& initial);
+std::unique_ptr<TCPSocket> dial_tcp_unique(const std::string& address, const SocketTuning& tuning);
+std::unique_ptr<TCPSocket> dial_tcp_unique(const std::string& address, const SocketTuning& tuning, const std::vector<uint8_t>& initial);
 
 struct ReaderFrom
 {
@@ -147,6 +491,9 @@ struct WriterTo
  *
  * The UDP specific read and write mechanisms are defined `ReaderFrom` and
  * `WriterTo`.
+ *
+ * Unlike on a TCPConnection, reading zero bytes doesn't end anything: it is
+ * an empty datagram, which is as valid as any other.
  */
 struct UDPConnection
    : Connection
@@ -159,8 +506,8 @@ struct UDPConnection
    // methods.
 
    /**
-    * read on a dialing connection is forbidden, unless a call to `bind` ended
-    * in a success.
+    * read on a dialing connection only yields data sent by the dialed
+    * address, as the underlaying socket is connected to it.
     */
    using Reader::read;
    using ReaderFrom::read;
@@ -173,14 +520,25 @@ struct UDPConnection
 
 /**
  * listen_udp creates a new UDP connection which'll listen on the given
- * address.
+ * address. listen_udp_unique hands it to a single owner.
  */
-std::shared_ptr<UDPConnection> listen_udp(const std::string& address);
+std::shared_ptr<UDPSocket> listen_udp(const std::string& address);
+std::unique_ptr<UDPSocket> listen_udp_unique(const std::string& address);
+
+/**
+ * listen_udp_activated adopts the UDP socket passed through socket
+ * activation like `listen_tcp_activated` does, and falls back to
+ * `listen_udp`.
+ */
+std::shared_ptr<UDPSocket> listen_udp_activated(const std::string& address, const std::string& name);
 
 /**
  * dial_udp creates a new UDP connection which defaults it's reads from and
- * writes to the provided address.
+ * writes to the provided address. dial_udp_unique hands it to a single owner.
  */
-std::shared_ptr<UDPConnection> dial_udp(const std::string& address);
+std::shared_ptr<UDPSocket> dial_udp(const std::string& address);
+std::unique_ptr<UDPSocket> dial_udp_unique(const std::string& address);
+
+#include <socket.hpp>
 
 #endif
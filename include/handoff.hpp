@@ -0,0 +1,65 @@
+#ifndef _CPPSOCKET_HANDOFF
+#define _CPPSOCKET_HANDOFF
+
+#include <cppsocket.hpp>
+#include <expected.hpp>
+#include <socket.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * A process restarts without dropping or delaying connections by handing its
+ * listening sockets, and optionally its established connections, over to its
+ * successor before it exits. The sockets themselves are passed over a Unix
+ * socket, rather than being bound anew, so that the successor accepts from
+ * the very same accept queue: connections which arrive during the restart
+ * wait in it, whichever of the two processes accepts them.
+ *
+ * Once `hand_over` returned, the predecessor stops accepting and drains: it
+ * closes its listeners, which leaves them open in the successor, finishes
+ * the connections it kept and exits. The connections it handed over are to
+ * be dropped unused, as both processes reading them would split the data.
+ *
+ * The Unix socket is given as a path, or as a name in the abstract namespace
+ * when it starts with '@'.
+ */
+
+/**
+ * Inheritance holds what a successor took over from its predecessor.
+ */
+struct Inheritance
+{
+   std::vector<std::unique_ptr<TCPSocketListener>> listeners;
+   std::vector<std::unique_ptr<TCPSocket>> connections;
+};
+
+/**
+ * hand_over waits up to `t` for the successor to call `take_over` on `path`,
+ * hands it the sockets of the given `listeners` and `connections`, which
+ * remain open in this process as well, and waits for the successor to have
+ * taken them over. It returns the amount of sockets handed over. Only a
+ * successor running as this process's effective user is handed anything;
+ * anyone else connecting to `path` is turned away.
+ */
+Expected<size_t> hand_over(
+   const std::string& path,
+   const std::vector<int>& listeners,
+   const std::vector<int>& connections,
+   const std::chrono::milliseconds& t
+);
+
+/**
+ * take_over waits up to `t` for the predecessor to hand over its sockets on
+ * `path`. What of `tuning` accepted sockets don't inherit from the listening
+ * ones is set on the connections the listeners accept; options set on the
+ * sockets themselves carry over, but `TCPSocket::spin` doesn't. The sockets
+ * are received close-on-exec, and only from a predecessor running as this
+ * process's effective user.
+ */
+Expected<Inheritance> take_over(const std::string& path, const std::chrono::milliseconds& t);
+Expected<Inheritance> take_over(const std::string& path, const SocketTuning& tuning, const std::chrono::milliseconds& t);
+
+#endif
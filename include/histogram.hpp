@@ -0,0 +1,81 @@
+#ifndef _CPPSOCKET_HISTOGRAM
+#define _CPPSOCKET_HISTOGRAM
+
+#include <cstdint>
+
+/**
+ * Histogram records values into logarithmic buckets which are each split
+ * into linear sub-buckets, the way HDR histograms do. This keeps the
+ * relative error of every reported value within 1/16th, with a fixed amount
+ * of memory and without allocating.
+ *
+ * Values are typically latencies in nanoseconds; anything beyond
+ * `kMaxValue` is recorded as `kMaxValue`.
+ */
+struct Histogram
+{
+   static const int kSubBucketBits = 4;
+   static const int kMaxValueBits = 40;
+   static const uint64_t kMaxValue = (uint64_t(1) << kMaxValueBits) - 1;
+   static const int kBuckets = (kMaxValueBits - kSubBucketBits + 1) << kSubBucketBits;
+
+   Histogram();
+
+   void record(uint64_t v)
+   {
+      if (v > kMaxValue)
+         v = kMaxValue;
+      __counts[index(v)]++;
+      __count++;
+      __sum += v;
+      if (v > __max)
+         __max = v;
+   }
+
+   /**
+    * merge adds all values recorded by `h`.
+    */
+   void merge(const Histogram& h);
+
+   void reset();
+
+   uint64_t count() const;
+   uint64_t max() const;
+   /**
+    * sum returns the total of all recorded values, after clamping.
+    */
+   uint64_t sum() const;
+
+   /**
+    * percentile returns the value below which `p` percent of the recorded
+    * values fall, rounded up to the bounds of its sub-bucket.
+    */
+   uint64_t percentile(double p) const;
+
+   /**
+    * bucket returns the amount of values recorded in the `i`th bucket, and
+    * upper the largest value which falls in it.
+    */
+   uint64_t bucket(int i) const;
+   static uint64_t upper(int i);
+
+private:
+   // Threads recording into shards of their own are merged bucket by bucket.
+   friend struct ShardHistogram;
+
+   static int index(uint64_t v)
+   {
+      if (v < (uint64_t(1) << kSubBucketBits))
+         return static_cast<int>(v);
+      int shift = 63 - __builtin_clzll(v) - kSubBucketBits;
+      return (shift << kSubBucketBits) + static_cast<int>(v >> shift);
+   }
+
+private:
+   uint64_t __counts[kBuckets];
+   uint64_t __count;
+   uint64_t __sum;
+   uint64_t __max;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _CPPSOCKET_METRICS
+#define _CPPSOCKET_METRICS
+
+#include <cppsocket.hpp>
+#include <expected.hpp>
+#include <stats.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+/**
+ * prometheus_text renders `s` in the Prometheus text exposition format.
+ * Counters are suffixed with `_total`, and latencies are histograms in
+ * seconds with a bucket per power of two nanoseconds.
+ */
+std::string prometheus_text(const IOStats& s);
+
+/**
+ * MetricsEndpoint answers HTTP requests for `/metrics` with a snapshot of
+ * `io_stats()`, without the need for an HTTP framework.
+ *
+ * Each scrape aggregates the per thread statistics once; the I/O paths which
+ * record them never wait on a scrape.
+ */
+struct MetricsEndpoint
+{
+   virtual ~MetricsEndpoint() {}
+
+   /**
+    * request_timeout sets how long a scraper may take to send its request.
+    */
+   virtual void request_timeout(const std::chrono::milliseconds& t) = 0;
+
+   /**
+    * serve answers scrapes, one at a time, until `close` is called, after
+    * which it returns the amount of scrapes it answered.
+    */
+   virtual Expected<size_t> serve() = 0;
+   virtual void close() = 0;
+};
+
+/**
+ * metrics_tcp creates a new MetricsEndpoint answering the connections
+ * accepted by `listener`. Combined with `MuxListener::match` and
+ * `http1_prefixes`, metrics can share a port with another protocol.
+ */
+std::unique_ptr<MetricsEndpoint> metrics_tcp(const std::shared_ptr<TCPListener>& listener);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef _CPPSOCKET_MUX
+#define _CPPSOCKET_MUX
+
+#include <cppsocket.hpp>
+#include <expected.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * MuxListener serves several protocols on a single listening socket. Each
+ * accepted connection is sniffed by peeking at its first bytes, without
+ * consuming them, and handed to the sub-listener of the first matching
+ * protocol.
+ */
+struct MuxListener
+{
+   /**
+    * kMaxPrefixLength bounds the amount of bytes peeked at to make a decision.
+    */
+   static const size_t kMaxPrefixLength = 64;
+
+   virtual ~MuxListener() {}
+
+   /**
+    * match returns a listener which accepts the connections of which the
+    * first bytes start with any of the given `prefixes`. Matchers are tried in
+    * the order they were registered, and can't be registered once `serve` was
+    * called.
+    */
+   virtual std::shared_ptr<TCPListener> match(const std::vector<std::string>& prefixes) = 0;
+
+   /**
+    * match_any returns a listener which accepts the connections no matcher
+    * claimed. This includes the connections which didn't send anything within
+    * the sniff timeout, as is common for protocols where the server speaks
+    * first. Without it, those connections are closed.
+    */
+   virtual std::shared_ptr<TCPListener> match_any() = 0;
+
+   /**
+    * sniff_timeout sets how long an accepted connection may take to send
+    * enough bytes to be matched.
+    */
+   virtual void sniff_timeout(const std::chrono::milliseconds& t) = 0;
+
+   /**
+    * serve accepts and routes connections until `close` is called, after
+    * which it returns the amount of connections it routed.
+    */
+   virtual Expected<size_t> serve() = 0;
+
+   /**
+    * close stops `serve` and the sub-listeners. Accepting on a closed
+    * sub-listener results in a `std::runtime_error`.
+    */
+   virtual void close() = 0;
+};
+
+/**
+ * mux_tcp creates a new MuxListener routing the connections accepted by
+ * `listener`.
+ */
+std::unique_ptr<MuxListener> mux_tcp(std::unique_ptr<TCPListener> listener);
+
+/**
+ * http1_prefixes returns the prefixes of HTTP/1.x requests, to be handed to
+ * `MuxListener::match`.
+ */
+std::vector<std::string> http1_prefixes();
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef _CPPSOCKET_NETSIM
+#define _CPPSOCKET_NETSIM
+
+#include <cppsocket.hpp>
+#include <expected.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * Impairment describes how a simulated link degrades the traffic crossing it.
+ * Both directions of a link are impaired alike, but independently.
+ */
+struct Impairment
+{
+   Impairment();
+
+   /**
+    * latency is the one-way delay, which varies uniformly by up to `jitter`
+    * either way.
+    */
+   std::chrono::microseconds latency;
+   std::chrono::microseconds jitter;
+
+   /**
+    * loss is the probability of a datagram being dropped, or of a stream
+    * segment having to be retransmitted, which delays it and everything sent
+    * after it by a retransmission timeout.
+    */
+   double loss;
+
+   /**
+    * reorder is the probability of a datagram skipping the delay, overtaking
+    * those sent before it. Streams are always delivered in order.
+    */
+   double reorder;
+
+   /**
+    * bandwidth caps the link in bytes per second, zero leaving it uncapped.
+    * Once more than `queue` bytes await their turn, datagrams are dropped and
+    * stream writes block. A zero `queue` leaves it unbounded.
+    */
+   uint64_t bandwidth;
+   size_t queue;
+};
+
+/**
+ * impairment_profile returns one of the named impairments: "none", "lan",
+ * "wan", "lossy", "mobile" or "satellite".
+ */
+Expected<Impairment> impairment_profile(const std::string& name);
+
+/**
+ * SimulatedNetwork is an in-memory network of which every link is impaired,
+ * to measure protocols under latency, loss and congestion without needing
+ * privileges or `tc`. Its connections behave like those of the corresponding
+ * functions in `cppsocket.hpp`, except for having no file descriptor; `fd`
+ * returns -1. Once sized with `buffer_sizes`, the send buffer of a stream
+ * bounds how much of it is in flight, as a socket's would.
+ *
+ * The impairments are drawn from a generator seeded with the network's seed
+ * and the addresses of the link, so that the same traffic on the same
+ * addresses is impaired alike from run to run, regardless of the order in
+ * which links are set up. What remains of the timing is up to the scheduler.
+ */
+struct SimulatedNetwork
+{
+   /**
+    * kSegmentSize is the size of the segments stream writes are split into,
+    * each of which is impaired on its own.
+    */
+   static const size_t kSegmentSize = 1448;
+
+   virtual ~SimulatedNetwork() {}
+
+   /**
+    * listen_tcp and listen_udp claim the given address on the network. As
+    * nothing is bound for real, any host and port may be used.
+    */
+   virtual std::unique_ptr<TCPListener> listen_tcp(const std::string& address) = 0;
+   virtual std::shared_ptr<UDPConnection> listen_udp(const std::string& address) = 0;
+
+   /**
+    * dial_tcp connects to a listener on the network, taking a round trip, and
+    * dial_udp to any address on it. Dialing connections get an ephemeral
+    * port on 127.0.0.1.
+    */
+   virtual std::shared_ptr<TCPConnection> dial_tcp(const std::string& address) = 0;
+   virtual std::shared_ptr<UDPConnection> dial_udp(const std::string& address) = 0;
+};
+
+/**
+ * simulate_network creates a new SimulatedNetwork of which all links are
+ * impaired by `impairment`, as drawn from `seed`.
+ */
+std::shared_ptr<SimulatedNetwork> simulate_network(const Impairment& impairment, uint64_t seed);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _CPPSOCKET_PROXY
+#define _CPPSOCKET_PROXY
+
+#include <cppsocket.hpp>
+#include <expected.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+/**
+ * Proxy relays traffic between the peers of a listener and an upstream
+ * address.
+ */
+struct Proxy
+{
+   virtual ~Proxy() {}
+
+   /**
+    * idle_timeout sets the duration after which a session without any traffic
+    * in either direction is torn down. A negative duration, the default,
+    * leaves idle sessions be. It applies to the sessions started from then
+    * on, so it's to be set before serving.
+    */
+   virtual void idle_timeout(const std::chrono::milliseconds& t) = 0;
+
+   /**
+    * serve relays traffic until `close` is called, after which it returns the
+    * amount of sessions it proxied. SIGPIPE is blocked on the calling thread
+    * meanwhile.
+    */
+   virtual Expected<size_t> serve() = 0;
+
+   /**
+    * close stops `serve` and tears down all sessions.
+    */
+   virtual void close() = 0;
+};
+
+/**
+ * proxy_tcp creates a new Proxy which pairs each connection accepted by
+ * `listener` with a connection dialed to `upstream`. Bytes are moved in both
+ * directions with `splice`, so they never pass through userspace, and a
+ * half-close on one side is propagated to the other. The upstream address is
+ * resolved once, and connected to without blocking the other sessions.
+ */
+std::unique_ptr<Proxy> proxy_tcp(std::unique_ptr<TCPListener> listener, const std::string& upstream);
+
+/**
+ * proxy_udp creates a new Proxy which relays the datagrams received by
+ * `listener` to `upstream`, over a dialed connection per client, and the
+ * responses back to the client. Datagrams are received and sent in batches.
+ */
+std::unique_ptr<Proxy> proxy_udp(const std::shared_ptr<UDPConnection>& listener, const std::string& upstream);
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef _CPPSOCKET_RESP
+#define _CPPSOCKET_RESP
+
+#include <cppsocket.hpp>
+#include <expected.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * RESPType enumerates the RESP (REdis Serialization Protocol) value types by
+ * their leading byte.
+ */
+enum class RESPType : char
+{
+   simple_string = '+',
+   error = '-',
+   integer = ':',
+   bulk_string = '$',
+   array = '*',
+};
+
+/**
+ * RESPValue describes a single parsed value without copying its payload. The
+ * payload lives at `offset` in the buffer that was handed to the parser.
+ *
+ * Arrays are stored flattened: an array is directly followed by its elements,
+ * and `span` holds the amount of values (itself included) the array covers.
+ */
+struct RESPValue
+{
+   RESPType type;
+   bool null;
+   size_t offset;
+   /**
+    * length is the size of the payload for strings and errors, and the amount
+    * of elements for arrays.
+    */
+   size_t length;
+   int64_t integer;
+   size_t span;
+};
+
+/**
+ * RESPParser is an incremental parser for RESP replies (and commands, which
+ * are just arrays of bulk strings).
+ *
+ * The parser never copies; it only records offsets into the buffer it was
+ * given. Feed it the same, growing, buffer until a complete value is
+ * available. Parsing resumes where the previous call left off instead of
+ * starting over.
+ */
+struct RESPParser
+{
+   RESPParser();
+
+   /**
+    * parse continues parsing the first `n` bytes of `b`. It returns `true`
+    * once a complete value is available through `values`, and `false` when
+    * more data is required. A malformed stream results in a
+    * `std::runtime_error`, after which the parser should be discarded.
+    *
+    * Calling parse again after it returned `true` starts on the next value.
+    */
+   Expected<bool> parse(const uint8_t* b, size_t n);
+
+   /**
+    * values returns the values making up the last complete value, the first
+    * being the outermost one.
+    */
+   const std::vector<RESPValue>& values() const;
+
+   /**
+    * position returns the amount of bytes of the buffer which are taken by
+    * completely parsed values.
+    */
+   size_t position() const;
+
+   /**
+    * discard tells the parser the first `n` bytes were removed from the front
+    * of the buffer. `n` may not exceed `position`.
+    */
+   void discard(size_t n);
+
+private:
+   size_t __start;
+   size_t __pos;
+   bool __complete;
+   std::vector<RESPValue> __values;
+   std::vector<size_t> __open;
+   std::vector<size_t> __remaining;
+};
+
+/**
+ * RESPReply is a read-only view of a parsed value. It is only valid as long
+ * as the buffer and values it was created from are left untouched.
+ */
+struct RESPReply
+{
+   RESPReply(const uint8_t* b, const RESPValue* v);
+
+   RESPType type() const;
+   bool null() const;
+   bool error() const;
+   int64_t integer() const;
+
+   /**
+    * data and size expose the payload of strings and errors in-place.
+    */
+   const char* data() const;
+   size_t size() const;
+
+   /**
+    * str copies the payload of strings and errors.
+    */
+   std::string str() const;
+
+   /**
+    * elements returns the amount of elements of an array, and `at` the `i`th
+    * of those.
+    */
+   size_t elements() const;
+   RESPReply at(size_t i) const;
+
+private:
+   const uint8_t* __b;
+   const RESPValue* __v;
+};
+
+/**
+ * resp_command appends `args` to `b` encoded as a RESP command.
+ */
+void resp_command(std::vector<uint8_t>& b, const std::vector<std::string>& args);
+
+typedef std::function<void(const RESPReply&)> RESPHandler;
+
+/**
+ * RESPClient pipelines commands over a connection. Commands are appended
+ * locally, and written with a single write on `flush`, after which the
+ * replies are handed out in the order the commands were appended.
+ */
+struct RESPClient
+{
+   const size_t kDefaultChunkSize = 16 * 1024;
+
+   RESPClient(const std::shared_ptr<Connection>& conn);
+
+   /**
+    * append queues `args` as a command for the next flush.
+    */
+   void append(const std::vector<std::string>& args);
+
+   /**
+    * pending returns the amount of commands of which the reply hasn't been
+    * handled yet.
+    */
+   size_t pending() const;
+
+   /**
+    * flush writes all pending commands and calls `h` with each reply, in
+    * order. The connection is allowed to be unavailable for a duration of `t`
+    * on each underlaying read and write.
+    *
+    * Omitting `t` or providing a negative value for `t` will block until all
+    * replies are read.
+    *
+    * When a flush fails, the commands of which the reply wasn't handled
+    * remain pending; the next flush resumes writing and handing out their
+    * replies before those of commands appended since.
+    */
+   Expected<size_t> flush(const RESPHandler& h, const std::chrono::milliseconds& t);
+   Expected<size_t> flush(const RESPHandler& h);
+
+private:
+   std::shared_ptr<Connection> __conn;
+   std::vector<uint8_t> __wbuf;
+   size_t __pending;
+   std::vector<uint8_t> __rbuf;
+   std::vector<uint8_t> __chunk;
+   RESPParser __parser;
+};
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef _CPPSOCKET_SOCKET
+#define _CPPSOCKET_SOCKET
+
+#include <cppsocket.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * The concrete types below are what `dial_tcp`, `listen_tcp`, `listen_udp`
+ * and `dial_udp` hand out. As they're final, calls made through them rather
+ * than through the interfaces they implement are bound statically, and the
+ * overloads which merely forward to another one are inlined. Hold on to them
+ * as such where the transport is known up front, like in tight read and write
+ * loops; the interfaces remain for everything which is to work on any
+ * transport.
+ *
+ * The `_unique` variants of the functions, and `accept_unique`, hand out the
+ * connections to a single owner instead, for connections which are moved
+ * from one stage to the next rather than shared. Moving a `std::unique_ptr`
+ * doesn't touch a reference count, and sharing it later on remains possible
+ * by converting it into a `std::shared_ptr`.
+ */
+
+/**
+ * TCPSocket is a TCP connection backed by a socket of its own.
+ */
+struct TCPSocket final
+   : TCPConnection
+{
+   /**
+    * TCPSocket adopts the connected `socket`, which it closes when destroyed.
+    * The addresses are given as `local_addr` and `remote_addr` return them,
+    * like "tcp://127.0.0.1:80".
+    */
+   TCPSocket(int socket, const std::string& local_addr, const std::string& remote_addr);
+   ~TCPSocket();
+
+   TCPSocket(const TCPSocket&) = delete;
+   TCPSocket& operator=(const TCPSocket&) = delete;
+
+   Expected<size_t> read(std::vector<uint8_t>& b, const std::chrono::milliseconds& t);
+
+   Expected<size_t> read(std::vector<uint8_t>& b)
+   {
+      return read(b, std::chrono::milliseconds(-1));
+   }
+
+   Expected<size_t> write(const std::vector<uint8_t>& b, const std::chrono::milliseconds& t);
+
+   Expected<size_t> write(const std::vector<uint8_t>& b)
+   {
+      return write(b, std::chrono::milliseconds(-1));
+   }
+
+   void timeout(const std::chrono::microseconds& t)
+   {
+      read_timeout(t);
+      write_timeout(t);
+   }
+
+   void read_timeout(const std::chrono::microseconds& t);
+   void write_timeout(const std::chrono::microseconds& t);
+   void no_delay(bool d);
+   void buffer_sizes(int send, int receive);
+   Expected<TCPInfo> info() const;
+   Expected<bool> close_write();
+   Expected<bool> close_read();
+
+   /**
+    * incoming_cpu returns the CPU which last handled the connection's
+    * incoming packets, which is where its data is warm in the cache; see
+    * `CPURouter`.
+    */
+   Expected<int> incoming_cpu() const;
+
+   /**
+    * spin has reads try to receive without blocking for up to `budget`
+    * before waiting on the socket, trading a core's worth of CPU for not
+    * being put to sleep and woken up again when the data arrives in time. A
+    * zero budget, the default, disables spinning. Reads with timestamping
+    * enabled don't spin.
+    */
+   void spin(const std::chrono::microseconds& budget)
+   {
+      __spin = budget;
+   }
+
+   int fd() const noexcept
+   {
+      return __socket;
+   }
+
+   IOCounters stats() const noexcept;
+   void timestamping(bool enable);
+   std::chrono::system_clock::time_point received_at() const;
+   Expected<std::vector<SentTimestamp>> sent_at();
+
+   std::string local_addr() const noexcept
+   {
+      return __local_addr;
+   }
+
+   std::string remote_addr() const noexcept
+   {
+      return __remote_addr;
+   }
+
+private:
+   friend std::shared_ptr<TCPSocket> dial_tcp(const std::string& address, const SocketTuning& tuning, const std::vector<uint8_t>& initial);
+   friend std::unique_ptr<TCPSocket> dial_tcp_unique(const std::string& address, const SocketTuning& tuning, const std::vector<uint8_t>& initial);
+
+   /**
+    * State holds what only the library's own translation units know the
+    * layout of.
+    */
+   struct State;
+
+   /**
+    * __spin_read receives into `b` without blocking until anything arrived
+    * or `budget` passed, returning -1 with `errno` set to EAGAIN for the
+    * latter.
+    */
+   int64_t __spin_read(std::vector<uint8_t>& b, const std::chrono::microseconds& budget);
+
+   int __socket;
+   std::string __local_addr;
+   std::string __remote_addr;
+   std::chrono::microseconds __spin;
+   std::unique_ptr<State> __state;
+};
+
+/**
+ * TCPSocketListener is a TCP listener backed by a socket of its own.
+ */
+struct TCPSocketListener final
+   : TCPListener
+{
+   /**
+    * TCPSocketListener adopts the listening `socket`, which it closes when
+    * destroyed. What of `tuning` accepted sockets don't inherit from the
+    * listening one is set on each of them as they're accepted.
+    */
+   explicit TCPSocketListener(int socket);
+   TCPSocketListener(int socket, const SocketTuning& tuning);
+   ~TCPSocketListener();
+
+   TCPSocketListener(const TCPSocketListener&) = delete;
+   TCPSocketListener& operator=(const TCPSocketListener&) = delete;
+
+   /**
+    * accept_socket accepts like `accept` does, handing out the connection as
+    * the TCPSocket it is.
+    */
+   Expected<std::shared_ptr<TCPSocket>> accept_socket(const std::chrono::milliseconds& t);
+
+   Expected<std::shared_ptr<TCPSocket>> accept_socket()
+   {
+      return accept_socket(__timeout);
+   }
+
+   /**
+    * accept_unique accepts like `accept_socket` does, handing out the
+    * connection to a single owner.
+    */
+   Expected<std::unique_ptr<TCPSocket>> accept_unique(const std::chrono::milliseconds& t);
+
+   Expected<std::unique_ptr<TCPSocket>> accept_unique()
+   {
+      return accept_unique(__timeout);
+   }
+
+   Expected<std::shared_ptr<TCPConnection>> accept(const std::chrono::milliseconds& t)
+   {
+      auto accepted = accept_socket(t);
+      if (accepted.erred())
+         return accepted.exception();
+      return std::shared_ptr<TCPConnection>(std::move(accepted.get()));
+   }
+
+   Expected<std::shared_ptr<TCPConnection>> accept()
+   {
+      return accept(__timeout);
+   }
+
+   void timeout(const std::chrono::milliseconds& t)
+   {
+      __timeout = t;
+   }
+
+   int fd() const noexcept
+   {
+      return __socket;
+   }
+
+   IOCounters stats() const noexcept;
+
+   /**
+    * close releases this process's copy of the socket, after which accepting
+    * fails. Listeners sharing the socket, like a successor it was handed over
+    * to, keep accepting from it, connections already waiting included. Only
+    * once the last copy is closed are the waiting connections reset and new
+    * ones refused.
+    */
+   Expected<bool> close();
+
+   /**
+    * stop stops accepting on every copy of the socket: connections awaiting
+    * `accept` are reset, new ones are refused, and accepting fails from now
+    * on, in whichever process shares the socket; listeners merely sharing
+    * the port aren't affected. To hand over, `close` instead.
+    */
+   Expected<bool> stop();
+
+private:
+   /**
+    * __accept accepts a new socket, of which the peer's address is placed
+    * into `remote`.
+    */
+   Expected<int> __accept(const std::chrono::milliseconds& t, std::string& remote);
+
+private:
+   struct State;
+
+   int __socket;
+   std::string __local_addr;
+   std::chrono::milliseconds __timeout;
+   std::unique_ptr<State> __state;
+};
+
+/**
+ * drain shuts a server down without cutting its connections short: it closes
+ * `listener`, and then waits until `deadline` for each of `conns` to be done
+ * with. A connection is done with once whatever handled it let go of it, or
+ * once it was closed for writing and the peer acknowledged all that was
+ * written, its closing included. It returns how many weren't done with by the
+ * deadline, for the caller to close regardless.
+ *
+ * Only this process's copy of the listening socket is closed, so a successor
+ * it was handed over to keeps accepting. Without one, connections still
+ * waiting to be accepted are reset along with the socket: the caller accepts
+ * them first, to serve or to close, when they are to be answered.
+ */
+Expected<size_t> drain(
+   TCPSocketListener& listener,
+   const std::vector<std::weak_ptr<TCPConnection>>& conns,
+   const std::chrono::steady_clock::time_point& deadline
+);
+
+/**
+ * UDPSocket is a UDP connection backed by a socket of its own.
+ */
+struct UDPSocket final
+   : UDPConnection
+{
+   /**
+    * UDPSocket adopts the bound `socket`, which it closes when destroyed.
+    * Without a `remote_addr` it's a listening connection, otherwise the
+    * socket is to be connected to it. The addresses are given like
+    * "udp://127.0.0.1:53".
+    */
+   UDPSocket(int socket, const std::string& local_addr);
+   UDPSocket(int socket, const std::string& local_addr, const std::string& remote_addr);
+   ~UDPSocket();
+
+   UDPSocket(const UDPSocket&) = delete;
+   UDPSocket& operator=(const UDPSocket&) = delete;
+
+   Expected<size_t> read(std::vector<uint8_t>& b, std::string& remote, const std::chrono::milliseconds& t);
+
+   Expected<size_t> read(std::vector<uint8_t>& b, std::string& remote)
+   {
+      return read(b, remote, std::chrono::milliseconds(-1));
+   }
+
+   Expected<size_t> read(std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
+   {
+      std::string whom;
+      return read(b, whom, t);
+   }
+
+   Expected<size_t> read(std::vector<uint8_t>& b)
+   {
+      return read(b, std::chrono::milliseconds(-1));
+   }
+
+   Expected<size_t> write(const std::vector<uint8_t>& b, const std::string& remote, const std::chrono::milliseconds& t);
+
+   Expected<size_t> write(const std::vector<uint8_t>& b, const std::string& remote)
+   {
+      return write(b, remote, std::chrono::milliseconds(-1));
+   }
+
+   Expected<size_t> write(const std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
+   {
+      if (__remote_addr == unknown_addr)
+         return Expected<size_t>::unexpected(std::logic_error(
+            "UDPConnection::write: writing to receiving UDP connection without addressee"
+         ));
+      return write(b, __remote_addr, t);
+   }
+
+   Expected<size_t> write(const std::vector<uint8_t>& b)
+   {
+      return write(b, std::chrono::milliseconds(-1));
+   }
+
+   void timeout(const std::chrono::microseconds& t)
+   {
+      read_timeout(t);
+      write_timeout(t);
+   }
+
+   void read_timeout(const std::chrono::microseconds& t);
+   void write_timeout(const std::chrono::microseconds& t);
+
+   int fd() const noexcept
+   {
+      return __socket;
+   }
+
+   IOCounters stats() const noexcept;
+   void timestamping(bool enable);
+   std::chrono::system_clock::time_point received_at() const;
+   Expected<std::vector<SentTimestamp>> sent_at();
+
+   std::string local_addr() const noexcept
+   {
+      return __local_addr;
+   }
+
+   std::string remote_addr() const noexcept
+   {
+      return __remote_addr;
+   }
+
+private:
+   struct State;
+
+   int __socket;
+   std::string __local_addr;
+   std::string __remote_addr;
+   std::unique_ptr<State> __state;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef _CPPSOCKET_STATS
+#define _CPPSOCKET_STATS
+
+#include <histogram.hpp>
+
+#include <cstdint>
+
+/**
+ * IOCounters counts what happened on a connection, a listener, or the whole
+ * process.
+ */
+struct IOCounters
+{
+   uint64_t bytes_in;
+   uint64_t bytes_out;
+   uint64_t reads;
+   uint64_t writes;
+   uint64_t accepts;
+   uint64_t dials;
+   /**
+    * syscalls counts all socket related syscalls, including the polls also
+    * counted by `polls`.
+    */
+   uint64_t syscalls;
+   uint64_t polls;
+   uint64_t timeouts;
+   uint64_t eagains;
+   uint64_t errors;
+};
+
+/**
+ * IOStats holds the process wide counters and the latency distributions of
+ * each kind of operation, in nanoseconds.
+ *
+ * To keep the cost of timing out of the hot path, only one in
+ * `kLatencySampling` operations per thread is timed.
+ */
+struct IOStats
+{
+   static const unsigned kLatencySampling = 8;
+
+   IOCounters counters;
+   Histogram read_latency;
+   Histogram write_latency;
+   Histogram accept_latency;
+   Histogram dial_latency;
+};
+
+/**
+ * io_stats_enabled returns whether the library was built with statistics,
+ * through the CPPSOCKET_STATS option. Without them all counters remain zero.
+ */
+bool io_stats_enabled();
+
+/**
+ * io_stats aggregates the statistics recorded by all threads, those which
+ * exited included. Recording is lock-free per thread and never waits for
+ * aggregation, which visits every thread's storage.
+ */
+IOStats io_stats();
+
+#endif
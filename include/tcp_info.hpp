@@ -0,0 +1,71 @@
+#ifndef _CPPSOCKET_TCP_INFO
+#define _CPPSOCKET_TCP_INFO
+
+#include <cppsocket.hpp>
+#include <histogram.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TCPInfoSample
+{
+   std::string remote_addr;
+   TCPInfo info;
+};
+
+/**
+ * TCPInfoSummary condenses samples into what a load balancer or autoscaler
+ * cares about: how the round-trip times are distributed, and how much is
+ * being retransmitted.
+ */
+struct TCPInfoSummary
+{
+   size_t sampled;
+   /**
+    * rtt holds the smoothed round-trip times in microseconds.
+    */
+   Histogram rtt;
+   uint64_t retransmits;
+   uint64_t lost;
+   uint64_t bytes_retransmitted;
+};
+
+/**
+ * TCPInfoCollector samples the transport metrics of the connections it
+ * tracks, without keeping them alive.
+ *
+ * Each collect samples at most `per_collect` connections, continuing where
+ * the previous one left off, so that scraping a huge amount of connections
+ * can be spread out and its cost stays bounded.
+ */
+struct TCPInfoCollector
+{
+   TCPInfoCollector(size_t per_collect);
+
+   /**
+    * track adds `conn` to the connections to sample. Connections which are
+    * gone are forgotten during collect.
+    */
+   void track(const std::shared_ptr<TCPConnection>& conn);
+
+   /**
+    * tracked returns the amount of connections tracked, some of which might
+    * be gone already.
+    */
+   size_t tracked();
+
+   std::vector<TCPInfoSample> collect();
+
+   static TCPInfoSummary summarize(const std::vector<TCPInfoSample>& samples);
+
+private:
+   size_t __per_collect;
+   size_t __next;
+   std::mutex __lock;
+   std::vector<std::weak_ptr<TCPConnection>> __conns;
+};
+
+#endif
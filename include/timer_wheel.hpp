@@ -0,0 +1,142 @@
+#ifndef _CPPSOCKET_TIMER_WHEEL
+#define _CPPSOCKET_TIMER_WHEEL
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+/**
+ * TimerHandler is called with the data of each timer which comes due.
+ */
+typedef std::function<void(uint64_t)> TimerHandler;
+
+/**
+ * TimerWheel keeps track of large amounts of timers, like one or more per
+ * connection, in a hierarchy of wheels. Scheduling and cancelling are O(1),
+ * as is expiring a timer; wheels further out are cascaded into nearer ones
+ * only once per revolution of the wheel below them.
+ *
+ * Deadlines are rounded up to the wheel's tick, so that all timers due within
+ * the same tick are expired in one go, and timers never come due early. A
+ * timer comes due at most a tick late, besides however late `expire` is
+ * called.
+ *
+ * A TimerWheel isn't safe to be used from several threads at once; it's meant
+ * to be driven by the event loop of the connections it times.
+ */
+struct TimerWheel
+{
+   /**
+    * Timer identifies a scheduled timer, for it to be cancelled.
+    */
+   typedef uint64_t Timer;
+
+   /**
+    * kLevels wheels of kSlots slots each reach 2^40 ticks ahead; deadlines
+    * beyond that come due at the wheel's reach.
+    */
+   static const size_t kLevels = 5;
+   static const size_t kSlots = 256;
+
+   virtual ~TimerWheel() {}
+
+   /**
+    * schedule sets a timer, handing `data` to the handler of `expire` once
+    * `deadline` passed. Deadlines already passed come due on the next tick.
+    */
+   virtual Timer schedule(const std::chrono::steady_clock::time_point& deadline, uint64_t data) = 0;
+
+   /**
+    * cancel removes the given timer. It returns false when the timer already
+    * came due or was cancelled before.
+    */
+   virtual bool cancel(Timer timer) = 0;
+
+   /**
+    * expire calls `due` for each timer which came due by `now`, in the order
+    * of their deadlines' ticks, and returns how many there were. `due` may
+    * schedule and cancel timers itself.
+    */
+   virtual size_t expire(const std::chrono::steady_clock::time_point& now, const TimerHandler& due) = 0;
+
+   /**
+    * size returns the amount of timers pending.
+    */
+   virtual size_t size() const noexcept = 0;
+
+   /**
+    * fd returns a file descriptor which becomes readable once the next timer
+    * is due, to be waited upon with `poll` or `epoll` along with the
+    * connections. It's rearmed, and thereby cleared, by calling `expire` with
+    * the current time; it needn't be read.
+    */
+   virtual int fd() const noexcept = 0;
+};
+
+/**
+ * timer_wheel creates a new TimerWheel of which the ticks last `tick`. The
+ * coarser the tick, the more timers are batched into each wakeup.
+ */
+std::unique_ptr<TimerWheel> timer_wheel(const std::chrono::milliseconds& tick);
+
+/**
+ * Keepalive detects idle connections and paces heartbeats on them, on top of
+ * a TimerWheel. Connections are identified by an id of the caller's choosing,
+ * and report activity with `touch`, which merely records the time; the wheel
+ * only gets involved once a connection's timer comes due.
+ */
+struct Keepalive
+{
+   virtual ~Keepalive() {}
+
+   /**
+    * watch starts keeping track of connection `id`, as if it was just active.
+    * Watching an id which is watched already resets it.
+    */
+   virtual void watch(uint64_t id) = 0;
+
+   /**
+    * touch records activity on connection `id`.
+    */
+   virtual void touch(uint64_t id) = 0;
+
+   /**
+    * forget stops keeping track of connection `id`.
+    */
+   virtual void forget(uint64_t id) = 0;
+
+   /**
+    * expire calls the handlers for the connections which came due by `now`,
+    * and returns how many calls it made. A connection which went idle is
+    * forgotten before its handler is called.
+    */
+   virtual size_t expire(const std::chrono::steady_clock::time_point& now) = 0;
+
+   /**
+    * size returns the amount of connections watched.
+    */
+   virtual size_t size() const noexcept = 0;
+
+   /**
+    * fd returns the file descriptor of the underlying wheel, see
+    * `TimerWheel::fd`.
+    */
+   virtual int fd() const noexcept = 0;
+};
+
+/**
+ * keepalive creates a new Keepalive which calls `on_idle` for connections
+ * which haven't been active for `idle_timeout`, and `on_heartbeat` each time
+ * a connection has been neither active nor sent a heartbeat for `heartbeat`.
+ * Either is disabled by a negative duration. The wheel's tick is a sixteenth
+ * of the shorter duration, but at least a millisecond.
+ */
+std::unique_ptr<Keepalive> keepalive(
+   const std::chrono::milliseconds& idle_timeout,
+   const std::chrono::milliseconds& heartbeat,
+   const TimerHandler& on_idle,
+   const TimerHandler& on_heartbeat
+);
+
+#endif
@@ -0,0 +1,121 @@
+#include <accounting.hpp>
+
+#ifdef CPPSOCKET_ACCOUNTING
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cstdarg>
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t syscalls = 0;
+static thread_local uint64_t allocations = 0;
+
+bool accounting_enabled()
+{
+   return true;
+}
+
+Accounting accounting()
+{
+   return Accounting{syscalls, allocations};
+}
+
+// The library is linked with `--wrap` for each of these, which has its
+// calls go through `__wrap_<name>` and the actual function be reachable
+// as `__real_<name>`. The list is to be kept in line with CMakeLists.txt.
+#define CPPSOCKET_WRAP(ret, name, params, args) \
+   ret __real_##name params; \
+   ret __wrap_##name params \
+   { \
+      syscalls++; \
+      return __real_##name args; \
+   }
+
+extern "C" {
+
+CPPSOCKET_WRAP(int, accept, (int fd, struct sockaddr* a, socklen_t* l), (fd, a, l))
+CPPSOCKET_WRAP(int, bind, (int fd, const struct sockaddr* a, socklen_t l), (fd, a, l))
+CPPSOCKET_WRAP(int, close, (int fd), (fd))
+CPPSOCKET_WRAP(int, connect, (int fd, const struct sockaddr* a, socklen_t l), (fd, a, l))
+CPPSOCKET_WRAP(int, epoll_create1, (int flags), (flags))
+CPPSOCKET_WRAP(int, epoll_ctl, (int ep, int op, int fd, struct epoll_event* ev), (ep, op, fd, ev))
+CPPSOCKET_WRAP(int, epoll_wait, (int ep, struct epoll_event* ev, int n, int t), (ep, ev, n, t))
+CPPSOCKET_WRAP(int, eventfd, (unsigned int initval, int flags), (initval, flags))
+CPPSOCKET_WRAP(uid_t, geteuid, (void), ())
+CPPSOCKET_WRAP(int, getpeername, (int fd, struct sockaddr* a, socklen_t* l), (fd, a, l))
+CPPSOCKET_WRAP(int, getsockname, (int fd, struct sockaddr* a, socklen_t* l), (fd, a, l))
+CPPSOCKET_WRAP(int, getsockopt, (int fd, int level, int name, void* v, socklen_t* l), (fd, level, name, v, l))
+CPPSOCKET_WRAP(int, listen, (int fd, int backlog), (fd, backlog))
+CPPSOCKET_WRAP(int, pipe2, (int* fds, int flags), (fds, flags))
+CPPSOCKET_WRAP(int, poll, (struct pollfd* fds, nfds_t n, int t), (fds, n, t))
+CPPSOCKET_WRAP(ssize_t, read, (int fd, void* b, size_t n), (fd, b, n))
+CPPSOCKET_WRAP(ssize_t, recv, (int fd, void* b, size_t n, int flags), (fd, b, n, flags))
+CPPSOCKET_WRAP(ssize_t, recvfrom, (int fd, void* b, size_t n, int flags, struct sockaddr* a, socklen_t* l), (fd, b, n, flags, a, l))
+CPPSOCKET_WRAP(int, recvmmsg, (int fd, struct mmsghdr* m, unsigned int n, int flags, struct timespec* t), (fd, m, n, flags, t))
+CPPSOCKET_WRAP(ssize_t, recvmsg, (int fd, struct msghdr* m, int flags), (fd, m, flags))
+CPPSOCKET_WRAP(int, sendmmsg, (int fd, struct mmsghdr* m, unsigned int n, int flags), (fd, m, n, flags))
+CPPSOCKET_WRAP(ssize_t, sendmsg, (int fd, const struct msghdr* m, int flags), (fd, m, flags))
+CPPSOCKET_WRAP(ssize_t, sendto, (int fd, const void* b, size_t n, int flags, const struct sockaddr* a, socklen_t l), (fd, b, n, flags, a, l))
+CPPSOCKET_WRAP(int, setsockopt, (int fd, int level, int name, const void* v, socklen_t l), (fd, level, name, v, l))
+CPPSOCKET_WRAP(int, shutdown, (int fd, int how), (fd, how))
+CPPSOCKET_WRAP(int, socket, (int domain, int type, int protocol), (domain, type, protocol))
+CPPSOCKET_WRAP(ssize_t, splice, (int in, loff_t* inoff, int out, loff_t* outoff, size_t n, unsigned int flags), (in, inoff, out, outoff, n, flags))
+CPPSOCKET_WRAP(int, timerfd_create, (int clock, int flags), (clock, flags))
+CPPSOCKET_WRAP(int, timerfd_settime, (int fd, int flags, const struct itimerspec* v, struct itimerspec* old), (fd, flags, v, old))
+CPPSOCKET_WRAP(int, unlink, (const char* path), (path))
+CPPSOCKET_WRAP(ssize_t, write, (int fd, const void* b, size_t n), (fd, b, n))
+
+int __real_fcntl(int fd, int cmd, ...);
+int __wrap_fcntl(int fd, int cmd, ...)
+{
+   // All the commands the library uses take at most a single integer.
+   va_list ap;
+   va_start(ap, cmd);
+   long arg = va_arg(ap, long);
+   va_end(ap);
+   syscalls++;
+   return __real_fcntl(fd, cmd, arg);
+}
+
+}
+
+void* operator new(size_t n)
+{
+   allocations++;
+   void* p = std::malloc(n ? n : 1);
+   if (p == NULL)
+      throw std::bad_alloc();
+   return p;
+}
+
+void operator delete(void* p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+   std::free(p);
+}
+
+#else
+
+bool accounting_enabled()
+{
+   return false;
+}
+
+Accounting accounting()
+{
+   return Accounting{0, 0};
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include <activation.hpp>
+#include <address.hpp>
+
+namespace sys {
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+}
+
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+/**
+ * kListenFdsStart is the first of the file descriptors passed, as set by the
+ * socket activation protocol.
+ */
+static const int kListenFdsStart = 3;
+
+/**
+ * Activated is a socket passed through socket activation.
+ */
+struct Activated
+{
+   int socket;
+   int type;
+   std::string name;
+   bool taken;
+};
+
+/**
+ * Activation holds the sockets passed to the process, as found in the
+ * environment the first time one is asked for.
+ */
+struct Activation
+{
+   Activation()
+   {
+      const char* pid = std::getenv("LISTEN_PID");
+      const char* fds = std::getenv("LISTEN_FDS");
+      const char* names = std::getenv("LISTEN_FDNAMES");
+      // The variables are meant for this process only, not for its children;
+      // they're taken out of the environment either way.
+      bool ours = pid != NULL && fds != NULL && std::atol(pid) == sys::getpid();
+      std::string named(ours && names != NULL ? names : "");
+      int n = ours ? std::atoi(fds) : 0;
+      unsetenv("LISTEN_PID");
+      unsetenv("LISTEN_FDS");
+      unsetenv("LISTEN_FDNAMES");
+
+      size_t from = 0;
+      for (int socket = kListenFdsStart; socket < kListenFdsStart + n; socket++) {
+         Activated a;
+         a.socket = socket;
+         a.taken = false;
+         size_t to = named.find(':', from);
+         a.name = from < named.size() ? named.substr(from, to - from) : "";
+         from = to == std::string::npos ? named.size() : to + 1;
+         sys::socklen_t len(sizeof(a.type));
+         if (sys::getsockopt(socket, SOL_SOCKET, SO_TYPE, &a.type, &len) == -1)
+            continue;
+         // Passed on to children no further than the variables are.
+         sys::fcntl(socket, F_SETFD, sys::fcntl(socket, F_GETFD) | FD_CLOEXEC);
+         passed.push_back(a);
+      }
+   }
+
+   std::mutex lock;
+   std::vector<Activated> passed;
+};
+
+int activated_socket(int type, const std::string& name, const std::string& bound)
+{
+   static Activation activation;
+   std::lock_guard<std::mutex> lock(activation.lock);
+   for (auto& a : activation.passed) {
+      if (a.taken || a.type != type)
+         continue;
+      if (name.empty()) {
+         auto addr = netaddr(a.socket);
+         if (addr.erred() || addr.get() != bound)
+            continue;
+      } else if (a.name != name) {
+         continue;
+      }
+      a.taken = true;
+      return a.socket;
+   }
+   return -1;
+}
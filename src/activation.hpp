@@ -0,0 +1,14 @@
+#ifndef _CPPSOCKET_ACTIVATION
+#define _CPPSOCKET_ACTIVATION
+
+#include <string>
+
+/**
+ * activated_socket takes one of the sockets passed to the process through
+ * socket activation, of the given `type`: the one called `name`, or, without
+ * a name, the one bound to `bound`, like "127.0.0.1:80". Each of them is only
+ * taken once; -1 is returned when there's none left which matches.
+ */
+int activated_socket(int type, const std::string& name, const std::string& bound);
+
+#endif
@@ -0,0 +1,126 @@
+#include <address.hpp>
+#include <trace.hpp>
+
+namespace sys {
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+}
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+Expected<std::string> netaddr(const struct sys::sockaddr* sa)
+{
+   void *saina;
+   int port;
+   if (sa->sa_family == AF_INET) {
+      struct sys::sockaddr_in *sai = (struct sys::sockaddr_in *)sa;
+      port = sys::ntohs(sai->sin_port);
+      saina = &sai->sin_addr;
+   } else if (sa->sa_family == AF_INET6){
+      struct sys::sockaddr_in6 *sai = (struct sys::sockaddr_in6 *)sa;
+      port = sys::ntohs(sai->sin6_port);
+      saina = &sai->sin6_addr;
+   } else {
+      return Expected<std::string>::unexpected(std::runtime_error("netaddr: unsupported family"));
+   }
+   char str[INET6_ADDRSTRLEN];
+   if (sys::inet_ntop(sa->sa_family, saina, str, sizeof(str)) == NULL)
+      return Expected<std::string>::unexpected(std::runtime_error(
+         std::string("netaddr: unable to convert IP to human-readable form - ") + std::strerror(errno)
+      ));
+   return std::string(str) + ":" + std::to_string(port);
+}
+
+Expected<std::string> netaddr(int socket)
+{
+   struct sys::sockaddr_storage sas;
+   sys::socklen_t sasl(sizeof(sas));
+   if (getsockname(socket, (struct sys::sockaddr*)&sas, &sasl) == -1)
+      return Expected<std::string>::unexpected(std::runtime_error(
+         std::string("netaddr: unable to aquire localaddr - ") + std::strerror(errno)
+      ));
+   return netaddr((struct sys::sockaddr*)&sas);
+}
+
+Expected<std::string> peeraddr(int socket)
+{
+   struct sys::sockaddr_storage sas;
+   sys::socklen_t sasl(sizeof(sas));
+   if (getpeername(socket, (struct sys::sockaddr*)&sas, &sasl) == -1)
+      return Expected<std::string>::unexpected(std::runtime_error(
+         std::string("peeraddr: unable to aquire remoteaddr - ") + std::strerror(errno)
+      ));
+   return netaddr((struct sys::sockaddr*)&sas);
+}
+
+/**
+ * Snipper is a callable object that snips a part, up to the position of the
+ * provided delimiter, on each call and returns the snipped part which can
+ * either be a `const char*` or `NULL`.
+ *
+ * It is required to provide an estimate snips, to make sure the actual data
+ * doesn't get lost.
+ */
+struct Snipper
+{
+   Snipper(const std::string& str, int snips)
+      : __str(str)
+   {
+      __snipped.reserve(snips);
+   }
+
+   const char* remaining_or(const char* c) const
+   {
+      return __str != "" ? __str.c_str() : c;
+   }
+
+   const char* operator()(const std::string& delimiter)
+   {
+      int pos = __str.find(delimiter);
+      if (pos == std::string::npos)
+         return NULL;
+      __snipped.push_back(std::string(__str.substr(0, pos)));
+      __str = __str.substr(pos+delimiter.length(), __str.length());
+      return __snipped.at(__snipped.size()-1).c_str();
+   }
+
+private:
+   std::string __str;
+   std::vector<std::string> __snipped;
+};
+
+Expected<std::shared_ptr<struct sys::addrinfo>> resolve(const std::string& address)
+{
+   CPPSOCKET_PROBE(resolve_start, address.c_str());
+   Snipper snip(address, 3);
+   const char* protocol = snip("://");
+   const char* hostname = snip(":");
+   const char* port = snip.remaining_or("80");
+   struct sys::addrinfo hints, *resolved;
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   if (std::string(protocol) == "tcp")
+      hints.ai_socktype = sys::SOCK_STREAM;
+   else if (std::string(protocol) == "udp")
+      hints.ai_socktype = sys::SOCK_DGRAM;
+   else {
+      CPPSOCKET_PROBE(resolve_done, address.c_str(), EAI_SERVICE);
+      return Expected<std::shared_ptr<struct sys::addrinfo>>::unexpected(std::runtime_error(
+         std::string("resolve: unable to resolve \"") + address + "\" - Unsupported protocol \"" + protocol + "\""
+      ));
+   }
+   int status = sys::getaddrinfo(hostname, port, &hints, &resolved);
+   CPPSOCKET_PROBE(resolve_done, address.c_str(), status);
+   if (status != 0)
+      return Expected<std::shared_ptr<struct sys::addrinfo>>::unexpected(std::runtime_error(
+         std::string("resolve: trying to resolve \"") + address + "\" but failed - " + sys::gai_strerror(status)
+      ));
+   return std::shared_ptr<struct sys::addrinfo>(resolved, sys::freeaddrinfo);
+}
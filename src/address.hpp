@@ -0,0 +1,38 @@
+#ifndef _CPPSOCKET_ADDRESS
+#define _CPPSOCKET_ADDRESS
+
+#include <expected.hpp>
+
+#include <memory>
+#include <string>
+
+namespace sys {
+
+struct sockaddr;
+struct addrinfo;
+
+}
+
+/**
+ * netaddr attempts to deduce the IP and port for the given `sockaddr`.
+ */
+Expected<std::string> netaddr(const struct sys::sockaddr* sa);
+
+/**
+ * netaddr attempts to deduce the IP and port for the given socket reference.
+ */
+Expected<std::string> netaddr(int socket);
+
+/**
+ * peeraddr attempts to deduce the IP and port of the peer of the given
+ * connected socket.
+ */
+Expected<std::string> peeraddr(int socket);
+
+/**
+ * resolve resolves an address like "tcp://127.0.0.1:80" into the socket
+ * address to bind or connect to.
+ */
+Expected<std::shared_ptr<struct sys::addrinfo>> resolve(const std::string& address);
+
+#endif
@@ -0,0 +1,144 @@
+#include <affinity.hpp>
+
+// <thread> brings in <pthread.h> and <sched.h> outside of `sys` already, and
+// the CPU_* macros refer to what they declare unqualified.
+#include <pthread.h>
+#include <sched.h>
+
+namespace sys {
+
+#include <dirent.h>
+#include <unistd.h>
+
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+std::vector<int> cpus()
+{
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   std::vector<int> allowed;
+   if (sched_getaffinity(0, sizeof(set), &set) == -1)
+      return allowed;
+   for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &set))
+         allowed.push_back(cpu);
+   return allowed;
+}
+
+int numa_node(int cpu)
+{
+   if (cpu < 0)
+      return -1;
+   // The CPU's directory links to its node as "node<N>".
+   std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+   sys::DIR* dir = sys::opendir(path.c_str());
+   if (dir == NULL)
+      return -1;
+   int node = -1;
+   while (struct sys::dirent* entry = sys::readdir(dir)) {
+      const char* name = entry->d_name;
+      if (std::strncmp(name, "node", 4) != 0 || name[4] < '0' || name[4] > '9')
+         continue;
+      node = std::atoi(name + 4);
+      break;
+   }
+   sys::closedir(dir);
+   return node;
+}
+
+static Expected<bool> pin(pthread_t thread, int cpu)
+{
+   if (cpu < 0 || cpu >= CPU_SETSIZE)
+      return Expected<bool>::unexpected(std::invalid_argument(
+         std::string("pin_thread: no such CPU ") + std::to_string(cpu)
+      ));
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   CPU_SET(cpu, &set);
+   int err = pthread_setaffinity_np(thread, sizeof(set), &set);
+   if (err != 0)
+      return Expected<bool>::unexpected(std::runtime_error(
+         std::string("pin_thread: unable to pin to CPU ") + std::to_string(cpu) + " - " +
+         std::strerror(err)
+      ));
+   return true;
+}
+
+Expected<bool> pin_thread(int cpu)
+{
+   return pin(pthread_self(), cpu);
+}
+
+Expected<bool> pin_thread(std::thread& thread, int cpu)
+{
+   return pin(thread.native_handle(), cpu);
+}
+
+/**
+ * nodes looks up the NUMA node of every CPU up to `last`, and of those the
+ * system may bring online.
+ */
+static std::vector<int> nodes(int last)
+{
+   long configured = sys::sysconf(sys::_SC_NPROCESSORS_CONF);
+   std::vector<int> found(std::max<long>(last + 1, configured), -1);
+   for (size_t cpu = 0; cpu < found.size(); cpu++)
+      found[cpu] = numa_node(cpu);
+   return found;
+}
+
+CPURouter::CPURouter(const std::vector<int>& cpus)
+   : CPURouter(cpus, nodes(cpus.empty() ? 0 : *std::max_element(cpus.begin(), cpus.end())))
+{}
+
+CPURouter::CPURouter(const std::vector<int>& cpus, const std::vector<int>& nodes)
+   : __cpus(cpus)
+   , __next(0)
+{
+   if (cpus.empty())
+      throw std::invalid_argument("CPURouter::CPURouter: no workers to route to");
+   int last = *std::max_element(cpus.begin(), cpus.end());
+   if (*std::min_element(cpus.begin(), cpus.end()) < 0)
+      throw std::invalid_argument("CPURouter::CPURouter: negative CPU");
+   size_t span = std::max<size_t>(last + 1, nodes.size());
+   __workers.assign(span, -1);
+   __nodes.resize(span);
+   for (size_t i = 0; i < cpus.size(); i++)
+      if (__workers[cpus[i]] == -1)
+         __workers[cpus[i]] = i;
+   for (size_t cpu = 0; cpu < span; cpu++) {
+      int node = cpu < nodes.size() ? nodes[cpu] : -1;
+      if (node < 0)
+         continue;
+      for (size_t i = 0; i < cpus.size(); i++)
+         if (size_t(cpus[i]) < nodes.size() && nodes[cpus[i]] == node)
+            __nodes[cpu].push_back(i);
+   }
+}
+
+size_t CPURouter::route(int cpu) const
+{
+   if (cpu < 0)
+      return __next.fetch_add(1, std::memory_order_relaxed) % __cpus.size();
+   if (size_t(cpu) < __workers.size()) {
+      if (__workers[cpu] >= 0)
+         return __workers[cpu];
+      const auto& local = __nodes[cpu];
+      if (!local.empty())
+         return local[cpu % local.size()];
+   }
+   return cpu % __cpus.size();
+}
+
+size_t CPURouter::route(const TCPSocket& conn) const
+{
+   auto cpu = conn.incoming_cpu();
+   return route(cpu.erred() ? -1 : cpu.get());
+}
@@ -0,0 +1,164 @@
+#include <autotune.hpp>
+
+namespace sys {
+
+#include <sys/socket.h>
+
+}
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+const size_t BufferAutotuner::kMinBuffer;
+const size_t BufferAutotuner::kMaxBuffer;
+
+/**
+ * kernel_limit returns the largest buffer size the kernel lets a socket ask
+ * for, the lower of `net.core.wmem_max` and `net.core.rmem_max`, or 0 when
+ * it can't tell.
+ */
+static size_t kernel_limit()
+{
+   size_t limit = 0;
+   for (const char* path : {"/proc/sys/net/core/wmem_max", "/proc/sys/net/core/rmem_max"}) {
+      std::ifstream f(path);
+      size_t max = 0;
+      if (!(f >> max))
+         return 0;
+      limit = limit == 0 ? max : std::min(limit, max);
+   }
+   return limit;
+}
+
+/**
+ * effective returns the bytes the buffers of `conn` take up now that both
+ * were sized at `grant`. The kernel doubles what sockets ask for, after
+ * clamping it to its limits, so theirs are read back.
+ */
+static size_t effective(const TCPConnection& conn, size_t grant)
+{
+   int socket = conn.fd();
+   if (socket == -1)
+      return 2 * grant;
+   int send = 0;
+   int receive = 0;
+   sys::socklen_t length = sizeof(int);
+   if (sys::getsockopt(socket, SOL_SOCKET, SO_SNDBUF, &send, &length) == -1 ||
+       sys::getsockopt(socket, SOL_SOCKET, SO_RCVBUF, &receive, &length) == -1)
+      return 4 * grant;
+   return send + receive;
+}
+
+BufferAutotuner::BufferAutotuner(size_t budget)
+   : __budget(budget)
+   , __committed(0)
+   , __limit(kernel_limit())
+{}
+
+void BufferAutotuner::track(const std::shared_ptr<TCPConnection>& conn)
+{
+   std::lock_guard<std::mutex> lock(__lock);
+   __added.push_back(conn);
+}
+
+size_t BufferAutotuner::tracked()
+{
+   std::lock_guard<std::mutex> lock(__lock);
+   return __tuned.size() + __added.size();
+}
+
+size_t BufferAutotuner::committed()
+{
+   std::lock_guard<std::mutex> lock(__lock);
+   return __committed;
+}
+
+/**
+ * rate returns the bytes per second of `bytes` over `elapsed`.
+ */
+static double rate(uint64_t bytes, const std::chrono::steady_clock::duration& elapsed)
+{
+   double seconds = std::chrono::duration<double>(elapsed).count();
+   return seconds > 0 ? bytes / seconds : 0;
+}
+
+size_t BufferAutotuner::tune()
+{
+   // What's tuned is only touched by tune itself, so that tracking new
+   // connections doesn't have to wait on a syscall per connection.
+   std::vector<std::weak_ptr<TCPConnection>> added;
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      added.swap(__added);
+   }
+   for (const auto& conn : added) {
+      Tuned t;
+      t.conn = conn;
+      t.acked = 0;
+      t.received = 0;
+      t.wanted = kMinBuffer;
+      t.granted = 0;
+      t.effective = 0;
+      t.socket = false;
+      __tuned.push_back(t);
+   }
+
+   std::vector<std::shared_ptr<TCPConnection>> conns;
+   double wanted = 0;
+   for (size_t i = 0; i < __tuned.size();) {
+      Tuned& t = __tuned[i];
+      auto conn = t.conn.lock();
+      if (!conn) {
+         __tuned[i] = __tuned.back();
+         __tuned.pop_back();
+         continue;
+      }
+      auto info = conn->info();
+      if (!info.erred()) {
+         const TCPInfo& ti = info.get();
+         auto now = std::chrono::steady_clock::now();
+         double r = ti.delivery_rate;
+         if (t.sampled != std::chrono::steady_clock::time_point()) {
+            r = std::max(r, rate(ti.bytes_acked - t.acked, now - t.sampled));
+            r = std::max(r, rate(ti.bytes_received - t.received, now - t.sampled));
+         }
+         double bdp = r * std::chrono::duration<double>(ti.rtt).count();
+         t.wanted = std::min<double>(kMaxBuffer, std::max<double>(kMinBuffer, 2 * bdp));
+         t.sampled = now;
+         t.acked = ti.bytes_acked;
+         t.received = ti.bytes_received;
+      }
+      // Sockets get no more than the kernel allows, and take up twice that.
+      t.socket = conn->fd() != -1;
+      if (t.socket && __limit > 0)
+         t.wanted = std::min(t.wanted, std::max(__limit, kMinBuffer));
+      wanted += t.socket ? 2 * t.wanted : t.wanted;
+      conns.push_back(conn);
+      i++;
+   }
+
+   // Both buffers of every connection are granted the same size.
+   double scale = 2 * wanted > __budget ? __budget / (2 * wanted) : 1;
+   size_t resized = 0;
+   size_t committed = 0;
+   for (size_t i = 0; i < __tuned.size(); i++) {
+      Tuned& t = __tuned[i];
+      size_t grant = std::max<size_t>(kMinBuffer, t.wanted * scale);
+      if (t.granted == 0 || grant > t.granted + t.granted / 4 || grant < t.granted - t.granted / 4) {
+         try {
+            conns[i]->buffer_sizes(grant, grant);
+            t.granted = grant;
+            t.effective = effective(*conns[i], grant);
+            resized++;
+         } catch (const std::runtime_error&) {
+            // Left as it is, to be retried on the next tune.
+         }
+      }
+      committed += t.effective;
+   }
+
+   std::lock_guard<std::mutex> lock(__lock);
+   __committed = committed;
+   return resized;
+}
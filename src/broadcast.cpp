@@ -0,0 +1,272 @@
+#include <broadcast.hpp>
+
+namespace sys {
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+}
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+const int Broadcaster::kMaxBatch;
+
+Message make_message(std::vector<uint8_t>&& b)
+{
+   return std::make_shared<const std::vector<uint8_t>>(std::move(b));
+}
+
+struct BroadcasterImpl
+   : Broadcaster
+{
+   const std::chrono::milliseconds kPollInterval = std::chrono::milliseconds(100);
+
+   BroadcasterImpl(size_t max_queued, LagPolicy policy)
+      : __max_queued(max_queued)
+      , __policy(policy)
+      , __closed(false)
+   {
+      if (max_queued == 0)
+         throw std::invalid_argument("Broadcaster::Broadcaster: at least one message has to be queueable");
+      __epoll = sys::epoll_create1(sys::EPOLL_CLOEXEC);
+      if (__epoll == -1)
+         throw std::runtime_error(
+            std::string("Broadcaster::Broadcaster: unable to create epoll instance - ") +
+            std::strerror(errno)
+         );
+      __stats.published = 0;
+      __stats.delivered = 0;
+      __stats.dropped = 0;
+      __stats.disconnected = 0;
+   }
+
+   ~BroadcasterImpl()
+   {
+      sys::close(__epoll);
+   }
+
+   void subscribe(const std::shared_ptr<TCPConnection>& conn)
+   {
+      int fd = conn->fd();
+      int flags = sys::fcntl(fd, F_GETFL, 0);
+      if (flags == -1 || sys::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+         throw std::runtime_error(
+            std::string("Broadcaster::subscribe: unable to make the connection non-blocking - ") +
+            std::strerror(errno)
+         );
+      std::lock_guard<std::mutex> lock(__lock);
+      struct sys::epoll_event ev;
+      ev.events = 0;
+      ev.data.fd = fd;
+      if (sys::epoll_ctl(__epoll, EPOLL_CTL_ADD, fd, &ev) == -1)
+         throw std::runtime_error(
+            std::string("Broadcaster::subscribe: unable to watch the connection - ") +
+            std::strerror(errno)
+         );
+      Subscriber& s = __subscribers[fd];
+      s.conn = conn;
+      s.offset = 0;
+      s.lagging = false;
+   }
+
+   void unsubscribe(const std::shared_ptr<TCPConnection>& conn)
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      remove(conn->fd());
+   }
+
+   size_t subscribers()
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      return __subscribers.size();
+   }
+
+   void publish(const Message& m)
+   {
+      Queued q{m, std::chrono::steady_clock::now()};
+      std::lock_guard<std::mutex> lock(__lock);
+      __stats.published++;
+      std::vector<int> failed;
+      for (auto& entry : __subscribers) {
+         Subscriber& s = entry.second;
+         if (s.queue.size() >= __max_queued) {
+            if (__policy == LagPolicy::disconnect) {
+               failed.push_back(entry.first);
+               continue;
+            }
+            __stats.dropped++;
+            if (__policy == LagPolicy::drop_newest)
+               continue;
+            // The message at the front might be partially written already,
+            // dropping it would corrupt the stream.
+            auto oldest = s.queue.begin() + (s.offset > 0 ? 1 : 0);
+            if (oldest == s.queue.end())
+               continue;
+            s.queue.erase(oldest);
+         }
+         s.queue.push_back(q);
+         if (s.lagging)
+            continue;
+         if (!flush(s))
+            failed.push_back(entry.first);
+         else if (!s.queue.empty())
+            lag(entry.first, s, true);
+      }
+      for (int fd : failed) {
+         __stats.disconnected++;
+         remove(fd);
+      }
+   }
+
+   Expected<bool> serve()
+   {
+      struct sys::epoll_event events[kMaxBatch];
+      while (!__closed) {
+         int n = sys::epoll_wait(__epoll, events, kMaxBatch, kPollInterval.count());
+         if (n == -1) {
+            if (errno == EINTR)
+               continue;
+            return Expected<bool>::unexpected(std::runtime_error(
+               std::string("Broadcaster::serve: failed to wait for events - ") + std::strerror(errno)
+            ));
+         }
+         std::lock_guard<std::mutex> lock(__lock);
+         for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            auto found = __subscribers.find(fd);
+            if (found == __subscribers.end())
+               continue;
+            Subscriber& s = found->second;
+            if ((events[i].events & (sys::EPOLLERR | sys::EPOLLHUP)) || !flush(s)) {
+               __stats.disconnected++;
+               remove(fd);
+            } else if (s.queue.empty()) {
+               lag(fd, s, false);
+            }
+         }
+      }
+      return true;
+   }
+
+   void close()
+   {
+      __closed = true;
+   }
+
+   BroadcastStats stats()
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      return __stats;
+   }
+
+private:
+   struct Queued
+   {
+      Message message;
+      std::chrono::steady_clock::time_point published;
+   };
+
+   struct Subscriber
+   {
+      std::shared_ptr<TCPConnection> conn;
+      std::deque<Queued> queue;
+      /**
+       * offset is the amount of bytes of the front message written already.
+       */
+      size_t offset;
+      bool lagging;
+   };
+
+   /**
+    * flush writes as many queued messages as possible with a single gathering
+    * write per batch. It returns `false` when the subscriber failed.
+    */
+   bool flush(Subscriber& s)
+   {
+      struct sys::iovec iov[kMaxBatch];
+      while (!s.queue.empty()) {
+         int n = 0;
+         for (auto it = s.queue.begin(); it != s.queue.end() && n < kMaxBatch; ++it, ++n) {
+            const std::vector<uint8_t>& b = *it->message;
+            size_t skip = n == 0 ? s.offset : 0;
+            iov[n].iov_base = const_cast<uint8_t*>(b.data()) + skip;
+            iov[n].iov_len = b.size() - skip;
+         }
+         struct sys::msghdr msg;
+         std::memset(&msg, 0, sizeof(msg));
+         msg.msg_iov = iov;
+         msg.msg_iovlen = n;
+         // sendmsg rather than writev, solely to not be killed by SIGPIPE.
+         ssize_t written = sys::sendmsg(s.conn->fd(), &msg, sys::MSG_NOSIGNAL | sys::MSG_DONTWAIT);
+         if (written < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+
+         auto now = std::chrono::steady_clock::now();
+         size_t left = written;
+         while (!s.queue.empty()) {
+            size_t remaining = s.queue.front().message->size() - s.offset;
+            if (left < remaining) {
+               s.offset += left;
+               break;
+            }
+            left -= remaining;
+            __stats.delivered++;
+            __stats.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+               now - s.queue.front().published
+            ).count());
+            s.queue.pop_front();
+            s.offset = 0;
+         }
+         if (!s.queue.empty() && s.offset > 0)
+            return true;
+      }
+      return true;
+   }
+
+   /**
+    * lag has `serve` pick up the subscriber once it's writable, or stop doing
+    * so once it caught up.
+    */
+   void lag(int fd, Subscriber& s, bool lagging)
+   {
+      struct sys::epoll_event ev;
+      ev.events = lagging ? static_cast<uint32_t>(sys::EPOLLOUT) : 0;
+      ev.data.fd = fd;
+      sys::epoll_ctl(__epoll, EPOLL_CTL_MOD, fd, &ev);
+      s.lagging = lagging;
+   }
+
+   void remove(int fd)
+   {
+      auto found = __subscribers.find(fd);
+      if (found == __subscribers.end())
+         return;
+      sys::epoll_ctl(__epoll, EPOLL_CTL_DEL, fd, NULL);
+      __subscribers.erase(found);
+   }
+
+private:
+   size_t __max_queued;
+   LagPolicy __policy;
+   int __epoll;
+   std::mutex __lock;
+   std::unordered_map<int, Subscriber> __subscribers;
+   BroadcastStats __stats;
+   std::atomic<bool> __closed;
+};
+
+std::unique_ptr<Broadcaster> broadcast_tcp(size_t max_queued, LagPolicy policy)
+{
+   return std::unique_ptr<Broadcaster>(new BroadcasterImpl(max_queued, policy));
+}
@@ -1,4 +1,10 @@
 #include <cppsocket.hpp>
+#include <socket.hpp>
+#include <activation.hpp>
+#include <address.hpp>
+#include <instrument.hpp>
+#include <trace.hpp>
+#include <tuning.hpp>
 
 namespace sys {
 
@@ -10,597 +16,1379 @@ namespace sys {
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
 
 }
 
+// The CMSG_* macros refer to an unqualified `struct cmsghdr`.
+using sys::cmsghdr;
+
+#include <algorithm>
 #include <cstring>
+#include <deque>
 #include <mutex>
 #include <stdexcept>
+#include <thread>
 #include <unordered_map>
 
-/**
- * netaddr attempts to deduce the IP and port for the given `sockaddr`.
- */
-static Expected<std::string> netaddr(const struct sys::sockaddr* sa)
-{
-   void *saina;
-   int port;
-   if (sa->sa_family == AF_INET) {
-      struct sys::sockaddr_in *sai = (struct sys::sockaddr_in *)&sa;
-      port = sys::ntohs(sai->sin_port);
-      saina = &(((struct sys::sockaddr_in*)sa)->sin_addr);
-   } else if (sa->sa_family == AF_INET6){
-      struct sys::sockaddr_in6 *sai = (struct sys::sockaddr_in6 *)&sa;
-      port = sys::ntohs(sai->sin6_port);
-      saina = &(((struct sys::sockaddr_in6*)sa)->sin6_addr);
-   } else {
-      return Expected<std::string>::unexpected(std::runtime_error("netaddr: unsupported family"));
-   }
-   char str[INET6_ADDRSTRLEN];
-   if (sys::inet_ntop(sa->sa_family, saina, str, sizeof(str)) == NULL)
-      return Expected<std::string>::unexpected(std::runtime_error(
-         std::string("netaddr: unable to convert IP to human-readable form - ") + std::strerror(errno)
-      ));
-   return std::string(str) + ":" + std::to_string(port);
-}
-
-/**
- * netaddr attempts to deduce the IP and port for the given socket reference.
- */
-static Expected<std::string> netaddr(int socket)
+static std::chrono::system_clock::time_point time_point(const struct timespec& ts)
 {
-   struct sys::sockaddr_storage sas;
-   sys::socklen_t sasl(sizeof(sas));
-   if (getsockname(socket, (struct sys::sockaddr*)&sas, &sasl) == -1)
-      return Expected<std::string>::unexpected(std::runtime_error(
-         std::string("netaddr: unable to aquire localaddr - ") + std::strerror(errno)
-      ));
-   return netaddr((struct sys::sockaddr*)&sas);
+   return std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+         std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec)
+      )
+   );
 }
 
 /**
- * Snipper is a callable object that snips a part, up to the position of the
- * provided delimiter, on each call and returns the snipped part which can
- * either be a `const char*` or `NULL`.
- *
- * It is required to provide an estimate snips, to make sure the actual data
- * doesn't get lost.
+ * Timestamper implements the kernel timestamping of a connection. Receive
+ * timestamps come along with the received data, whereas transmit timestamps
+ * are queued on the socket's error queue.
  */
-struct Snipper
+struct Timestamper
 {
-   Snipper(const std::string& str, int snips)
-      : __str(str)
-   {
-      __snipped.reserve(snips);
-   }
+   /**
+    * kMaxSent bounds the amount of transmit timestamps held on to when they
+    * aren't collected; the oldest ones are dropped first.
+    */
+   static const size_t kMaxSent = 4096;
 
-   const char* remaining_or(const char* c) const
-   {
-      return __str != "" ? __str.c_str() : c;
-   }
+   Timestamper()
+      : __enabled(false)
+   {}
 
-   const char* operator()(const std::string& delimiter)
+   bool enabled() const
    {
-      int pos = __str.find(delimiter);
-      if (pos == std::string::npos)
-         return NULL;
-      __snipped.push_back(std::string(__str.substr(0, pos)));
-      __str = __str.substr(pos+delimiter.length(), __str.length());
-      return __snipped.at(__snipped.size()-1).c_str();
+      return __enabled;
    }
 
-private:
-   std::string __str;
-   std::vector<std::string> __snipped;
-};
-
-static Expected<std::shared_ptr<struct sys::addrinfo>> resolve(const std::string& address)
-{
-   Snipper snip(address, 3);
-   const char* protocol = snip("://");
-   const char* hostname = snip(":");
-   const char* port = snip.remaining_or("80");
-   struct sys::addrinfo hints, *resolved;
-   memset(&hints, 0, sizeof(hints));
-   hints.ai_family = AF_UNSPEC;
-   if (std::string(protocol) == "tcp")
-      hints.ai_socktype = sys::SOCK_STREAM;
-   else if (std::string(protocol) == "udp")
-      hints.ai_socktype = sys::SOCK_DGRAM;
-   else
-      return Expected<std::shared_ptr<struct sys::addrinfo>>::unexpected(std::runtime_error(
-         std::string("resolve: unable to resolve \"") + address + "\" - Unsupported protocol \"" + protocol + "\""
-      ));
-   int status = sys::getaddrinfo(hostname, port, &hints, &resolved);
-   if (status != 0)
-      return Expected<std::shared_ptr<struct sys::addrinfo>>::unexpected(std::runtime_error(
-         std::string("resolve: trying to resolve \"") + address + "\" but failed - " + sys::gai_strerror(status)
-      ));
-   return std::shared_ptr<struct sys::addrinfo>(resolved, sys::freeaddrinfo);
-}
-
-struct UDPConnectionImpl
-   : UDPConnection
-{
-   // Sending
-   UDPConnectionImpl(const std::shared_ptr<struct sys::addrinfo>& resolved, const std::string& dialing)
+   void enable(int socket, bool e)
    {
-      __socket = sys::socket(resolved->ai_family, resolved->ai_socktype, resolved->ai_protocol);
-      if (__socket == -1)
-         throw std::runtime_error(
-            std::string("UDPConnection::UDPConnection: unable to acquire socket - ") +
-            std::strerror(errno)
-         );
-      if (sys::connect(__socket, resolved->ai_addr, resolved->ai_addrlen) == -1)
+      int flags = !e ? 0 :
+         sys::SOF_TIMESTAMPING_SOFTWARE |
+         sys::SOF_TIMESTAMPING_RX_SOFTWARE |
+         sys::SOF_TIMESTAMPING_TX_SOFTWARE |
+         sys::SOF_TIMESTAMPING_OPT_ID |
+         sys::SOF_TIMESTAMPING_OPT_TSONLY;
+      if (sys::setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == -1)
          throw std::runtime_error(
-            std::string("UDPConnection::UDPConnection: unable to connect socket - ") +
+            std::string("Connection::timestamping: unable to set SO_TIMESTAMPING - ") +
             std::strerror(errno)
          );
-      __local_addr = std::string("udp://") + netaddr(__socket).get();
-      __remote_addr = dialing;
+      __enabled = e;
    }
 
-   // Receiving
-   UDPConnectionImpl(const std::shared_ptr<struct sys::addrinfo>& resolved)
+   /**
+    * wait polls `pfd` for up to `t`, and resumes polling with what remains of
+    * `t` for as long as poll only reported transmit timestamps.
+    */
+   int wait(int socket, struct sys::pollfd& pfd, const std::chrono::milliseconds& t)
    {
-      __socket = sys::socket(resolved->ai_family, resolved->ai_socktype, resolved->ai_protocol);
-      if (__socket == -1)
-         throw std::runtime_error(
-            std::string("UDPConnection::UDPConnection: unable to acquire socket - ") +
-            std::strerror(errno)
-         );
-      if (sys::bind(__socket, resolved->ai_addr, resolved->ai_addrlen) == -1)
-         throw std::runtime_error(
-            std::string("UDPConnection::UDPConnection: unable to bind socket - ") +
-            std::strerror(errno)
+      if (!__enabled)
+         return sys::poll(&pfd, 1, t.count());
+      auto deadline = std::chrono::steady_clock::now() + t;
+      int result = sys::poll(&pfd, 1, t.count());
+      while (result > 0 && absorbs(socket, pfd)) {
+         auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now() + std::chrono::microseconds(999)
          );
-      __local_addr = (std::string("udp://") + netaddr(resolved->ai_addr).get());
-      __remote_addr = unknown_addr;
+         result = sys::poll(&pfd, 1, t.count() < 0 ? -1 : std::max<int64_t>(left.count(), 0));
+      }
+      return result;
    }
 
-   void timeout(const std::chrono::microseconds& t)
+   /**
+    * absorbs determines whether poll only reported the socket's error queue
+    * holding transmit timestamps, which it collects, in which case polling is
+    * to be resumed. Otherwise it clears POLLERR if that was all there was to
+    * it. Only writes queue timestamps, so resuming polling can't go on
+    * indefinitely.
+    */
+   bool absorbs(int socket, struct sys::pollfd& pfd)
    {
-      read_timeout(t);
-      write_timeout(t);
+      if (!__enabled || !(pfd.revents & POLLERR))
+         return false;
+      int err = 0;
+      sys::socklen_t errl(sizeof(err));
+      if (sys::getsockopt(socket, SOL_SOCKET, SO_ERROR, &err, &errl) == -1 || err != 0) {
+         errno = err;
+         return false;
+      }
+      collect(socket);
+      pfd.revents &= ~POLLERR;
+      return !(pfd.revents & pfd.events);
    }
 
-   void read_timeout(const std::chrono::microseconds& t)
+   /**
+    * recv receives like `recvfrom` does, whilst noting the receive timestamp.
+    */
+   ssize_t recv(int socket, void* b, size_t n, struct sys::sockaddr* from, sys::socklen_t* froml)
    {
-      const std::chrono::seconds s = std::chrono::duration_cast<std::chrono::seconds>(t);
-      struct timeval tv;
-      tv.tv_sec = s.count();
-      tv.tv_usec = (t - s).count();
-      if (sys::setsockopt(__socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))  == -1)
-         throw new std::runtime_error(
-            std::string("UDPConnection::read_timeout: unable to set read timeout - ") +
-            std::strerror(errno)
-         );
+      struct sys::iovec iov;
+      iov.iov_base = b;
+      iov.iov_len = n;
+      char control[CMSG_SPACE(sizeof(struct sys::scm_timestamping))];
+      struct sys::msghdr msg;
+      std::memset(&msg, 0, sizeof(msg));
+      msg.msg_name = from;
+      msg.msg_namelen = froml ? *froml : 0;
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      ssize_t s = sys::recvmsg(socket, &msg, 0);
+      if (s < 0)
+         return s;
+      if (froml)
+         *froml = msg.msg_namelen;
+      std::chrono::system_clock::time_point received;
+      for (struct sys::cmsghdr* c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+         if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING) {
+            struct sys::scm_timestamping ts;
+            std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            received = time_point(ts.ts[0]);
+         }
+      }
+      std::lock_guard<std::mutex> lock(__lock);
+      __received = received;
+      return s;
    }
 
-   void write_timeout(const std::chrono::microseconds& t)
+   std::chrono::system_clock::time_point received() const
    {
-      const std::chrono::seconds s = std::chrono::duration_cast<std::chrono::seconds>(t);
-      struct timeval tv;
-      tv.tv_sec = s.count();
-      tv.tv_usec = (t - s).count();
-      if (sys::setsockopt(__socket, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == -1)
-         throw new std::runtime_error(
-            std::string("UDPConnection::read_timeout: unable to set write timeout - ") +
-            std::strerror(errno)
-         );
+      std::lock_guard<std::mutex> lock(__lock);
+      return __received;
    }
 
-   std::string local_addr() const noexcept
+   Expected<std::vector<SentTimestamp>> sent(int socket)
    {
-      return __local_addr;
+      if (!collect(socket))
+         return Expected<std::vector<SentTimestamp>>::unexpected(std::runtime_error(
+            std::string("Connection::sent_at: unable to read the error queue - ") +
+            std::strerror(errno)
+         ));
+      std::lock_guard<std::mutex> lock(__lock);
+      std::vector<SentTimestamp> sent(__sent.begin(), __sent.end());
+      __sent.clear();
+      return sent;
    }
 
-   std::string remote_addr() const noexcept
+private:
+   /**
+    * collect moves the timestamps from the error queue into `__sent`.
+    */
+   bool collect(int socket)
    {
-      return __remote_addr;
-   }
+      for (;;) {
+         char control[CMSG_SPACE(sizeof(struct sys::scm_timestamping)) + CMSG_SPACE(sizeof(struct sys::sock_extended_err) + 64)];
+         struct sys::msghdr msg;
+         std::memset(&msg, 0, sizeof(msg));
+         msg.msg_control = control;
+         msg.msg_controllen = sizeof(control);
+         if (sys::recvmsg(socket, &msg, sys::MSG_ERRQUEUE | sys::MSG_DONTWAIT) < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
 
-   Expected<size_t> read(std::vector<uint8_t>& b, std::string& remote, const std::chrono::milliseconds& t)
-   {
-      {
-         struct sys::pollfd pfd;
-         pfd.fd = __socket;
-         pfd.events = POLLIN;
-         int result = poll(&pfd, 1, t.count());
-         if (result == -1 || pfd.revents & POLLERR)
-            return Expected<size_t>::unexpected(std::runtime_error(std::string("UDPConnection::read: failed to poll the socket - ") + std::strerror(errno)));
-         if (result == 0)
-            return Expected<size_t>::unexpected(std::logic_error("UDPConnection::read: timeout whilst polling the socket"));
+         bool stamped = false;
+         SentTimestamp st;
+         st.id = 0;
+         for (struct sys::cmsghdr* c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING) {
+               struct sys::scm_timestamping ts;
+               std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+               st.at = time_point(ts.ts[0]);
+               stamped = true;
+            } else {
+               struct sys::sock_extended_err ee;
+               std::memcpy(&ee, CMSG_DATA(c), sizeof(ee));
+               if (ee.ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+                  st.id = ee.ee_data;
+            }
+         }
+         if (!stamped)
+            continue;
+         std::lock_guard<std::mutex> lock(__lock);
+         if (__sent.size() == kMaxSent)
+            __sent.pop_front();
+         __sent.push_back(st);
       }
-
-      struct sys::sockaddr_storage sas;
-      sys::socklen_t sasl(sizeof(sas));
-      ssize_t s = sys::recvfrom(__socket, &b[0], b.size(), 0, (struct sys::sockaddr *)&sas, &sasl);
-      if (s < 0)
-         return Expected<size_t>::unexpected(std::runtime_error(std::string("UDPConnection::read: unable to read - ") + std::strerror(errno)));
-      auto from = netaddr((struct sys::sockaddr*)&sas);
-      remote = from.erred() ? unknown_addr : std::string("udp://") + from.get();
-      return s;
    }
 
-   Expected<size_t> read(std::vector<uint8_t>& b, std::string& remote)
-   {
-      return read(b, remote, std::chrono::milliseconds(-1));
-   }
+private:
+   bool __enabled;
+   mutable std::mutex __lock;
+   std::chrono::system_clock::time_point __received;
+   std::deque<SentTimestamp> __sent;
+};
 
-   Expected<size_t> read(std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
-   {
-      if (__remote_addr != unknown_addr)
-         return Expected<size_t>::unexpected(std::logic_error(
-            "UDPConnection::read: reading from a sending UDP connection without addressee"
-         ));
-      std::string whom;
-      return read(b, whom, t);
-   }
+const size_t Timestamper::kMaxSent;
 
-   Expected<size_t> read(std::vector<uint8_t>& b)
-   {
-      return read(b, std::chrono::milliseconds(-1));
-   }
+struct UDPSocket::State
+{
+   DuplexStats stats;
+   Timestamper timestamps;
+   // would be nicer to have a LRU-cache with lookup instead of this thing
+   // that'll grow indefinitely.
+   std::unordered_map<std::string, std::shared_ptr<struct sys::addrinfo>> remotes;
+   std::mutex remotes_lock;
 
-   Expected<size_t> write(const std::vector<uint8_t>& b, const std::string& remote, const std::chrono::milliseconds& t)
+   Expected<std::shared_ptr<struct sys::addrinfo>> resolve(const std::string& remote)
    {
-      auto resolved = __resolve(remote);
+      {
+         std::lock_guard<std::mutex> lock(remotes_lock);
+         auto found = remotes.find(remote);
+         if (found != remotes.end())
+            return found->second;
+      }
+      auto resolved = ::resolve(remote);
       if (resolved.erred())
-         return Expected<size_t>::unexpected(std::invalid_argument(std::string("UDPConnection::write: unable to resolve the given remote \"") + remote + "\""));
-
+         return resolved.exception();
       {
-         struct sys::pollfd pfd;
-         pfd.fd = __socket;
-         pfd.events = POLLOUT;
-         int result = poll(&pfd, 1, t.count());
-         if (result == -1 || pfd.revents & POLLERR)
-            return Expected<size_t>::unexpected(std::runtime_error(std::string("UDPConnection::writes: failed to poll the socket - ") + std::strerror(errno)));
-         if (result == 0)
-            return Expected<size_t>::unexpected(std::logic_error("UDPConnection::write: timeout whilst polling the socket"));
+         std::lock_guard<std::mutex> lock(remotes_lock);
+         remotes[remote] = resolved.get();
       }
-
-      auto to = resolved.get();
-      ssize_t s = sys::sendto(__socket, &b[0], b.size(), 0, to->ai_addr, to->ai_addrlen);
-      if (s < 0)
-         return Expected<size_t>::unexpected(std::runtime_error(std::string("UDPConnection::write: unable to write - ") + std::strerror(errno)));
-      return s;
+      return resolved.get();
    }
+};
+
+UDPSocket::UDPSocket(int socket, const std::string& local_addr)
+   : __socket(socket)
+   , __local_addr(local_addr)
+   , __remote_addr(unknown_addr)
+   , __state(new State())
+{}
+
+UDPSocket::UDPSocket(int socket, const std::string& local_addr, const std::string& remote_addr)
+   : __socket(socket)
+   , __local_addr(local_addr)
+   , __remote_addr(remote_addr)
+   , __state(new State())
+{}
+
+UDPSocket::~UDPSocket()
+{
+   sys::close(__socket);
+}
+
+void UDPSocket::read_timeout(const std::chrono::microseconds& t)
+{
+   const std::chrono::seconds s = std::chrono::duration_cast<std::chrono::seconds>(t);
+   struct timeval tv;
+   tv.tv_sec = s.count();
+   tv.tv_usec = (t - s).count();
+   if (sys::setsockopt(__socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))  == -1)
+      throw std::runtime_error(
+         std::string("UDPConnection::read_timeout: unable to set read timeout - ") +
+         std::strerror(errno)
+      );
+}
+
+void UDPSocket::write_timeout(const std::chrono::microseconds& t)
+{
+   const std::chrono::seconds s = std::chrono::duration_cast<std::chrono::seconds>(t);
+   struct timeval tv;
+   tv.tv_sec = s.count();
+   tv.tv_usec = (t - s).count();
+   if (sys::setsockopt(__socket, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == -1)
+      throw std::runtime_error(
+         std::string("UDPConnection::write_timeout: unable to set write timeout - ") +
+         std::strerror(errno)
+      );
+}
+
+IOCounters UDPSocket::stats() const noexcept
+{
+   return __state->stats.counters();
+}
+
+void UDPSocket::timestamping(bool enable)
+{
+   __state->timestamps.enable(__socket, enable);
+}
+
+std::chrono::system_clock::time_point UDPSocket::received_at() const
+{
+   return __state->timestamps.received();
+}
+
+Expected<std::vector<SentTimestamp>> UDPSocket::sent_at()
+{
+   return __state->timestamps.sent(__socket);
+}
 
-   Expected<size_t> write(const std::vector<uint8_t>& b, const std::string& remote)
+Expected<size_t> UDPSocket::read(std::vector<uint8_t>& b, std::string& remote, const std::chrono::milliseconds& t)
+{
+   IOStatsRecorder& stats = __state->stats.reading;
+   Timestamper& timestamps = __state->timestamps;
+   LatencyTimer timer(kReadLatency);
+   if (b.empty())
+      return Expected<size_t>::unexpected(std::invalid_argument(
+         "UDPConnection::read: reading into an empty buffer"
+      ));
+   CPPSOCKET_PROBE(udp_read_start, __socket, b.size(), t.count());
    {
-      return write(b, remote, std::chrono::milliseconds(-1));
+      struct sys::pollfd pfd;
+      pfd.fd = __socket;
+      pfd.events = POLLIN;
+      int result = timestamps.wait(__socket, pfd, t);
+      stats.add(kPolls);
+      stats.add(kSyscalls);
+      if (result == -1 || pfd.revents & POLLERR) {
+         stats.add(kErrors);
+         CPPSOCKET_PROBE(udp_read_done, __socket, -1, errno);
+         return Expected<size_t>::unexpected(std::runtime_error(std::string("UDPConnection::read: failed to poll the socket - ") + std::strerror(errno)));
+      }
+      if (result == 0) {
+         stats.add(kTimeouts);
+         CPPSOCKET_PROBE(udp_read_done, __socket, -1, ETIMEDOUT);
+         return Expected<size_t>::unexpected(std::logic_error("UDPConnection::read: timeout whilst polling the socket"));
+      }
    }
 
-   Expected<size_t> write(const std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
-   {
-      if (__remote_addr == unknown_addr)
-         return Expected<size_t>::unexpected(std::logic_error(
-            "UDPConnection::write: writing to receiving UDP connection without addressee"
-         ));
-      return write(b, __remote_addr, t);
+   struct sys::sockaddr_storage sas;
+   sys::socklen_t sasl(sizeof(sas));
+   ssize_t s = timestamps.enabled()
+      ? timestamps.recv(__socket, &b[0], b.size(), (struct sys::sockaddr *)&sas, &sasl)
+      : sys::recvfrom(__socket, &b[0], b.size(), 0, (struct sys::sockaddr *)&sas, &sasl);
+   stats.add(kSyscalls);
+   if (s < 0) {
+      stats.add(errno == EAGAIN || errno == EWOULDBLOCK ? kEagains : kErrors);
+      CPPSOCKET_PROBE(udp_read_done, __socket, -1, errno);
+      return Expected<size_t>::unexpected(std::runtime_error(std::string("UDPConnection::read: unable to read - ") + std::strerror(errno)));
    }
+   stats.add(kReads);
+   stats.add(kBytesIn, s);
+   CPPSOCKET_PROBE(udp_read_done, __socket, s, 0);
+   auto from = netaddr((struct sys::sockaddr*)&sas);
+   remote = from.erred() ? unknown_addr : std::string("udp://") + from.get();
+   return s;
+}
 
-   Expected<size_t> write(const std::vector<uint8_t>& b)
-   {
-      return write(b, std::chrono::milliseconds(-1));
+Expected<size_t> UDPSocket::write(const std::vector<uint8_t>& b, const std::string& remote, const std::chrono::milliseconds& t)
+{
+   IOStatsRecorder& stats = __state->stats.writing;
+   Timestamper& timestamps = __state->timestamps;
+   LatencyTimer timer(kWriteLatency);
+   CPPSOCKET_PROBE(udp_send_start, __socket, b.size(), t.count());
+   auto resolved = __state->resolve(remote);
+   if (resolved.erred()) {
+      CPPSOCKET_PROBE(udp_send_done, __socket, -1, EINVAL);
+      return Expected<size_t>::unexpected(std::invalid_argument(std::string("UDPConnection::write: unable to resolve the given remote \"") + remote + "\""));
    }
 
-private:
-   Expected<std::shared_ptr<struct sys::addrinfo>> __resolve(const std::string& remote)
    {
-      {
-         std::lock_guard<std::mutex> lock(__remotes_lock);
-         auto found = __remotes.find(remote);
-         if (found != __remotes.end())
-            return found->second;
+      struct sys::pollfd pfd;
+      pfd.fd = __socket;
+      pfd.events = POLLOUT;
+      int result = timestamps.wait(__socket, pfd, t);
+      stats.add(kPolls);
+      stats.add(kSyscalls);
+      if (result == -1 || pfd.revents & POLLERR) {
+         stats.add(kErrors);
+         CPPSOCKET_PROBE(udp_send_done, __socket, -1, errno);
+         return Expected<size_t>::unexpected(std::runtime_error(std::string("UDPConnection::writes: failed to poll the socket - ") + std::strerror(errno)));
       }
-      auto resolved = resolve(remote);
-      if (resolved.erred())
-         return resolved.exception();
-      {
-         std::lock_guard<std::mutex> lock(__remotes_lock);
-         __remotes[remote] = resolved.get();
+      if (result == 0) {
+         stats.add(kTimeouts);
+         CPPSOCKET_PROBE(udp_send_done, __socket, -1, ETIMEDOUT);
+         return Expected<size_t>::unexpected(std::logic_error("UDPConnection::write: timeout whilst polling the socket"));
       }
-      return resolved.get();
    }
 
-private:
-   int __socket;
-   std::string __local_addr;
-   std::string __remote_addr;
-   // would be nicer to have a LRU-cache with lookup instead of this thing
-   // that'll grow indefinitely.
-   std::unordered_map<std::string, std::shared_ptr<struct sys::addrinfo>> __remotes;
-   std::mutex __remotes_lock;
-};
+   auto to = resolved.get();
+   ssize_t s = sys::sendto(__socket, b.data(), b.size(), 0, to->ai_addr, to->ai_addrlen);
+   stats.add(kSyscalls);
+   if (s < 0) {
+      stats.add(errno == EAGAIN || errno == EWOULDBLOCK ? kEagains : kErrors);
+      CPPSOCKET_PROBE(udp_send_done, __socket, -1, errno);
+      return Expected<size_t>::unexpected(std::runtime_error(std::string("UDPConnection::write: unable to write - ") + std::strerror(errno)));
+   }
+   stats.add(kWrites);
+   stats.add(kBytesOut, s);
+   CPPSOCKET_PROBE(udp_send_done, __socket, s, 0);
+   return s;
+}
 
-std::shared_ptr<UDPConnection> listen_udp(const std::string& address)
+/**
+ * bind_udp binds a new UDP socket to `address`, returning it along with the
+ * address it's bound to in `local`.
+ */
+static int bind_udp(const std::string& address, std::string& local)
 {
    auto resolved = resolve(address).get();
    if (resolved->ai_socktype != sys::SOCK_DGRAM)
       throw std::runtime_error(
          std::string("listen_udp: attempting to use a non-UDP socket on \"") + address + "\""
       );
-   return std::make_shared<UDPConnectionImpl>(resolved);
+   int socket = sys::socket(resolved->ai_family, resolved->ai_socktype, resolved->ai_protocol);
+   if (socket == -1)
+      throw std::runtime_error(
+         std::string("UDPConnection::UDPConnection: unable to acquire socket - ") +
+         std::strerror(errno)
+      );
+   if (sys::bind(socket, resolved->ai_addr, resolved->ai_addrlen) == -1) {
+      sys::close(socket);
+      throw std::runtime_error(
+         std::string("UDPConnection::UDPConnection: unable to bind socket - ") +
+         std::strerror(errno)
+      );
+   }
+   local = std::string("udp://") + netaddr(resolved->ai_addr).get();
+   return socket;
 }
 
-std::shared_ptr<UDPConnection> dial_udp(const std::string& address)
+/**
+ * connect_udp connects a new UDP socket to `address`, returning it along with
+ * the address it got bound to in `local`.
+ */
+static int connect_udp(const std::string& address, std::string& local)
 {
    auto resolved = resolve(address).get();
    if (resolved->ai_socktype != sys::SOCK_DGRAM)
       throw std::runtime_error(
          std::string("dial_udp: attempting to use a non-UDP socket on \"") + address + "\""
       );
-   return std::make_shared<UDPConnectionImpl>(resolved, address);
+   int socket = sys::socket(resolved->ai_family, resolved->ai_socktype, resolved->ai_protocol);
+   if (socket == -1)
+      throw std::runtime_error(
+         std::string("UDPConnection::UDPConnection: unable to acquire socket - ") +
+         std::strerror(errno)
+      );
+   if (sys::connect(socket, resolved->ai_addr, resolved->ai_addrlen) == -1) {
+      sys::close(socket);
+      throw std::runtime_error(
+         std::string("UDPConnection::UDPConnection: unable to connect socket - ") +
+         std::strerror(errno)
+      );
+   }
+   local = std::string("udp://") + netaddr(socket).get();
+   return socket;
+}
+
+std::shared_ptr<UDPSocket> listen_udp(const std::string& address)
+{
+   std::string local;
+   int socket = bind_udp(address, local);
+   return std::make_shared<UDPSocket>(socket, local);
+}
+
+std::unique_ptr<UDPSocket> listen_udp_unique(const std::string& address)
+{
+   std::string local;
+   int socket = bind_udp(address, local);
+   return std::unique_ptr<UDPSocket>(new UDPSocket(socket, local));
+}
+
+std::shared_ptr<UDPSocket> listen_udp_activated(const std::string& address, const std::string& name)
+{
+   auto resolved = resolve(address).get();
+   if (resolved->ai_socktype != sys::SOCK_DGRAM)
+      throw std::runtime_error(
+         std::string("listen_udp: attempting to use a non-UDP socket on \"") + address + "\""
+      );
+   int socket = activated_socket(sys::SOCK_DGRAM, name, netaddr(resolved->ai_addr).get());
+   if (socket == -1)
+      return listen_udp(address);
+   return std::make_shared<UDPSocket>(socket, std::string("udp://") + netaddr(socket).get());
 }
 
-struct TCPConnectionImpl
-   : TCPConnection
+std::shared_ptr<UDPSocket> dial_udp(const std::string& address)
 {
-   TCPConnectionImpl(const std::shared_ptr<struct sys::addrinfo>& resolved)
-      : __remote_addr(std::string("tcp://") + netaddr(resolved->ai_addr).get())
+   std::string local;
+   int socket = connect_udp(address, local);
+   return std::make_shared<UDPSocket>(socket, local, address);
+}
+
+std::unique_ptr<UDPSocket> dial_udp_unique(const std::string& address)
+{
+   std::string local;
+   int socket = connect_udp(address, local);
+   return std::unique_ptr<UDPSocket>(new UDPSocket(socket, local, address));
+}
+
+/**
+ * tcp_info_ext mirrors the kernel's `struct tcp_info`, of which the libc's
+ * declaration only covers the fields which existed at the time. The kernel
+ * only ever appends fields and fills in as many as fit, so the ones it
+ * doesn't know about remain zero.
+ */
+struct tcp_info_ext
+{
+   struct sys::tcp_info base;
+   uint64_t pacing_rate;
+   uint64_t max_pacing_rate;
+   uint64_t bytes_acked;
+   uint64_t bytes_received;
+   uint32_t segs_out;
+   uint32_t segs_in;
+   uint32_t notsent_bytes;
+   uint32_t min_rtt;
+   uint32_t data_segs_in;
+   uint32_t data_segs_out;
+   uint64_t delivery_rate;
+   uint64_t busy_time;
+   uint64_t rwnd_limited;
+   uint64_t sndbuf_limited;
+   uint32_t delivered;
+   uint32_t delivered_ce;
+   uint64_t bytes_sent;
+   uint64_t bytes_retrans;
+};
+
+
+struct TCPSocket::State
+{
+   /**
+    * dialed records the syscalls which went into connecting, and the
+    * `writes` which sent `sent` bytes of the initial payload.
+    */
+   void dialed(size_t syscalls, size_t writes, size_t sent)
    {
-      __socket = sys::socket(resolved->ai_family, resolved->ai_socktype, resolved->ai_protocol);
-      if (__socket == -1)
-         throw std::runtime_error(
-            std::string("TCPConnection::TCPConnection: unable to acquire socket - ") +
-            std::strerror(errno)
-         );
-      if (sys::connect(__socket, resolved->ai_addr, resolved->ai_addrlen) < 0) {
-         sys::close(__socket);
-         throw std::runtime_error(
-            std::string("TCPConnection::TCPConnection: unable to connect socket - ") +
-            std::strerror(errno)
-         );
+      stats.writing.add(kSyscalls, syscalls);
+      stats.writing.add(kDials);
+      if (writes > 0) {
+         stats.writing.add(kWrites, writes);
+         stats.writing.add(kBytesOut, sent);
       }
-      __local_addr = std::string("tcp://") + netaddr(__socket).get();
    }
 
-   TCPConnectionImpl(int socket, const std::string& localaddr, const std::string& remote)
-      : __socket(socket)
-      , __local_addr(std::string("tcp://") + localaddr)
-      , __remote_addr(std::string("tcp://") + remote)
-   {}
+   DuplexStats stats;
+   Timestamper timestamps;
+};
 
-   ~TCPConnectionImpl()
-   {
-      sys::close(__socket);
-   }
+TCPSocket::TCPSocket(int socket, const std::string& local_addr, const std::string& remote_addr)
+   : __socket(socket)
+   , __local_addr(local_addr)
+   , __remote_addr(remote_addr)
+   , __spin(0)
+   , __state(new State())
+{}
 
-   void timeout(const std::chrono::microseconds& t)
-   {
-      read_timeout(t);
-      write_timeout(t);
-   }
+TCPSocket::~TCPSocket()
+{
+   sys::close(__socket);
+}
 
-   void read_timeout(const std::chrono::microseconds& t)
-   {
-      const std::chrono::seconds s = std::chrono::duration_cast<std::chrono::seconds>(t);
-      struct timeval tv;
-      tv.tv_sec = s.count();
-      tv.tv_usec = (t - s).count();
-      if (sys::setsockopt(__socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))  == -1)
-         throw new std::runtime_error(
-            std::string("TCPConnection::read_timeout: unable to set read timeout - ") +
-            std::strerror(errno)
-         );
-   }
+void TCPSocket::read_timeout(const std::chrono::microseconds& t)
+{
+   const std::chrono::seconds s = std::chrono::duration_cast<std::chrono::seconds>(t);
+   struct timeval tv;
+   tv.tv_sec = s.count();
+   tv.tv_usec = (t - s).count();
+   if (sys::setsockopt(__socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))  == -1)
+      throw std::runtime_error(
+         std::string("TCPConnection::read_timeout: unable to set read timeout - ") +
+         std::strerror(errno)
+      );
+}
 
-   void write_timeout(const std::chrono::microseconds& t)
-   {
-      const std::chrono::seconds s = std::chrono::duration_cast<std::chrono::seconds>(t);
-      struct timeval tv;
-      tv.tv_sec = s.count();
-      tv.tv_usec = (t - s).count();
-      if (sys::setsockopt(__socket, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == -1)
-         throw new std::runtime_error(
-            std::string("TCPConnection::read_timeout: unable to set write timeout - ") +
-            std::strerror(errno)
-         );
-   }
+void TCPSocket::write_timeout(const std::chrono::microseconds& t)
+{
+   const std::chrono::seconds s = std::chrono::duration_cast<std::chrono::seconds>(t);
+   struct timeval tv;
+   tv.tv_sec = s.count();
+   tv.tv_usec = (t - s).count();
+   if (sys::setsockopt(__socket, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == -1)
+      throw std::runtime_error(
+         std::string("TCPConnection::write_timeout: unable to set write timeout - ") +
+         std::strerror(errno)
+      );
+}
 
-   void no_delay(bool d)
-   {
-      int opt = d ? 1 : 0;
-      if (sys::setsockopt(__socket, SOL_TCP, TCP_NODELAY, &opt, sizeof(opt)) == -1)
-         throw new std::runtime_error(
-            std::string("TCPConnection::no_delay: unable to set NODELAY - ") +
-            std::strerror(errno)
-         );
-   }
+void TCPSocket::no_delay(bool d)
+{
+   int opt = d ? 1 : 0;
+   if (sys::setsockopt(__socket, SOL_TCP, TCP_NODELAY, &opt, sizeof(opt)) == -1)
+      throw std::runtime_error(
+         std::string("TCPConnection::no_delay: unable to set NODELAY - ") +
+         std::strerror(errno)
+      );
+}
 
-   std::string local_addr() const noexcept
-   {
-      return __local_addr;
-   }
+void TCPSocket::buffer_sizes(int send, int receive)
+{
+   if (send > 0 && sys::setsockopt(__socket, SOL_SOCKET, SO_SNDBUF, &send, sizeof(send)) == -1)
+      throw std::runtime_error(
+         std::string("TCPConnection::buffer_sizes: unable to size the send buffer - ") +
+         std::strerror(errno)
+      );
+   if (receive > 0 && sys::setsockopt(__socket, SOL_SOCKET, SO_RCVBUF, &receive, sizeof(receive)) == -1)
+      throw std::runtime_error(
+         std::string("TCPConnection::buffer_sizes: unable to size the receive buffer - ") +
+         std::strerror(errno)
+      );
+}
 
-   std::string remote_addr() const noexcept
-   {
-      return __remote_addr;
-   }
+Expected<bool> TCPSocket::close_write()
+{
+   if (sys::shutdown(__socket, sys::SHUT_WR) == -1)
+      return Expected<bool>::unexpected(std::runtime_error(
+         std::string("TCPConnection::close_write: unable to shut down - ") +
+         std::strerror(errno)
+      ));
+   return true;
+}
 
-   Expected<size_t> read(std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
-   {
-      {
-         struct sys::pollfd pfd;
-         pfd.fd = __socket;
-         pfd.events = POLLIN;
-         int result = poll(&pfd, 1, t.count());
-         if (result == -1 || pfd.revents & POLLERR)
-            return Expected<size_t>::unexpected(std::runtime_error(
-                  std::string("TCPConnection::read: failed to poll the socket - ") +
-                  std::strerror(errno)
-               ));
-         if (result == 0)
-            return Expected<size_t>::unexpected(std::logic_error(
-               "TCPConnection::read: timeout whilst polling the socket"
-            ));
-      }
+Expected<bool> TCPSocket::close_read()
+{
+   if (sys::shutdown(__socket, sys::SHUT_RD) == -1)
+      return Expected<bool>::unexpected(std::runtime_error(
+         std::string("TCPConnection::close_read: unable to shut down - ") +
+         std::strerror(errno)
+      ));
+   return true;
+}
 
-      ssize_t s = sys::read(__socket, &b[0], b.size());
-      if (s < 0)
+Expected<int> TCPSocket::incoming_cpu() const
+{
+   int cpu = -1;
+   sys::socklen_t len(sizeof(cpu));
+   if (sys::getsockopt(__socket, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == -1)
+      return Expected<int>::unexpected(std::runtime_error(
+         std::string("TCPSocket::incoming_cpu: unable to get SO_INCOMING_CPU - ") +
+         std::strerror(errno)
+      ));
+   return cpu;
+}
+
+Expected<TCPInfo> TCPSocket::info() const
+{
+   struct tcp_info_ext ti;
+   std::memset(&ti, 0, sizeof(ti));
+   sys::socklen_t til(sizeof(ti));
+   if (sys::getsockopt(__socket, SOL_TCP, TCP_INFO, &ti, &til) == -1)
+      return Expected<TCPInfo>::unexpected(std::runtime_error(
+         std::string("TCPConnection::info: unable to get TCP_INFO - ") +
+         std::strerror(errno)
+      ));
+   TCPInfo i;
+   i.state = ti.base.tcpi_state;
+   i.rtt = std::chrono::microseconds(ti.base.tcpi_rtt);
+   i.rtt_var = std::chrono::microseconds(ti.base.tcpi_rttvar);
+   i.min_rtt = std::chrono::microseconds(ti.min_rtt);
+   i.rto = std::chrono::microseconds(ti.base.tcpi_rto);
+   i.retransmits = ti.base.tcpi_retrans;
+   i.total_retransmits = ti.base.tcpi_total_retrans;
+   i.lost = ti.base.tcpi_lost;
+   i.unacked = ti.base.tcpi_unacked;
+   i.cwnd = ti.base.tcpi_snd_cwnd;
+   i.ssthresh = ti.base.tcpi_snd_ssthresh;
+   i.mss = ti.base.tcpi_snd_mss;
+   i.pacing_rate = ti.pacing_rate;
+   i.delivery_rate = ti.delivery_rate;
+   i.bytes_sent = ti.bytes_sent;
+   i.bytes_acked = ti.bytes_acked;
+   i.bytes_received = ti.bytes_received;
+   i.bytes_retransmitted = ti.bytes_retrans;
+   i.notsent_bytes = ti.notsent_bytes;
+   return i;
+}
+
+IOCounters TCPSocket::stats() const noexcept
+{
+   return __state->stats.counters();
+}
+
+void TCPSocket::timestamping(bool enable)
+{
+   __state->timestamps.enable(__socket, enable);
+}
+
+std::chrono::system_clock::time_point TCPSocket::received_at() const
+{
+   return __state->timestamps.received();
+}
+
+Expected<std::vector<SentTimestamp>> TCPSocket::sent_at()
+{
+   return __state->timestamps.sent(__socket);
+}
+
+Expected<size_t> TCPSocket::read(std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
+{
+   IOStatsRecorder& stats = __state->stats.reading;
+   Timestamper& timestamps = __state->timestamps;
+   LatencyTimer timer(kReadLatency);
+   if (b.empty())
+      return Expected<size_t>::unexpected(std::invalid_argument(
+         "TCPConnection::read: reading into an empty buffer"
+      ));
+   CPPSOCKET_PROBE(tcp_read_start, __socket, b.size(), t.count());
+   std::chrono::milliseconds wait = t;
+   if (__spin.count() > 0 && !timestamps.enabled()) {
+      std::chrono::microseconds budget = __spin;
+      if (t.count() >= 0 && t < budget)
+         budget = t;
+      auto began = std::chrono::steady_clock::now();
+      int64_t s = __spin_read(b, budget);
+      if (s >= 0) {
+         stats.add(kReads);
+         stats.add(kBytesIn, s);
+         CPPSOCKET_PROBE(tcp_read_done, __socket, s, 0);
+         return s;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+         stats.add(kErrors);
+         CPPSOCKET_PROBE(tcp_read_done, __socket, -1, errno);
          return Expected<size_t>::unexpected(std::runtime_error(
             std::string("TCPConnection::read: unable to read - ") +
             std::strerror(errno)
          ));
-      return s;
-   }
-
-   Expected<size_t> read(std::vector<uint8_t>& b)
-   {
-      return read(b, std::chrono::milliseconds(-1));
+      }
+      if (t.count() >= 0)
+         wait = std::max(std::chrono::milliseconds(0), t - std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - began
+         ));
    }
-
-   Expected<size_t> write(const std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
    {
-      {
-         struct sys::pollfd pfd;
-         pfd.fd = __socket;
-         pfd.events = POLLOUT;
-         int result = poll(&pfd, 1, t.count());
-         if (result == -1 || pfd.revents & POLLERR)
-            return Expected<size_t>::unexpected(std::runtime_error(
-               std::string("TCPConnection::write: failed to poll the socket - ") +
+      struct sys::pollfd pfd;
+      pfd.fd = __socket;
+      pfd.events = POLLIN;
+      int result = timestamps.wait(__socket, pfd, wait);
+      stats.add(kPolls);
+      stats.add(kSyscalls);
+      if (result == -1 || pfd.revents & POLLERR) {
+         stats.add(kErrors);
+         CPPSOCKET_PROBE(tcp_read_done, __socket, -1, errno);
+         return Expected<size_t>::unexpected(std::runtime_error(
+               std::string("TCPConnection::read: failed to poll the socket - ") +
                std::strerror(errno)
             ));
-         if (result == 0)
-            return Expected<size_t>::unexpected(std::logic_error(
-               "TCPConnection::write: timeout whilst polling the socket"
-            ));
       }
+      if (result == 0) {
+         stats.add(kTimeouts);
+         CPPSOCKET_PROBE(tcp_read_done, __socket, -1, ETIMEDOUT);
+         return Expected<size_t>::unexpected(std::logic_error(
+            "TCPConnection::read: timeout whilst polling the socket"
+         ));
+      }
+   }
 
-      ssize_t s = sys::write(__socket, &b[0], b.size());
-      if (s < 0)
+   ssize_t s = timestamps.enabled()
+      ? timestamps.recv(__socket, &b[0], b.size(), NULL, NULL)
+      : sys::read(__socket, &b[0], b.size());
+   stats.add(kSyscalls);
+   if (s < 0) {
+      stats.add(errno == EAGAIN || errno == EWOULDBLOCK ? kEagains : kErrors);
+      CPPSOCKET_PROBE(tcp_read_done, __socket, -1, errno);
+      return Expected<size_t>::unexpected(std::runtime_error(
+         std::string("TCPConnection::read: unable to read - ") +
+         std::strerror(errno)
+      ));
+   }
+   stats.add(kReads);
+   stats.add(kBytesIn, s);
+   CPPSOCKET_PROBE(tcp_read_done, __socket, s, 0);
+   return s;
+}
+
+int64_t TCPSocket::__spin_read(std::vector<uint8_t>& b, const std::chrono::microseconds& budget)
+{
+   auto until = std::chrono::steady_clock::now() + budget;
+   uint64_t attempts = 0;
+   for (;;) {
+      ssize_t s = sys::recvfrom(__socket, &b[0], b.size(), sys::MSG_DONTWAIT, NULL, NULL);
+      attempts++;
+      if (s >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+         __state->stats.reading.add(kSyscalls, attempts);
+         return s;
+      }
+      if (std::chrono::steady_clock::now() >= until) {
+         __state->stats.reading.add(kSyscalls, attempts);
+         errno = EAGAIN;
+         return -1;
+      }
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+   }
+}
+
+Expected<size_t> TCPSocket::write(const std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
+{
+   IOStatsRecorder& stats = __state->stats.writing;
+   Timestamper& timestamps = __state->timestamps;
+   LatencyTimer timer(kWriteLatency);
+   CPPSOCKET_PROBE(tcp_write_start, __socket, b.size(), t.count());
+   {
+      struct sys::pollfd pfd;
+      pfd.fd = __socket;
+      pfd.events = POLLOUT;
+      int result = timestamps.wait(__socket, pfd, t);
+      stats.add(kPolls);
+      stats.add(kSyscalls);
+      if (result == -1 || pfd.revents & POLLERR) {
+         stats.add(kErrors);
+         CPPSOCKET_PROBE(tcp_write_done, __socket, -1, errno);
          return Expected<size_t>::unexpected(std::runtime_error(
-            std::string("TCPConnection::write: unable to write - ") +
+            std::string("TCPConnection::write: failed to poll the socket - ") +
             std::strerror(errno)
          ));
-      return s;
+      }
+      if (result == 0) {
+         stats.add(kTimeouts);
+         CPPSOCKET_PROBE(tcp_write_done, __socket, -1, ETIMEDOUT);
+         return Expected<size_t>::unexpected(std::logic_error(
+            "TCPConnection::write: timeout whilst polling the socket"
+         ));
+      }
    }
 
-   Expected<size_t> write(const std::vector<uint8_t>& b)
-   {
-      return write(b, std::chrono::milliseconds(-1));
+   // Writing to a connection closed for writing fails rather than raising
+   // SIGPIPE.
+   ssize_t s = sys::sendto(__socket, b.data(), b.size(), sys::MSG_NOSIGNAL, NULL, 0);
+   stats.add(kSyscalls);
+   if (s < 0) {
+      stats.add(errno == EAGAIN || errno == EWOULDBLOCK ? kEagains : kErrors);
+      CPPSOCKET_PROBE(tcp_write_done, __socket, -1, errno);
+      return Expected<size_t>::unexpected(std::runtime_error(
+         std::string("TCPConnection::write: unable to write - ") +
+         std::strerror(errno)
+      ));
    }
+   stats.add(kWrites);
+   stats.add(kBytesOut, s);
+   CPPSOCKET_PROBE(tcp_write_done, __socket, s, 0);
+   return s;
+}
 
-private:
-   int __socket;
-   std::string __local_addr;
-   std::string __remote_addr;
+struct TCPSocketListener::State
+{
+   IOStatsRecorder stats;
+   SocketTuning tuning;
 };
 
-struct TCPListenerImpl
-   : TCPListener
+TCPSocketListener::TCPSocketListener(int socket)
+   : TCPSocketListener(socket, SocketTuning())
+{}
+
+TCPSocketListener::TCPSocketListener(int socket, const SocketTuning& tuning)
+   : __socket(socket)
+   , __local_addr(std::string("tcp://") + netaddr(socket).get())
+   , __timeout(std::chrono::milliseconds(-1))
+   , __state(new State())
+{
+   __state->tuning = tuning;
+}
+
+TCPSocketListener::~TCPSocketListener()
+{
+   if (__socket != -1)
+      sys::close(__socket);
+}
+
+Expected<int> TCPSocketListener::__accept(const std::chrono::milliseconds& t, std::string& remote)
 {
-   TCPListenerImpl(std::shared_ptr<struct sys::addrinfo> resolved)
-      : __addr(resolved)
-      , __timeout(std::chrono::milliseconds(-1))
+   IOStatsRecorder& stats = __state->stats;
+   if (__socket == -1) {
+      stats.add(kErrors);
+      return Expected<int>::unexpected(std::runtime_error(
+         "TCPListener::accept: the listener is closed"
+      ));
+   }
+   LatencyTimer timer(kAcceptLatency);
+   CPPSOCKET_PROBE(tcp_accept_start, __socket, t.count());
    {
-      __socket = sys::socket(__addr->ai_family, __addr->ai_socktype, __addr->ai_protocol);
-      if (__socket == -1)
-         throw std::runtime_error(
-            std::string("TCPListener::TCPListener: unable to acquire socket - ") +
-            std::strerror(errno)
-         );
-      int opt = 1;
-      if (sys::setsockopt(__socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1) {
-         sys::close(__socket);
-         throw std::runtime_error(
-            std::string("TCPListener::TCPListener: unable to claim socket - ") +
-            std::strerror(errno)
-         );
-      }
-      if (sys::bind(__socket, __addr->ai_addr, __addr->ai_addrlen) == -1) {
-         sys::close(__socket);
-         throw std::runtime_error(
-            std::string("TCPListener::TCPListener: unable to bind socket - ") +
+      struct sys::pollfd pfd;
+      pfd.fd = __socket;
+      pfd.events = POLLIN;
+      int result = poll(&pfd, 1, t.count());
+      stats.add(kPolls);
+      stats.add(kSyscalls);
+      if (result == -1 || pfd.revents & POLLERR) {
+         stats.add(kErrors);
+         CPPSOCKET_PROBE(tcp_accept_done, __socket, -1, errno);
+         return Expected<int>::unexpected(std::runtime_error(
+            std::string("TCPListener::accept: failed to poll the bound-socket - ") +
             std::strerror(errno)
-         );
+         ));
       }
-      if (sys::listen(__socket, kDefaultListenBacklog) == -1) {
-         sys::close(__socket);
-         throw std::runtime_error(
-            std::string("TCPListener::TCPListener: unable to listen - ") +
-            std::strerror(errno)
-         );
+      if (result == 0) {
+         stats.add(kTimeouts);
+         CPPSOCKET_PROBE(tcp_accept_done, __socket, -1, ETIMEDOUT);
+         return Expected<int>::unexpected(std::logic_error(
+            "TCPListener::accept: timeout whilst polling the bound-socket"
+         ));
       }
    }
 
-   ~TCPListenerImpl()
-   {
-      sys::close(__socket);
+   struct sys::sockaddr_storage sas;
+   sys::socklen_t sasl(sizeof(sas));
+   int socket = sys::accept(__socket, (struct sys::sockaddr*)&sas, &sasl);
+   stats.add(kSyscalls);
+   if (socket == -1) {
+      stats.add(errno == EAGAIN || errno == EWOULDBLOCK ? kEagains : kErrors);
+      CPPSOCKET_PROBE(tcp_accept_done, __socket, -1, errno);
+      return Expected<int>::unexpected(std::runtime_error(
+         std::string("TCPListener::accept: failed to accept a new connection - ") +
+         std::strerror(errno)
+      ));
    }
+   stats.add(kAccepts);
+   CPPSOCKET_PROBE(tcp_accept_done, __socket, socket, 0);
 
-   Expected<std::shared_ptr<TCPConnection>> accept(const std::chrono::milliseconds& t)
-   {
-      {
-         struct sys::pollfd pfd;
-         pfd.fd = __socket;
-         pfd.events = POLLIN;
-         int result = poll(&pfd, 1, t.count());
-         if (result == -1 || pfd.revents & POLLERR)
-            return Expected<std::shared_ptr<TCPConnection>>::unexpected(std::runtime_error(
-               std::string("TCPListener::accept: failed to poll the bound-socket - ") +
-               std::strerror(errno)
-            ));
-      }
+   size_t syscalls = 0;
+   auto tuned = tune_accepted(socket, __state->tuning, "TCPListener::accept", syscalls);
+   stats.add(kSyscalls, syscalls);
+   if (tuned.erred()) {
+      stats.add(kErrors);
+      sys::close(socket);
+      return tuned.exception();
+   }
 
-      struct sys::sockaddr_storage sas;
-      sys::socklen_t sasl(sizeof(sas));
-      int socket = sys::accept(__socket, (struct sys::sockaddr*)&sas, &sasl);
-      if (socket == -1)
-         return Expected<std::shared_ptr<TCPConnection>>::unexpected(std::runtime_error(
-            std::string("TCPListener::accept: failed to accept a new connection - ") +
-            std::strerror(errno)
-         ));
+   auto remote_addr = netaddr((struct sys::sockaddr*)&sas);
+   if (remote_addr.erred()) {
+      sys::close(socket);
+      return remote_addr.exception();
+   }
+   remote = std::string("tcp://") + remote_addr.get();
+   return socket;
+}
 
-      auto local_addr = netaddr(__addr->ai_addr);
-      if (local_addr.erred())
-         return local_addr.exception();
-      auto remote_addr = netaddr((struct sys::sockaddr*)&sas);
-      if (remote_addr.erred())
-         return remote_addr.exception();
-      std::shared_ptr<TCPConnection> conn = std::make_shared<TCPConnectionImpl>(
-         socket,
-         local_addr.get(),
-         remote_addr.get()
-      );
-      return conn;
+Expected<std::shared_ptr<TCPSocket>> TCPSocketListener::accept_socket(const std::chrono::milliseconds& t)
+{
+   std::string remote;
+   auto socket = __accept(t, remote);
+   if (socket.erred())
+      return socket.exception();
+   auto conn = std::make_shared<TCPSocket>(socket.get(), __local_addr, remote);
+   conn->spin(__state->tuning.spin);
+   return conn;
+}
+
+Expected<std::unique_ptr<TCPSocket>> TCPSocketListener::accept_unique(const std::chrono::milliseconds& t)
+{
+   std::string remote;
+   auto socket = __accept(t, remote);
+   if (socket.erred())
+      return socket.exception();
+   std::unique_ptr<TCPSocket> conn(new TCPSocket(socket.get(), __local_addr, remote));
+   conn->spin(__state->tuning.spin);
+   return conn;
+}
+
+IOCounters TCPSocketListener::stats() const noexcept
+{
+   return __state->stats.counters();
+}
+
+TCPListenOptions::TCPListenOptions()
+   : backlog(TCPListener::kDefaultListenBacklog)
+   , fast_open(0)
+   , defer_accept(0)
+   , reuse_port(false)
+{}
+
+Expected<bool> TCPSocketListener::close()
+{
+   if (__socket == -1)
+      return true;
+   // The descriptor is released even when closing fails.
+   int closed = sys::close(__socket);
+   __socket = -1;
+   if (closed == -1)
+      return Expected<bool>::unexpected(std::runtime_error(
+         std::string("TCPListener::close: unable to close - ") +
+         std::strerror(errno)
+      ));
+   return true;
+}
+
+Expected<bool> TCPSocketListener::stop()
+{
+   if (sys::shutdown(__socket, sys::SHUT_RDWR) == -1)
+      return Expected<bool>::unexpected(std::runtime_error(
+         std::string("TCPListener::stop: unable to shut down - ") +
+         std::strerror(errno)
+      ));
+   return true;
+}
+
+/**
+ * kDrainInterval is how often drain checks on the connections.
+ */
+static const std::chrono::milliseconds kDrainInterval(5);
+
+/**
+ * drained tells whether the peer acknowledged the closing of `conn` for
+ * writing, which it only does once it got all that was written before.
+ */
+static bool drained(TCPConnection& conn)
+{
+   auto info = conn.info();
+   if (info.erred())
+      return true;
+   switch (info.get().state) {
+   case sys::TCP_FIN_WAIT2:
+   case sys::TCP_TIME_WAIT:
+   case sys::TCP_CLOSE:
+      return true;
+   default:
+      return false;
    }
+}
 
-   Expected<std::shared_ptr<TCPConnection>> accept()
-   {
-      return accept(__timeout);
+Expected<size_t> drain(
+   TCPSocketListener& listener,
+   const std::vector<std::weak_ptr<TCPConnection>>& conns,
+   const std::chrono::steady_clock::time_point& deadline
+) {
+   auto closed = listener.close();
+   if (closed.erred())
+      return closed.exception();
+   std::vector<std::weak_ptr<TCPConnection>> busy(conns);
+   for (;;) {
+      busy.erase(std::remove_if(busy.begin(), busy.end(), [](const std::weak_ptr<TCPConnection>& c) {
+         auto conn = c.lock();
+         return !conn || drained(*conn);
+      }), busy.end());
+      auto now = std::chrono::steady_clock::now();
+      if (busy.empty() || now >= deadline)
+         return busy.size();
+      std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(kDrainInterval, deadline - now));
    }
+}
 
-   void timeout(const std::chrono::milliseconds& t)
-   {
-      __timeout = t;
+/**
+ * accept_on has the bound `socket` listen for connections as set out by
+ * `options`, closing it when it fails to. Listening on a socket which listens
+ * already merely sizes its backlog anew.
+ */
+static void accept_on(int socket, const TCPListenOptions& options)
+{
+   if (options.fast_open > 0 && sys::setsockopt(socket, SOL_TCP, TCP_FASTOPEN, &options.fast_open, sizeof(options.fast_open)) == -1) {
+      sys::close(socket);
+      throw std::runtime_error(
+         std::string("TCPListener::TCPListener: unable to enable Fast Open - ") +
+         std::strerror(errno)
+      );
+   }
+   int defer = options.defer_accept.count();
+   if (defer > 0 && sys::setsockopt(socket, SOL_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(defer)) == -1) {
+      sys::close(socket);
+      throw std::runtime_error(
+         std::string("TCPListener::TCPListener: unable to defer accepting - ") +
+         std::strerror(errno)
+      );
    }
+   if (sys::listen(socket, options.backlog) == -1) {
+      sys::close(socket);
+      throw std::runtime_error(
+         std::string("TCPListener::TCPListener: unable to listen - ") +
+         std::strerror(errno)
+      );
+   }
+}
 
-private:
-   std::shared_ptr<struct sys::addrinfo> __addr;
-   std::chrono::milliseconds __timeout;
-   int __socket;
-};
+std::unique_ptr<TCPSocketListener> listen_tcp(const std::string& address)
+{
+   return listen_tcp(address, TCPListenOptions());
+}
+
+std::unique_ptr<TCPSocketListener> listen_tcp(const std::string& address, const TCPListenOptions& options)
+{
+   auto resolved = resolve(address).get();
+   if (resolved->ai_socktype != sys::SOCK_STREAM)
+      throw std::runtime_error(
+         std::string("listen_tcp: attempting to use a non-TCP socket on \"") + address + "\""
+      );
+   int socket = sys::socket(resolved->ai_family, resolved->ai_socktype, resolved->ai_protocol);
+   if (socket == -1)
+      throw std::runtime_error(
+         std::string("TCPListener::TCPListener: unable to acquire socket - ") +
+         std::strerror(errno)
+      );
+   int opt = 1;
+   if (sys::setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1) {
+      sys::close(socket);
+      throw std::runtime_error(
+         std::string("TCPListener::TCPListener: unable to claim socket - ") +
+         std::strerror(errno)
+      );
+   }
+   if (options.reuse_port && sys::setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+      sys::close(socket);
+      throw std::runtime_error(
+         std::string("TCPListener::TCPListener: unable to share port - ") +
+         std::strerror(errno)
+      );
+   }
+   size_t syscalls = 0;
+   auto tuned = tune(socket, options.tuning, "TCPListener::TCPListener", syscalls);
+   if (tuned.erred()) {
+      sys::close(socket);
+      tuned.get();
+   }
+   if (sys::bind(socket, resolved->ai_addr, resolved->ai_addrlen) == -1) {
+      sys::close(socket);
+      throw std::runtime_error(
+         std::string("TCPListener::TCPListener: unable to bind socket - ") +
+         std::strerror(errno)
+      );
+   }
+   accept_on(socket, options);
+   return std::unique_ptr<TCPSocketListener>(new TCPSocketListener(socket, options.tuning));
+}
 
-std::unique_ptr<TCPListener> listen_tcp(const std::string& address)
+std::unique_ptr<TCPSocketListener> listen_tcp_activated(const std::string& address, const std::string& name)
+{
+   return listen_tcp_activated(address, name, TCPListenOptions());
+}
+
+std::unique_ptr<TCPSocketListener> listen_tcp_activated(const std::string& address, const std::string& name, const TCPListenOptions& options)
 {
    auto resolved = resolve(address).get();
    if (resolved->ai_socktype != sys::SOCK_STREAM)
       throw std::runtime_error(
          std::string("listen_tcp: attempting to use a non-TCP socket on \"") + address + "\""
       );
-   return std::unique_ptr<TCPListener>(new TCPListenerImpl(resolved));
+   int socket = activated_socket(sys::SOCK_STREAM, name, netaddr(resolved->ai_addr).get());
+   if (socket == -1)
+      return listen_tcp(address, options);
+   size_t syscalls = 0;
+   auto tuned = tune(socket, options.tuning, "TCPListener::TCPListener", syscalls);
+   if (tuned.erred()) {
+      sys::close(socket);
+      tuned.get();
+   }
+   accept_on(socket, options);
+   return std::unique_ptr<TCPSocketListener>(new TCPSocketListener(socket, options.tuning));
+}
+
+std::vector<std::unique_ptr<TCPSocketListener>> listen_tcp_sharded(const std::string& address, size_t shards, const TCPListenOptions& options)
+{
+   if (shards == 0)
+      throw std::invalid_argument("listen_tcp_sharded: no shards to listen with");
+   TCPListenOptions shared(options);
+   shared.reuse_port = true;
+   std::vector<std::unique_ptr<TCPSocketListener>> listeners;
+   listeners.push_back(listen_tcp(address, shared));
+   // The others join whatever port the first one got bound to.
+   std::string bound = std::string("tcp://") + netaddr(listeners.front()->fd()).get();
+   while (listeners.size() < shards)
+      listeners.push_back(listen_tcp(bound, shared));
+   return listeners;
+}
+
+/**
+ * statement and jump build a BPF instruction, like the BPF_STMT and BPF_JUMP
+ * macros do, taking the negative offsets of the kernel's extensions as well.
+ */
+static struct sys::sock_filter statement(uint16_t code, uint32_t k)
+{
+   struct sys::sock_filter s = { code, 0, 0, k };
+   return s;
+}
+
+static struct sys::sock_filter jump(uint16_t code, uint32_t k, uint8_t jt, uint8_t jf)
+{
+   struct sys::sock_filter j = { code, jt, jf, k };
+   return j;
 }
 
-std::shared_ptr<TCPConnection> dial_tcp(const std::string& address)
+/**
+ * steering_program builds the program steering a group of `shards`
+ * listeners by `key`. The remote address and port are read relative to the
+ * network header, as the packet's data starts past the TCP header by the
+ * time the program runs.
+ */
+static std::vector<struct sys::sock_filter> steering_program(size_t shards, Steering key, uint32_t seed)
+{
+   std::vector<struct sys::sock_filter> program;
+   if (key == Steering::cpu) {
+      program.push_back(statement(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU));
+   } else {
+      std::vector<struct sys::sock_filter> v4, v6;
+      if (key == Steering::remote_address) {
+         v4.push_back(statement(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12));
+         // The words of an IPv6 address are folded into one.
+         v6.push_back(statement(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 8));
+         for (int word = 12; word <= 20; word += 4) {
+            v6.push_back(statement(BPF_MISC | BPF_TAX, 0));
+            v6.push_back(statement(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + word));
+            v6.push_back(statement(BPF_ALU | BPF_XOR | BPF_X, 0));
+         }
+      } else {
+         // IPv4 headers vary in length, IPv6 ones are taken to come without
+         // extension headers.
+         v4.push_back(statement(BPF_LDX | BPF_B | BPF_MSH, SKF_NET_OFF));
+         v4.push_back(statement(BPF_LD | BPF_H | BPF_IND, SKF_NET_OFF));
+         v6.push_back(statement(BPF_LD | BPF_H | BPF_ABS, SKF_NET_OFF + 40));
+      }
+      program.push_back(statement(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF));
+      program.push_back(statement(BPF_ALU | BPF_RSH | BPF_K, 4));
+      program.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, 6, uint8_t(v4.size() + 1), 0));
+      program.insert(program.end(), v4.begin(), v4.end());
+      program.push_back(statement(BPF_JMP | BPF_JA, uint32_t(v6.size())));
+      program.insert(program.end(), v6.begin(), v6.end());
+      // Fibonacci hashing, of which the upper bits are the better mixed.
+      program.push_back(statement(BPF_ALU | BPF_XOR | BPF_K, seed));
+      program.push_back(statement(BPF_ALU | BPF_MUL | BPF_K, 0x9E3779B1));
+      program.push_back(statement(BPF_ALU | BPF_RSH | BPF_K, 16));
+   }
+   program.push_back(statement(BPF_ALU | BPF_MOD | BPF_K, uint32_t(shards)));
+   program.push_back(statement(BPF_RET | BPF_A, 0));
+   return program;
+}
+
+Expected<bool> steer_reuseport(const std::vector<std::unique_ptr<TCPSocketListener>>& group, Steering key)
+{
+   return steer_reuseport(group, key, 0);
+}
+
+Expected<bool> steer_reuseport(const std::vector<std::unique_ptr<TCPSocketListener>>& group, Steering key, uint32_t seed)
+{
+   if (group.empty())
+      return Expected<bool>::unexpected(std::invalid_argument(
+         "steer_reuseport: no listeners to steer to"
+      ));
+   auto program = steering_program(group.size(), key, seed);
+   struct sys::sock_fprog fprog;
+   fprog.len = program.size();
+   fprog.filter = program.data();
+   // The program is shared by the whole group, whichever listener it's
+   // attached through.
+   if (sys::setsockopt(group.front()->fd(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fprog, sizeof(fprog)) == -1)
+      return Expected<bool>::unexpected(std::runtime_error(
+         std::string("steer_reuseport: unable to attach the steering program - ") +
+         std::strerror(errno)
+      ));
+   return true;
+}
+
+/**
+ * Dial is what connect_tcp set up: the connected socket along with the
+ * addresses of both ends, and what it took to send the initial payload.
+ */
+struct Dial
+{
+   int socket;
+   std::string local;
+   std::string remote;
+   size_t syscalls;
+   size_t writes;
+};
+
+/**
+ * dial_failed records the failure of a dial, which has no connection to
+ * record it on yet, and throws along with what failed.
+ */
+static void dial_failed(const Dial& d, const char* what)
+{
+   int err = errno;
+   count(kSyscalls, d.syscalls);
+   count(kErrors);
+   if (d.socket != -1)
+      sys::close(d.socket);
+   throw std::runtime_error(
+      std::string("TCPConnection::TCPConnection: ") + what + " - " + std::strerror(err)
+   );
+}
+
+/**
+ * connect_tcp connects a new TCP socket, set up with `tuning`, to `address`
+ * and sends `initial` over it. The payload is handed to the kernel along with the connection
+ * request, for it to be sent with the SYN if it holds a Fast Open cookie of
+ * the server. When the kernel doesn't do Fast Open, it's written once
+ * connected instead.
+ */
+static Dial connect_tcp(const std::string& address, const SocketTuning& tuning, const std::vector<uint8_t>& initial)
 {
    auto resolved = resolve(address).get();
    if (resolved->ai_socktype != sys::SOCK_STREAM)
       throw std::runtime_error(
          std::string("dial_tcp: attempting to use a non-TCP socket on \"") + address + "\""
       );
-   return std::make_shared<TCPConnectionImpl>(resolved);
+   LatencyTimer timer(kDialLatency);
+   Dial d;
+   d.syscalls = 1;
+   d.writes = 0;
+   d.socket = sys::socket(resolved->ai_family, resolved->ai_socktype, resolved->ai_protocol);
+   if (d.socket == -1)
+      dial_failed(d, "unable to acquire socket");
+   auto tuned = tune(d.socket, tuning, "TCPConnection::TCPConnection", d.syscalls);
+   if (tuned.erred()) {
+      count(kSyscalls, d.syscalls);
+      count(kErrors);
+      sys::close(d.socket);
+      tuned.get();
+   }
+   size_t sent = 0;
+   bool connected = false;
+   if (!initial.empty()) {
+      ssize_t s = sys::sendto(d.socket, &initial[0], initial.size(), sys::MSG_FASTOPEN | sys::MSG_NOSIGNAL, resolved->ai_addr, resolved->ai_addrlen);
+      d.syscalls++;
+      if (s >= 0) {
+         sent = s;
+         connected = true;
+         d.writes++;
+      } else if (errno != EOPNOTSUPP) {
+         dial_failed(d, "unable to connect socket");
+      }
+   }
+   if (!connected) {
+      d.syscalls++;
+      if (sys::connect(d.socket, resolved->ai_addr, resolved->ai_addrlen) < 0)
+         dial_failed(d, "unable to connect socket");
+   }
+   while (sent < initial.size()) {
+      ssize_t s = sys::sendto(d.socket, &initial[sent], initial.size() - sent, sys::MSG_NOSIGNAL, NULL, 0);
+      d.syscalls++;
+      if (s < 0)
+         dial_failed(d, "unable to send the initial payload");
+      sent += s;
+      d.writes++;
+   }
+   d.local = std::string("tcp://") + netaddr(d.socket).get();
+   d.remote = std::string("tcp://") + netaddr(resolved->ai_addr).get();
+   return d;
+}
+
+std::shared_ptr<TCPSocket> dial_tcp(const std::string& address)
+{
+   return dial_tcp(address, SocketTuning(), std::vector<uint8_t>());
+}
+
+std::shared_ptr<TCPSocket> dial_tcp(const std::string& address, const std::vector<uint8_t>& initial)
+{
+   return dial_tcp(address, SocketTuning(), initial);
+}
+
+std::shared_ptr<TCPSocket> dial_tcp(const std::string& address, const SocketTuning& tuning)
+{
+   return dial_tcp(address, tuning, std::vector<uint8_t>());
+}
+
+std::shared_ptr<TCPSocket> dial_tcp(const std::string& address, const SocketTuning& tuning, const std::vector<uint8_t>& initial)
+{
+   Dial d = connect_tcp(address, tuning, initial);
+   auto conn = std::make_shared<TCPSocket>(d.socket, d.local, d.remote);
+   conn->__state->dialed(d.syscalls, d.writes, initial.size());
+   conn->spin(tuning.spin);
+   return conn;
+}
+
+std::unique_ptr<TCPSocket> dial_tcp_unique(const std::string& address)
+{
+   return dial_tcp_unique(address, SocketTuning(), std::vector<uint8_t>());
+}
+
+std::unique_ptr<TCPSocket> dial_tcp_unique(const std::string& address, const std::vector<uint8_t>& initial)
+{
+   return dial_tcp_unique(address, SocketTuning(), initial);
+}
+
+std::unique_ptr<TCPSocket> dial_tcp_unique(const std::string& address, const SocketTuning& tuning)
+{
+   return dial_tcp_unique(address, tuning, std::vector<uint8_t>());
+}
+
+std::unique_ptr<TCPSocket> dial_tcp_unique(const std::string& address, const SocketTuning& tuning, const std::vector<uint8_t>& initial)
+{
+   Dial d = connect_tcp(address, tuning, initial);
+   std::unique_ptr<TCPSocket> conn(new TCPSocket(d.socket, d.local, d.remote));
+   conn->__state->dialed(d.syscalls, d.writes, initial.size());
+   conn->spin(tuning.spin);
+   return conn;
 }
@@ -0,0 +1,308 @@
+#include <handoff.hpp>
+#include <address.hpp>
+
+// <sys/un.h> brings in <string.h>, which is to stay outside of `sys`.
+#include <cstring>
+
+namespace sys {
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+}
+
+// The CMSG_* macros refer to an unqualified `struct cmsghdr`.
+using sys::cmsghdr;
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+
+/**
+ * kBatch bounds the amount of sockets passed along with a single message.
+ */
+static const size_t kBatch = 64;
+
+/**
+ * kListener and kConnection tell the sockets of a message apart, one byte per
+ * socket.
+ */
+static const char kListener = 'L';
+static const char kConnection = 'C';
+
+/**
+ * kTakenOver is what the successor acknowledges the handover with.
+ */
+static const char kTakenOver = 'k';
+
+/**
+ * unix_addr fills `sa` with the address of the Unix socket at `path`, and
+ * returns its length, or 0 when the path doesn't fit.
+ */
+static sys::socklen_t unix_addr(const std::string& path, struct sys::sockaddr_un& sa)
+{
+   std::memset(&sa, 0, sizeof(sa));
+   sa.sun_family = AF_UNIX;
+   if (path.empty() || path.size() >= sizeof(sa.sun_path))
+      return 0;
+   std::memcpy(sa.sun_path, path.data(), path.size());
+   if (path[0] == '@') {
+      sa.sun_path[0] = '\0';
+      return offsetof(struct sys::sockaddr_un, sun_path) + path.size();
+   }
+   return offsetof(struct sys::sockaddr_un, sun_path) + path.size() + 1;
+}
+
+/**
+ * wait waits until `socket` is ready for `events` or `deadline` passed,
+ * returning what poll does.
+ */
+static int wait(int socket, short events, const std::chrono::steady_clock::time_point& deadline)
+{
+   auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+   struct sys::pollfd pfd;
+   pfd.fd = socket;
+   pfd.events = events;
+   return sys::poll(&pfd, 1, std::max<int64_t>(left.count(), 0));
+}
+
+/**
+ * same_user tells whether the peer of the Unix `socket` runs as this
+ * process's effective user, the only one to be handed its sockets.
+ */
+static bool same_user(int socket)
+{
+   struct sys::ucred cred;
+   sys::socklen_t len = sizeof(cred);
+   return sys::getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == sys::geteuid();
+}
+
+template <typename T>
+static Expected<T> failed(const char* who, const char* what, int socket)
+{
+   int err = errno;
+   sys::close(socket);
+   return Expected<T>::unexpected(std::runtime_error(
+      std::string(who) + ": " + what + " - " + std::strerror(err)
+   ));
+}
+
+template <typename T>
+static Expected<T> timed_out(const char* who, const char* what, int socket)
+{
+   sys::close(socket);
+   return Expected<T>::unexpected(std::logic_error(std::string(who) + ": timed out " + what));
+}
+
+Expected<size_t> hand_over(
+   const std::string& path,
+   const std::vector<int>& listeners,
+   const std::vector<int>& connections,
+   const std::chrono::milliseconds& t
+) {
+   auto deadline = std::chrono::steady_clock::now() + t;
+   struct sys::sockaddr_un sa;
+   sys::socklen_t len = unix_addr(path, sa);
+   if (len == 0)
+      return Expected<size_t>::unexpected(std::invalid_argument(
+         std::string("hand_over: unusable path \"") + path + "\""
+      ));
+   int server = sys::socket(AF_UNIX, sys::SOCK_SEQPACKET, 0);
+   if (server == -1)
+      return failed<size_t>("hand_over", "unable to acquire socket", -1);
+   // A path left behind by an earlier handover would fail the bind.
+   bool named = path[0] != '@';
+   if (named)
+      sys::unlink(path.c_str());
+   if (sys::bind(server, (struct sys::sockaddr*)&sa, len) == -1)
+      return failed<size_t>("hand_over", "unable to bind socket", server);
+   if (sys::listen(server, 1) == -1) {
+      if (named)
+         sys::unlink(path.c_str());
+      return failed<size_t>("hand_over", "unable to listen", server);
+   }
+   auto unbind = [&]() {
+      int err = errno;
+      if (named)
+         sys::unlink(path.c_str());
+      errno = err;
+   };
+   int ready, successor;
+   for (;;) {
+      ready = wait(server, POLLIN, deadline);
+      if (ready == 0) {
+         unbind();
+         return timed_out<size_t>("hand_over", "waiting for the successor", server);
+      }
+      successor = ready == -1 ? -1 : sys::accept(server, NULL, NULL);
+      if (successor == -1) {
+         unbind();
+         return failed<size_t>("hand_over", "unable to accept the successor", server);
+      }
+      if (same_user(successor))
+         break;
+      // Anyone else who connected is turned away empty-handed.
+      sys::close(successor);
+   }
+   unbind();
+   sys::close(server);
+
+   std::vector<char> kinds(listeners.size(), kListener);
+   kinds.insert(kinds.end(), connections.size(), kConnection);
+   std::vector<int> sockets(listeners);
+   sockets.insert(sockets.end(), connections.begin(), connections.end());
+   for (size_t i = 0; i < sockets.size(); i += kBatch) {
+      size_t n = std::min(kBatch, sockets.size() - i);
+      char control[CMSG_SPACE(sizeof(int) * kBatch)];
+      std::memset(control, 0, sizeof(control));
+      struct sys::iovec iov;
+      iov.iov_base = &kinds[i];
+      iov.iov_len = n;
+      struct sys::msghdr msg;
+      std::memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = sys::SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+      std::memcpy(CMSG_DATA(cmsg), &sockets[i], sizeof(int) * n);
+      if (sys::sendmsg(successor, &msg, sys::MSG_NOSIGNAL) == -1)
+         return failed<size_t>("hand_over", "unable to pass sockets", successor);
+   }
+   // Shutting down tells the successor it has got everything.
+   if (sys::shutdown(successor, sys::SHUT_WR) == -1)
+      return failed<size_t>("hand_over", "unable to finish handing over", successor);
+
+   ready = wait(successor, POLLIN, deadline);
+   if (ready == 0)
+      return timed_out<size_t>("hand_over", "waiting for the successor to take over", successor);
+   char ack = 0;
+   if (ready == -1 || sys::read(successor, &ack, 1) != 1 || ack != kTakenOver) {
+      if (ready != -1)
+         errno = ECONNRESET;
+      return failed<size_t>("hand_over", "successor didn't take over", successor);
+   }
+   sys::close(successor);
+   return sockets.size();
+}
+
+Expected<Inheritance> take_over(const std::string& path, const std::chrono::milliseconds& t)
+{
+   return take_over(path, SocketTuning(), t);
+}
+
+/**
+ * adopt adds `socket`, of the given `kind`, to `inheritance`.
+ */
+static Expected<bool> adopt(Inheritance& inheritance, char kind, int socket, const SocketTuning& tuning)
+{
+   if (kind != kListener && kind != kConnection) {
+      errno = EPROTO;
+      return failed<bool>("take_over", "received garbled sockets", socket);
+   }
+   auto local = netaddr(socket);
+   if (local.erred()) {
+      sys::close(socket);
+      return local.exception();
+   }
+   if (kind == kListener) {
+      inheritance.listeners.emplace_back(new TCPSocketListener(socket, tuning));
+      return true;
+   }
+   auto remote = peeraddr(socket);
+   if (remote.erred()) {
+      sys::close(socket);
+      return remote.exception();
+   }
+   inheritance.connections.emplace_back(new TCPSocket(
+      socket, std::string("tcp://") + local.get(), std::string("tcp://") + remote.get()
+   ));
+   return true;
+}
+
+Expected<Inheritance> take_over(const std::string& path, const SocketTuning& tuning, const std::chrono::milliseconds& t)
+{
+   auto deadline = std::chrono::steady_clock::now() + t;
+   struct sys::sockaddr_un sa;
+   sys::socklen_t len = unix_addr(path, sa);
+   if (len == 0)
+      return Expected<Inheritance>::unexpected(std::invalid_argument(
+         std::string("take_over: unusable path \"") + path + "\""
+      ));
+   int predecessor = sys::socket(AF_UNIX, sys::SOCK_SEQPACKET, 0);
+   if (predecessor == -1)
+      return failed<Inheritance>("take_over", "unable to acquire socket", -1);
+   // The predecessor might not be handing over yet.
+   while (sys::connect(predecessor, (struct sys::sockaddr*)&sa, len) == -1) {
+      if (errno != ENOENT && errno != ECONNREFUSED)
+         return failed<Inheritance>("take_over", "unable to reach the predecessor", predecessor);
+      if (std::chrono::steady_clock::now() >= deadline)
+         return timed_out<Inheritance>("take_over", "waiting for the predecessor", predecessor);
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   }
+   // Anyone may have claimed an abstract name before the predecessor did.
+   if (!same_user(predecessor)) {
+      errno = EPERM;
+      return failed<Inheritance>("take_over", "predecessor runs as another user", predecessor);
+   }
+
+   Inheritance inheritance;
+   for (;;) {
+      int ready = wait(predecessor, POLLIN, deadline);
+      if (ready == 0)
+         return timed_out<Inheritance>("take_over", "waiting for the sockets", predecessor);
+      char kinds[kBatch];
+      char control[CMSG_SPACE(sizeof(int) * kBatch)];
+      struct sys::iovec iov;
+      iov.iov_base = kinds;
+      iov.iov_len = sizeof(kinds);
+      struct sys::msghdr msg;
+      std::memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      int64_t n = ready == -1 ? -1 : sys::recvmsg(predecessor, &msg, sys::MSG_CMSG_CLOEXEC);
+      if (n == -1)
+         return failed<Inheritance>("take_over", "unable to receive sockets", predecessor);
+      if (n == 0)
+         break;
+
+      std::vector<int> sockets;
+      for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+         if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != sys::SCM_RIGHTS)
+            continue;
+         size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+         size_t at = sockets.size();
+         sockets.resize(at + count);
+         std::memcpy(&sockets[at], CMSG_DATA(cmsg), sizeof(int) * count);
+      }
+      if (sockets.size() != size_t(n) || (msg.msg_flags & sys::MSG_CTRUNC)) {
+         for (int socket : sockets)
+            sys::close(socket);
+         errno = EPROTO;
+         return failed<Inheritance>("take_over", "received garbled sockets", predecessor);
+      }
+      for (size_t i = 0; i < sockets.size(); i++) {
+         auto adopted = adopt(inheritance, kinds[i], sockets[i], tuning);
+         if (adopted.erred()) {
+            for (size_t j = i + 1; j < sockets.size(); j++)
+               sys::close(sockets[j]);
+            sys::close(predecessor);
+            return adopted.exception();
+         }
+      }
+   }
+
+   if (sys::write(predecessor, &kTakenOver, 1) != 1)
+      return failed<Inheritance>("take_over", "unable to acknowledge the handover", predecessor);
+   sys::close(predecessor);
+   return inheritance;
+}
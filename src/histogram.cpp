@@ -0,0 +1,76 @@
+#include <histogram.hpp>
+
+#include <cstring>
+
+const int Histogram::kSubBucketBits;
+const int Histogram::kMaxValueBits;
+const uint64_t Histogram::kMaxValue;
+const int Histogram::kBuckets;
+
+Histogram::Histogram()
+{
+   reset();
+}
+
+void Histogram::merge(const Histogram& h)
+{
+   for (int i = 0; i < kBuckets; i++)
+      __counts[i] += h.__counts[i];
+   __count += h.__count;
+   __sum += h.__sum;
+   if (h.__max > __max)
+      __max = h.__max;
+}
+
+void Histogram::reset()
+{
+   std::memset(__counts, 0, sizeof(__counts));
+   __count = 0;
+   __sum = 0;
+   __max = 0;
+}
+
+uint64_t Histogram::count() const
+{
+   return __count;
+}
+
+uint64_t Histogram::sum() const
+{
+   return __sum;
+}
+
+uint64_t Histogram::max() const
+{
+   return __max;
+}
+
+uint64_t Histogram::percentile(double p) const
+{
+   if (__count == 0)
+      return 0;
+   uint64_t rank = static_cast<uint64_t>(p / 100.0 * __count + 0.5);
+   if (rank < 1)
+      rank = 1;
+   uint64_t seen = 0;
+   for (int i = 0; i < kBuckets; i++) {
+      seen += __counts[i];
+      if (seen >= rank)
+         return upper(i) < __max ? upper(i) : __max;
+   }
+   return __max;
+}
+
+uint64_t Histogram::bucket(int i) const
+{
+   return __counts[i];
+}
+
+uint64_t Histogram::upper(int i)
+{
+   if (i < (1 << kSubBucketBits))
+      return i;
+   int shift = (i >> kSubBucketBits) - 1;
+   uint64_t sub = i - (shift << kSubBucketBits);
+   return ((sub + 1) << shift) - 1;
+}
@@ -0,0 +1,209 @@
+#ifndef _CPPSOCKET_INSTRUMENT
+#define _CPPSOCKET_INSTRUMENT
+
+#include <stats.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Counter indexes the counters of IOCounters.
+ */
+enum Counter
+{
+   kBytesIn,
+   kBytesOut,
+   kReads,
+   kWrites,
+   kAccepts,
+   kDials,
+   kSyscalls,
+   kPolls,
+   kTimeouts,
+   kEagains,
+   kErrors,
+   kCounters,
+};
+
+enum Latency
+{
+   kReadLatency,
+   kWriteLatency,
+   kAcceptLatency,
+   kDialLatency,
+   kLatencies,
+};
+
+#ifdef CPPSOCKET_STATS
+
+/**
+ * ShardHistogram is a Histogram recorded into by a single thread whilst
+ * aggregation reads it. Like the counters it holds relaxed atomics, so that
+ * neither waits for the other; a snapshot taken meanwhile might see a value
+ * in its bucket but not yet in the sum.
+ */
+struct ShardHistogram
+{
+   ShardHistogram();
+
+   void record(uint64_t v)
+   {
+      if (v > Histogram::kMaxValue)
+         v = Histogram::kMaxValue;
+      bump(__counts[Histogram::index(v)], 1);
+      bump(__sum, v);
+      if (v > __max.load(std::memory_order_relaxed))
+         __max.store(v, std::memory_order_relaxed);
+   }
+
+   /**
+    * merge_into adds what was recorded so far to `h`.
+    */
+   void merge_into(Histogram& h) const;
+
+private:
+   static void bump(std::atomic<uint64_t>& a, uint64_t n)
+   {
+      a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+   }
+
+private:
+   std::atomic<uint64_t> __counts[Histogram::kBuckets];
+   std::atomic<uint64_t> __sum;
+   std::atomic<uint64_t> __max;
+};
+
+/**
+ * StatsShard is the storage of a single thread. It is only ever written by
+ * that thread, hence plain loads and stores suffice, and it is padded to a
+ * cache line of its own so threads don't contend over one.
+ */
+struct alignas(64) StatsShard
+{
+   StatsShard();
+   ~StatsShard();
+
+   std::atomic<uint64_t> counters[kCounters];
+   /**
+    * sampled counts operations per kind, so that alternating kinds, like
+    * writes followed by reads, are sampled alike.
+    */
+   unsigned sampled[kLatencies];
+   ShardHistogram latencies[kLatencies];
+};
+
+extern thread_local StatsShard stats_shard;
+
+/**
+ * count records into the statistics of the calling thread only, for what
+ * happened without a connection or listener to record it on as well.
+ */
+inline void count(Counter c, uint64_t n = 1)
+{
+   std::atomic<uint64_t>& shared = stats_shard.counters[c];
+   shared.store(shared.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+ * IOStatsRecorder records the statistics of a single connection or listener
+ * in addition to the ones of the calling thread. Like a shard, it is written
+ * by one thread at a time, hence the plain loads and stores.
+ */
+struct IOStatsRecorder
+{
+   IOStatsRecorder()
+   {
+      for (auto& c : __counters)
+         c.store(0, std::memory_order_relaxed);
+   }
+
+   void add(Counter c, uint64_t n = 1)
+   {
+      count(c, n);
+      __counters[c].store(__counters[c].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+   }
+
+   IOCounters counters() const;
+
+   /**
+    * counters returns the sum of what this and `other` recorded.
+    */
+   IOCounters counters(const IOStatsRecorder& other) const;
+
+private:
+   std::atomic<uint64_t> __counters[kCounters];
+};
+
+/**
+ * DuplexStats records the statistics of a connection, of which one thread
+ * might read whilst another writes: each direction has a recorder of its
+ * own, so both remain single-writer.
+ */
+struct DuplexStats
+{
+   IOStatsRecorder reading;
+   IOStatsRecorder writing;
+
+   IOCounters counters() const
+   {
+      return reading.counters(writing);
+   }
+};
+
+/**
+ * LatencyTimer times the operation it is alive for, if the calling thread's
+ * turn to sample came up.
+ */
+struct LatencyTimer
+{
+   LatencyTimer(Latency l)
+      : __latency(l)
+      , __sampled(++stats_shard.sampled[l] % IOStats::kLatencySampling == 0)
+   {
+      if (__sampled)
+         __begin = std::chrono::steady_clock::now();
+   }
+
+   ~LatencyTimer()
+   {
+      if (!__sampled)
+         return;
+      uint64_t took = std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now() - __begin
+      ).count();
+      stats_shard.latencies[__latency].record(took);
+   }
+
+private:
+   Latency __latency;
+   bool __sampled;
+   std::chrono::steady_clock::time_point __begin;
+};
+
+#else
+
+inline void count(Counter, uint64_t = 1) {}
+
+struct IOStatsRecorder
+{
+   void add(Counter, uint64_t = 1) {}
+   IOCounters counters() const { return IOCounters(); }
+};
+
+struct DuplexStats
+{
+   IOStatsRecorder reading;
+   IOStatsRecorder writing;
+
+   IOCounters counters() const { return IOCounters(); }
+};
+
+struct LatencyTimer
+{
+   LatencyTimer(Latency) {}
+};
+
+#endif
+
+#endif
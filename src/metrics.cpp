@@ -0,0 +1,177 @@
+#include <metrics.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+static void counter(std::string& out, const char* name, const char* help, uint64_t v)
+{
+   out += std::string("# HELP cppsocket_") + name + " " + help + "\n";
+   out += std::string("# TYPE cppsocket_") + name + " counter\n";
+   out += std::string("cppsocket_") + name + " " + std::to_string(v) + "\n";
+}
+
+static std::string seconds(uint64_t ns)
+{
+   char b[32];
+   std::snprintf(b, sizeof(b), "%.9g", ns / 1e9);
+   return b;
+}
+
+static void histogram(std::string& out, const char* name, const char* help, const Histogram& h)
+{
+   // A bucket per sub-bucket would be hundreds of series, whereas one per
+   // power of two from a microsecond up keeps the relative error within 2x.
+   // Those end just short of the power of two, which `le` includes.
+   const uint64_t kSmallest = 1024;
+   const std::string metric = std::string("cppsocket_") + name + "_seconds";
+   out += "# HELP " + metric + " " + help + "\n";
+   out += "# TYPE " + metric + " histogram\n";
+   uint64_t cumulative = 0;
+   for (int i = 0; i < Histogram::kBuckets; i++) {
+      cumulative += h.bucket(i);
+      uint64_t end = Histogram::upper(i) + 1;
+      if (end < kSmallest || (end & (end - 1)) != 0)
+         continue;
+      out += metric + "_bucket{le=\"" + seconds(Histogram::upper(i)) + "\"} " + std::to_string(cumulative) + "\n";
+   }
+   out += metric + "_bucket{le=\"+Inf\"} " + std::to_string(h.count()) + "\n";
+   out += metric + "_sum " + seconds(h.sum()) + "\n";
+   out += metric + "_count " + std::to_string(h.count()) + "\n";
+}
+
+std::string prometheus_text(const IOStats& s)
+{
+   std::string out;
+   counter(out, "received_bytes_total", "Bytes read from connections.", s.counters.bytes_in);
+   counter(out, "sent_bytes_total", "Bytes written to connections.", s.counters.bytes_out);
+   counter(out, "reads_total", "Successful reads.", s.counters.reads);
+   counter(out, "writes_total", "Successful writes.", s.counters.writes);
+   counter(out, "accepts_total", "Accepted connections.", s.counters.accepts);
+   counter(out, "dials_total", "Dialed connections.", s.counters.dials);
+   counter(out, "syscalls_total", "Socket related syscalls, polls included.", s.counters.syscalls);
+   counter(out, "polls_total", "Polls awaiting readiness.", s.counters.polls);
+   counter(out, "timeouts_total", "Operations which timed out.", s.counters.timeouts);
+   counter(out, "eagains_total", "Syscalls which would have blocked.", s.counters.eagains);
+   counter(out, "errors_total", "Operations which failed.", s.counters.errors);
+   histogram(out, "read_duration", "Sampled duration of reads, polling included.", s.read_latency);
+   histogram(out, "write_duration", "Sampled duration of writes, polling included.", s.write_latency);
+   histogram(out, "accept_duration", "Sampled duration of accepts, polling included.", s.accept_latency);
+   histogram(out, "dial_duration", "Sampled duration of dials.", s.dial_latency);
+   return out;
+}
+
+struct MetricsEndpointImpl
+   : MetricsEndpoint
+{
+   const std::chrono::milliseconds kPollInterval = std::chrono::milliseconds(100);
+   const size_t kMaxRequestLength = 8192;
+
+   MetricsEndpointImpl(const std::shared_ptr<TCPListener>& listener)
+      : __listener(listener)
+      , __request_timeout(std::chrono::seconds(1))
+      , __closed(false)
+   {}
+
+   void request_timeout(const std::chrono::milliseconds& t)
+   {
+      __request_timeout = t;
+   }
+
+   Expected<size_t> serve()
+   {
+      size_t scraped = 0;
+      while (!__closed) {
+         auto accepted = __listener->accept(kPollInterval);
+         if (accepted.erred()) {
+            try {
+               accepted.get();
+            } catch (const std::logic_error&) {
+               continue;
+            } catch (const std::runtime_error& e) {
+               if (__closed)
+                  break;
+               return Expected<size_t>::unexpected(std::runtime_error(
+                  std::string("MetricsEndpoint::serve: failed to accept - ") + e.what()
+               ));
+            }
+         }
+         if (respond(accepted.get()))
+            scraped++;
+      }
+      return scraped;
+   }
+
+   void close()
+   {
+      __closed = true;
+   }
+
+private:
+   /**
+    * respond reads a single request and answers it. It returns whether the
+    * metrics were sent.
+    */
+   bool respond(const std::shared_ptr<TCPConnection>& conn)
+   {
+      std::string request;
+      std::vector<uint8_t> b(1024);
+      auto deadline = std::chrono::steady_clock::now() + __request_timeout;
+      while (request.find("\r\n\r\n") == std::string::npos) {
+         auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()
+         );
+         if (left.count() <= 0 || request.size() > kMaxRequestLength)
+            return false;
+         auto read = conn->read(b, left);
+         if (read.erred() || read.get() == 0)
+            return false;
+         request.append(b.begin(), b.begin() + read.get());
+      }
+
+      std::string line = request.substr(0, request.find("\r\n"));
+      if (line.compare(0, 4, "GET ") != 0) {
+         reply(conn, "405 Method Not Allowed", "");
+         return false;
+      }
+      std::string path = line.substr(4, line.find(' ', 4) - 4);
+      path = path.substr(0, path.find('?'));
+      if (path != "/metrics") {
+         reply(conn, "404 Not Found", "");
+         return false;
+      }
+      return reply(conn, "200 OK", prometheus_text(io_stats()));
+   }
+
+   bool reply(const std::shared_ptr<TCPConnection>& conn, const std::string& status, const std::string& body)
+   {
+      std::string head =
+         "HTTP/1.0 " + status + "\r\n"
+         "Content-Type: text/plain; version=0.0.4\r\n"
+         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+         "Connection: close\r\n"
+         "\r\n";
+      std::vector<uint8_t> response(head.begin(), head.end());
+      response.insert(response.end(), body.begin(), body.end());
+      for (size_t written = 0; written < response.size();) {
+         std::vector<uint8_t> rest(response.begin() + written, response.end());
+         auto wrote = conn->write(rest, __request_timeout);
+         if (wrote.erred())
+            return false;
+         written += wrote.get();
+      }
+      return true;
+   }
+
+private:
+   std::shared_ptr<TCPListener> __listener;
+   std::chrono::milliseconds __request_timeout;
+   std::atomic<bool> __closed;
+};
+
+std::unique_ptr<MetricsEndpoint> metrics_tcp(const std::shared_ptr<TCPListener>& listener)
+{
+   return std::unique_ptr<MetricsEndpoint>(new MetricsEndpointImpl(listener));
+}
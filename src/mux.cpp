@@ -0,0 +1,299 @@
+#include <mux.hpp>
+
+namespace sys {
+
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+}
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+
+const size_t MuxListener::kMaxPrefixLength;
+
+/**
+ * MuxRoute is the sub-listener side of a MuxListener; the MuxListener pushes
+ * the connections it matched, which are then accepted from it.
+ */
+struct MuxRoute
+   : TCPListener
+{
+   MuxRoute()
+      : __timeout(std::chrono::milliseconds(-1))
+      , __closed(false)
+      , __accepts(0)
+   {}
+
+   void push(const std::shared_ptr<TCPConnection>& conn)
+   {
+      {
+         std::lock_guard<std::mutex> lock(__lock);
+         __accepted.push_back(conn);
+      }
+      __available.notify_one();
+   }
+
+   void close()
+   {
+      {
+         std::lock_guard<std::mutex> lock(__lock);
+         __closed = true;
+      }
+      __available.notify_all();
+   }
+
+   Expected<std::shared_ptr<TCPConnection>> accept(const std::chrono::milliseconds& t)
+   {
+      std::unique_lock<std::mutex> lock(__lock);
+      auto ready = [this](){ return __closed || !__accepted.empty(); };
+      if (t.count() < 0)
+         __available.wait(lock, ready);
+      else if (!__available.wait_for(lock, t, ready))
+         return Expected<std::shared_ptr<TCPConnection>>::unexpected(std::logic_error(
+            "MuxListener::accept: timeout whilst awaiting a matching connection"
+         ));
+      if (__accepted.empty())
+         return Expected<std::shared_ptr<TCPConnection>>::unexpected(std::runtime_error(
+            "MuxListener::accept: listener is closed"
+         ));
+      std::shared_ptr<TCPConnection> conn = __accepted.front();
+      __accepted.pop_front();
+      __accepts++;
+      return conn;
+   }
+
+   Expected<std::shared_ptr<TCPConnection>> accept()
+   {
+      return accept(__timeout);
+   }
+
+   void timeout(const std::chrono::milliseconds& t)
+   {
+      __timeout = t;
+   }
+
+   int fd() const noexcept
+   {
+      return -1;
+   }
+
+   IOCounters stats() const noexcept
+   {
+      IOCounters c = IOCounters();
+      c.accepts = __accepts;
+      return c;
+   }
+
+private:
+   std::chrono::milliseconds __timeout;
+   std::mutex __lock;
+   std::condition_variable __available;
+   std::deque<std::shared_ptr<TCPConnection>> __accepted;
+   bool __closed;
+   std::atomic<uint64_t> __accepts;
+};
+
+struct MuxListenerImpl
+   : MuxListener
+{
+   const std::chrono::milliseconds kPollInterval = std::chrono::milliseconds(100);
+
+   MuxListenerImpl(std::unique_ptr<TCPListener> listener)
+      : __listener(std::move(listener))
+      , __sniff_timeout(std::chrono::seconds(1))
+      , __peek(1)
+      , __serving(false)
+      , __closed(false)
+   {}
+
+   ~MuxListenerImpl()
+   {
+      close();
+   }
+
+   std::shared_ptr<TCPListener> match(const std::vector<std::string>& prefixes)
+   {
+      if (__serving)
+         throw std::logic_error("MuxListener::match: registering a matcher whilst serving");
+      auto route = std::make_shared<MuxRoute>();
+      for (const auto& prefix : prefixes) {
+         if (prefix.empty() || prefix.size() > kMaxPrefixLength)
+            throw std::invalid_argument(
+               std::string("MuxListener::match: prefixes are to be between 1 and ") +
+               std::to_string(kMaxPrefixLength) + " bytes long"
+            );
+         // The matcher table is indexed by the first byte, so that only the
+         // prefixes which can possibly match are compared.
+         __table[static_cast<uint8_t>(prefix[0])].push_back(__prefixes.size());
+         __prefixes.push_back(Prefix{prefix, route});
+         if (prefix.size() > __peek)
+            __peek = prefix.size();
+      }
+      __routes.push_back(route);
+      return route;
+   }
+
+   std::shared_ptr<TCPListener> match_any()
+   {
+      if (__serving)
+         throw std::logic_error("MuxListener::match_any: registering a matcher whilst serving");
+      if (!__fallback) {
+         __fallback = std::make_shared<MuxRoute>();
+         __routes.push_back(__fallback);
+      }
+      return __fallback;
+   }
+
+   void sniff_timeout(const std::chrono::milliseconds& t)
+   {
+      __sniff_timeout = t;
+   }
+
+   Expected<size_t> serve()
+   {
+      __serving = true;
+      size_t routed = 0;
+      std::vector<Sniffing> sniffing;
+      std::vector<struct sys::pollfd> pfds;
+      while (!__closed) {
+         auto now = std::chrono::steady_clock::now();
+         auto wait = kPollInterval;
+         pfds.resize(sniffing.size() + 1);
+         pfds[0].fd = __listener->fd();
+         pfds[0].events = POLLIN;
+         pfds[0].revents = 0;
+         for (size_t i = 0; i < sniffing.size(); i++) {
+            pfds[i + 1].fd = sniffing[i].conn->fd();
+            pfds[i + 1].events = POLLIN;
+            pfds[i + 1].revents = 0;
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(sniffing[i].deadline - now);
+            if (left < wait)
+               wait = left < std::chrono::milliseconds(0) ? std::chrono::milliseconds(0) : left;
+         }
+         if (sys::poll(pfds.data(), pfds.size(), wait.count()) == -1) {
+            if (errno == EINTR)
+               continue;
+            return Expected<size_t>::unexpected(std::runtime_error(
+               std::string("MuxListener::serve: failed to poll - ") + std::strerror(errno)
+            ));
+         }
+
+         now = std::chrono::steady_clock::now();
+         for (size_t i = sniffing.size(); i-- > 0;) {
+            std::shared_ptr<MuxRoute> route;
+            bool decided = true;
+            if (pfds[i + 1].revents != 0)
+               decided = sniff(sniffing[i], route);
+            else if (now >= sniffing[i].deadline)
+               route = __fallback;
+            else
+               decided = false;
+            if (!decided)
+               continue;
+            if (route) {
+               if (sniffing[i].lowered) {
+                  int one = 1;
+                  sys::setsockopt(sniffing[i].conn->fd(), SOL_SOCKET, SO_RCVLOWAT, &one, sizeof(one));
+               }
+               route->push(sniffing[i].conn);
+               routed++;
+            }
+            sniffing.erase(sniffing.begin() + i);
+         }
+
+         if (pfds[0].revents & POLLIN) {
+            auto accepted = __listener->accept(std::chrono::milliseconds(0));
+            if (!accepted.erred())
+               sniffing.push_back(Sniffing{accepted.get(), now + __sniff_timeout, false});
+         }
+      }
+      return routed;
+   }
+
+   void close()
+   {
+      __closed = true;
+      for (auto& route : __routes)
+         route->close();
+   }
+
+private:
+   struct Prefix
+   {
+      std::string prefix;
+      std::shared_ptr<MuxRoute> route;
+   };
+
+   struct Sniffing
+   {
+      std::shared_ptr<TCPConnection> conn;
+      std::chrono::steady_clock::time_point deadline;
+      bool lowered;
+   };
+
+   /**
+    * sniff peeks at the connection's first bytes and determines the `route`
+    * to take. It returns `false` when more bytes are needed to decide, and
+    * leaves `route` empty when the connection is to be dropped.
+    */
+   bool sniff(Sniffing& s, std::shared_ptr<MuxRoute>& route)
+   {
+      uint8_t b[kMaxPrefixLength];
+      ssize_t n = sys::recv(s.conn->fd(), b, __peek, sys::MSG_PEEK | sys::MSG_DONTWAIT);
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         return false;
+      if (n <= 0)
+         return true;
+
+      for (size_t i : __table[b[0]]) {
+         const std::string& prefix = __prefixes[i].prefix;
+         size_t m = std::min(static_cast<size_t>(n), prefix.size());
+         if (std::memcmp(b, prefix.data(), m) != 0)
+            continue;
+         if (m == prefix.size()) {
+            route = __prefixes[i].route;
+            return true;
+         }
+         // This prefix might still match, and it takes precedence over the
+         // ones which follow. Have poll wait until more bytes have arrived
+         // instead of reporting the peeked ones over and over again.
+         int more = n + 1;
+         sys::setsockopt(s.conn->fd(), SOL_SOCKET, SO_RCVLOWAT, &more, sizeof(more));
+         s.lowered = true;
+         return false;
+      }
+      route = __fallback;
+      return true;
+   }
+
+private:
+   std::unique_ptr<TCPListener> __listener;
+   std::chrono::milliseconds __sniff_timeout;
+   std::vector<Prefix> __prefixes;
+   std::vector<size_t> __table[256];
+   size_t __peek;
+   std::vector<std::shared_ptr<MuxRoute>> __routes;
+   std::shared_ptr<MuxRoute> __fallback;
+   std::atomic<bool> __serving;
+   std::atomic<bool> __closed;
+};
+
+std::unique_ptr<MuxListener> mux_tcp(std::unique_ptr<TCPListener> listener)
+{
+   return std::unique_ptr<MuxListener>(new MuxListenerImpl(std::move(listener)));
+}
+
+std::vector<std::string> http1_prefixes()
+{
+   return {
+      "GET ", "HEAD ", "POST ", "PUT ", "DELETE ", "CONNECT ", "OPTIONS ", "TRACE ", "PATCH ",
+   };
+}
@@ -0,0 +1,1106 @@
+#include <netsim.hpp>
+#include <instrument.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+const size_t SimulatedNetwork::kSegmentSize;
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * kMinRetransmitTimeout mirrors the lower bound Linux puts on its
+ * retransmission timeout, and kMaxRetransmits the amount of times a segment
+ * is retransmitted before it's delivered regardless.
+ */
+static const std::chrono::milliseconds kMinRetransmitTimeout(200);
+static const unsigned kMaxRetransmits = 15;
+
+/**
+ * kFirstEphemeralPort is where the ports of dialing connections start.
+ */
+static const unsigned kFirstEphemeralPort = 49152;
+
+Impairment::Impairment()
+   : latency(0)
+   , jitter(0)
+   , loss(0)
+   , reorder(0)
+   , bandwidth(0)
+   , queue(0)
+{}
+
+static Impairment impairment(
+   const std::chrono::microseconds& latency,
+   const std::chrono::microseconds& jitter,
+   double loss,
+   double reorder,
+   uint64_t bandwidth,
+   size_t queue
+)
+{
+   Impairment i;
+   i.latency = latency;
+   i.jitter = jitter;
+   i.loss = loss;
+   i.reorder = reorder;
+   i.bandwidth = bandwidth;
+   i.queue = queue;
+   return i;
+}
+
+Expected<Impairment> impairment_profile(const std::string& name)
+{
+   using std::chrono::microseconds;
+   using std::chrono::milliseconds;
+   if (name == "none")
+      return Impairment();
+   if (name == "lan")
+      return impairment(microseconds(250), microseconds(50), 0, 0, 125000000, 1 << 20);
+   if (name == "wan")
+      return impairment(milliseconds(40), milliseconds(2), 0.001, 0, 12500000, 1 << 20);
+   if (name == "lossy")
+      return impairment(milliseconds(40), milliseconds(10), 0.02, 0.01, 12500000, 1 << 20);
+   if (name == "mobile")
+      return impairment(milliseconds(60), milliseconds(30), 0.01, 0.02, 1250000, 256 << 10);
+   if (name == "satellite")
+      return impairment(milliseconds(300), milliseconds(20), 0.005, 0, 3125000, 2 << 20);
+   return Expected<Impairment>::unexpected(std::invalid_argument(
+      std::string("impairment_profile: unknown profile \"") + name + "\""
+   ));
+}
+
+static uint64_t fnv1a(const std::string& s)
+{
+   uint64_t h = 14695981039346656037ull;
+   for (char c : s) {
+      h ^= static_cast<uint8_t>(c);
+      h *= 1099511628211ull;
+   }
+   return h;
+}
+
+static uint64_t splitmix64(uint64_t x)
+{
+   x += 0x9e3779b97f4a7c15ull;
+   x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+   x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+   return x ^ (x >> 31);
+}
+
+/**
+ * Link is one direction between two endpoints, impairing what's sent across
+ * it. Its draws are taken from `std::mt19937_64`, of which the sequence is
+ * fixed by the standard, rather than from the standard distributions, of
+ * which the results differ between implementations.
+ */
+struct Link
+{
+   Link(const Impairment& impairment, uint64_t seed)
+      : __impairment(impairment)
+      , __random(seed)
+      , __retransmits(0)
+   {}
+
+   /**
+    * room returns when `n` more bytes fit the link's queue.
+    */
+   Clock::time_point room(size_t n)
+   {
+      if (__impairment.bandwidth == 0 || __impairment.queue == 0)
+         return Clock::time_point();
+      std::lock_guard<std::mutex> lock(__lock);
+      return __free - transmission(__impairment.queue - std::min(n, __impairment.queue));
+   }
+
+   /**
+    * send impairs `n` bytes sent at `now`, returning whether they arrive and
+    * if so, when in `at`. Stream segments always arrive, in order.
+    *
+    * Every send takes the same draws, whether it's dropped for a full queue
+    * or not, so that the timing doesn't change what's drawn afterwards.
+    */
+   bool send(size_t n, bool stream, const Clock::time_point& now, Clock::time_point& at)
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      const Impairment& i = __impairment;
+      Clock::duration delay = i.latency + std::chrono::duration_cast<Clock::duration>(
+         i.jitter * (2 * draw() - 1)
+      );
+      if (delay < Clock::duration::zero())
+         delay = Clock::duration::zero();
+      bool lost = draw() < i.loss;
+      bool skips = draw() < i.reorder;
+
+      Clock::time_point start = std::max(now, __free);
+      if (!stream && i.bandwidth != 0 && i.queue != 0 &&
+          (n > i.queue || start - now > transmission(i.queue - n)))
+         return false;
+      __free = start + transmission(n);
+
+      if (!stream) {
+         at = __free + (skips ? Clock::duration::zero() : delay);
+         return !lost;
+      }
+      for (unsigned r = 0; lost && r < kMaxRetransmits; r++) {
+         delay += rto();
+         __retransmits++;
+         lost = draw() < i.loss;
+      }
+      at = std::max(__free + delay, __last);
+      __last = at;
+      return true;
+   }
+
+   /**
+    * rto returns the retransmission timeout of the link, as Linux would
+    * estimate it from the round trips across it.
+    */
+   Clock::duration rto() const
+   {
+      return std::max<Clock::duration>(
+         kMinRetransmitTimeout,
+         2 * __impairment.latency + 4 * __impairment.jitter
+      );
+   }
+
+   const Impairment& impairment() const
+   {
+      return __impairment;
+   }
+
+   uint64_t retransmits() const
+   {
+      return __retransmits;
+   }
+
+private:
+   double draw()
+   {
+      return (__random() >> 11) * (1.0 / 9007199254740992.0);
+   }
+
+   Clock::duration transmission(size_t n) const
+   {
+      if (__impairment.bandwidth == 0)
+         return Clock::duration::zero();
+      return std::chrono::duration_cast<Clock::duration>(
+         std::chrono::nanoseconds(n * 1000000000ull / __impairment.bandwidth)
+      );
+   }
+
+private:
+   const Impairment __impairment;
+   std::mutex __lock;
+   std::mt19937_64 __random;
+   Clock::time_point __free;
+   Clock::time_point __last;
+   std::atomic<uint64_t> __retransmits;
+};
+
+/**
+ * Packet is a datagram, a stream segment, or the end of a stream.
+ */
+struct Packet
+{
+   Packet()
+      : offset(0)
+      , fin(false)
+   {}
+
+   std::string from;
+   std::vector<uint8_t> data;
+   size_t offset;
+   bool fin;
+};
+
+/**
+ * Arrivals holds what was sent to an endpoint until it arrives and is taken,
+ * ordered by arrival and then by sending.
+ */
+template <typename T>
+struct Arrivals
+{
+   typedef std::map<std::pair<Clock::time_point, uint64_t>, T> Queue;
+
+   Arrivals()
+      : __sequence(0)
+      , __closed(false)
+   {}
+
+   /**
+    * push returns false when the endpoint was closed, discarding `v`.
+    */
+   bool push(const Clock::time_point& at, T&& v)
+   {
+      {
+         std::lock_guard<std::mutex> lock(__lock);
+         if (__closed)
+            return false;
+         __queue.insert(std::make_pair(std::make_pair(at, __sequence++), std::move(v)));
+      }
+      __arrived.notify_all();
+      return true;
+   }
+
+   /**
+    * close discards what's queued, and what's pushed from now on.
+    */
+   void close()
+   {
+      Queue discarded;
+      {
+         std::lock_guard<std::mutex> lock(__lock);
+         __closed = true;
+         std::swap(discarded, __queue);
+      }
+      __arrived.notify_all();
+   }
+
+   /**
+    * take waits until the earliest of the queue arrived, indefinitely or
+    * until `deadline` when given, and hands the queue to `f` when it did.
+    * It returns false when the wait timed out or the endpoint was closed.
+    */
+   template <typename F>
+   bool take(const Clock::time_point* deadline, F f)
+   {
+      std::unique_lock<std::mutex> lock(__lock);
+      for (;;) {
+         Clock::time_point now = Clock::now();
+         if (__closed)
+            return false;
+         if (!__queue.empty() && __queue.begin()->first.first <= now) {
+            f(__queue, now);
+            return true;
+         }
+         if (deadline && now >= *deadline)
+            return false;
+         if (__queue.empty() && !deadline)
+            __arrived.wait(lock);
+         else if (__queue.empty())
+            __arrived.wait_until(lock, *deadline);
+         else
+            __arrived.wait_until(lock, deadline
+               ? std::min(*deadline, __queue.begin()->first.first)
+               : __queue.begin()->first.first
+            );
+      }
+   }
+
+private:
+   std::mutex __lock;
+   std::condition_variable __arrived;
+   Queue __queue;
+   uint64_t __sequence;
+   bool __closed;
+};
+
+/**
+ * Counters counts what happened on a simulated connection or listener. The
+ * simulation makes no syscalls, so it's kept out of `io_stats`.
+ */
+struct Counters
+{
+   Counters()
+   {
+      for (auto& c : __counters)
+         c.store(0, std::memory_order_relaxed);
+   }
+
+   void add(Counter c, uint64_t n = 1)
+   {
+      __counters[c].fetch_add(n, std::memory_order_relaxed);
+   }
+
+   uint64_t get(Counter c) const
+   {
+      return __counters[c].load(std::memory_order_relaxed);
+   }
+
+   IOCounters counters() const
+   {
+      IOCounters c = IOCounters();
+      c.bytes_in = get(kBytesIn);
+      c.bytes_out = get(kBytesOut);
+      c.reads = get(kReads);
+      c.writes = get(kWrites);
+      c.accepts = get(kAccepts);
+      c.dials = get(kDials);
+      c.timeouts = get(kTimeouts);
+      c.errors = get(kErrors);
+      return c;
+   }
+
+private:
+   std::atomic<uint64_t> __counters[kCounters];
+};
+
+/**
+ * deadline determines when an operation allowed to take `t` gives up, falling
+ * back to `otherwise` for a negative `t`. It returns false when it never does.
+ */
+static bool deadline(const std::chrono::milliseconds& t, const std::chrono::microseconds& otherwise, Clock::time_point& at)
+{
+   if (t.count() >= 0)
+      at = Clock::now() + t;
+   else if (otherwise.count() > 0)
+      at = Clock::now() + otherwise;
+   else
+      return false;
+   return true;
+}
+
+static std::chrono::system_clock::time_point wall_clock(const Clock::time_point& at)
+{
+   return std::chrono::system_clock::now() -
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(Clock::now() - at);
+}
+
+/**
+ * endpoint strips the `scheme` of `address`, returning an empty string when
+ * it's of another scheme.
+ */
+static std::string endpoint(const std::string& address, const std::string& scheme)
+{
+   if (address.compare(0, scheme.size(), scheme) != 0 || address.size() == scheme.size())
+      return std::string();
+   return address.substr(scheme.size());
+}
+
+typedef Arrivals<Packet> Inbox;
+typedef Arrivals<std::shared_ptr<TCPConnection>> Backlog;
+
+struct SimulatedNetworkImpl;
+
+struct SimulatedTCPConnection
+   : TCPConnection
+{
+   SimulatedTCPConnection(
+      const std::string& local,
+      const std::string& remote,
+      const std::shared_ptr<Inbox>& in,
+      const std::shared_ptr<Inbox>& out,
+      const std::shared_ptr<Link>& link
+   )
+      : __local_addr(local)
+      , __remote_addr(remote)
+      , __in(in)
+      , __out(out)
+      , __link(link)
+      , __read_timeout(0)
+      , __write_timeout(0)
+      , __timestamping(false)
+      , __send_buffer(0)
+      , __in_flight(0)
+      , __acked(0)
+      , __write_closed(false)
+      , __read_closed(false)
+   {}
+
+   ~SimulatedTCPConnection()
+   {
+      __in->close();
+      close_write();
+   }
+
+   Expected<bool> close_write()
+   {
+      if (__write_closed.exchange(true))
+         return true;
+      Clock::time_point at;
+      __link->send(0, true, Clock::now(), at);
+      Packet fin;
+      fin.fin = true;
+      __out->push(at, std::move(fin));
+      return true;
+   }
+
+   /**
+    * close_read has reads return the end of the stream, whilst what arrives
+    * is still taken in, as the kernel does.
+    */
+   Expected<bool> close_read()
+   {
+      __read_closed = true;
+      return true;
+   }
+
+   void timeout(const std::chrono::microseconds& t)
+   {
+      read_timeout(t);
+      write_timeout(t);
+   }
+
+   void read_timeout(const std::chrono::microseconds& t)
+   {
+      __read_timeout = t;
+   }
+
+   void write_timeout(const std::chrono::microseconds& t)
+   {
+      __write_timeout = t;
+   }
+
+   void no_delay(bool)
+   {}
+
+   /**
+    * buffer_sizes bounds the bytes in flight by the send buffer, as they
+    * await their acknowledgement a latency after arriving. The receive
+    * buffer isn't simulated.
+    */
+   void buffer_sizes(int send, int)
+   {
+      if (send > 0)
+         __send_buffer = send;
+   }
+
+   Expected<TCPInfo> info() const
+   {
+      const Impairment& i = __link->impairment();
+      TCPInfo ti = TCPInfo();
+      ti.state = 1;
+      ti.rtt = 2 * i.latency;
+      ti.rtt_var = i.jitter;
+      ti.min_rtt = i.latency > i.jitter ? 2 * (i.latency - i.jitter) : std::chrono::microseconds(0);
+      ti.rto = std::chrono::duration_cast<std::chrono::microseconds>(__link->rto());
+      ti.total_retransmits = __link->retransmits();
+      ti.mss = SimulatedNetwork::kSegmentSize;
+      ti.bytes_sent = __stats.get(kBytesOut);
+      {
+         std::lock_guard<std::mutex> lock(__flight_lock);
+         acknowledge(Clock::now());
+         ti.bytes_acked = __acked;
+         ti.unacked = __unacked.size();
+      }
+      ti.bytes_received = __stats.get(kBytesIn);
+      ti.bytes_retransmitted = ti.total_retransmits * SimulatedNetwork::kSegmentSize;
+      return ti;
+   }
+
+   int fd() const noexcept
+   {
+      return -1;
+   }
+
+   IOCounters stats() const noexcept
+   {
+      return __stats.counters();
+   }
+
+   void timestamping(bool enable)
+   {
+      __timestamping = enable;
+   }
+
+   std::chrono::system_clock::time_point received_at() const
+   {
+      return __timestamping ? wall_clock(__received) : std::chrono::system_clock::time_point();
+   }
+
+   Expected<std::vector<SentTimestamp>> sent_at()
+   {
+      return std::vector<SentTimestamp>();
+   }
+
+   std::string local_addr() const noexcept
+   {
+      return __local_addr;
+   }
+
+   std::string remote_addr() const noexcept
+   {
+      return __remote_addr;
+   }
+
+   Expected<size_t> read(std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
+   {
+      if (b.empty())
+         return Expected<size_t>::unexpected(std::invalid_argument(
+            "TCPConnection::read: reading into an empty buffer"
+         ));
+      if (__read_closed) {
+         __stats.add(kReads);
+         return 0;
+      }
+      Clock::time_point until;
+      bool bounded = deadline(t, __read_timeout, until);
+      size_t copied = 0;
+      Clock::time_point received;
+      bool taken = __in->take(bounded ? &until : NULL, [&](Inbox::Queue& q, const Clock::time_point& now) {
+         auto it = q.begin();
+         while (copied < b.size() && it != q.end() && it->first.first <= now && !it->second.fin) {
+            Packet& p = it->second;
+            size_t n = std::min(b.size() - copied, p.data.size() - p.offset);
+            std::memcpy(&b[copied], &p.data[p.offset], n);
+            copied += n;
+            p.offset += n;
+            received = it->first.first;
+            if (p.offset < p.data.size())
+               break;
+            it = q.erase(it);
+         }
+      });
+      if (!taken) {
+         __stats.add(kTimeouts);
+         return Expected<size_t>::unexpected(std::logic_error(
+            "TCPConnection::read: timeout whilst awaiting the link"
+         ));
+      }
+      if (copied > 0)
+         __received = received;
+      __stats.add(kReads);
+      __stats.add(kBytesIn, copied);
+      return copied;
+   }
+
+   Expected<size_t> read(std::vector<uint8_t>& b)
+   {
+      return read(b, std::chrono::milliseconds(-1));
+   }
+
+   Expected<size_t> write(const std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
+   {
+      if (__write_closed) {
+         __stats.add(kErrors);
+         return Expected<size_t>::unexpected(std::runtime_error(
+            std::string("TCPConnection::write: unable to write - ") + std::strerror(EPIPE)
+         ));
+      }
+      Clock::time_point until;
+      bool bounded = deadline(t, __write_timeout, until);
+      size_t sent = 0;
+      while (sent < b.size()) {
+         size_t n = std::min(SimulatedNetwork::kSegmentSize, b.size() - sent);
+         if (!window(n, bounded ? &until : NULL))
+            break;
+         Clock::time_point room = __link->room(n);
+         if (room > Clock::now()) {
+            if (bounded && room > until)
+               break;
+            std::this_thread::sleep_until(room);
+         }
+         Clock::time_point at;
+         __link->send(n, true, Clock::now(), at);
+         Packet p;
+         p.data.assign(b.begin() + sent, b.begin() + sent + n);
+         if (!__out->push(at, std::move(p))) {
+            __stats.add(kErrors);
+            return Expected<size_t>::unexpected(std::runtime_error(
+               std::string("TCPConnection::write: unable to write - ") + std::strerror(EPIPE)
+            ));
+         }
+         {
+            std::lock_guard<std::mutex> lock(__flight_lock);
+            __unacked.push_back(std::make_pair(at + __link->impairment().latency, n));
+            __in_flight += n;
+         }
+         sent += n;
+      }
+      if (sent == 0 && !b.empty()) {
+         __stats.add(kTimeouts);
+         return Expected<size_t>::unexpected(std::logic_error(
+            "TCPConnection::write: timeout whilst awaiting the link"
+         ));
+      }
+      __stats.add(kWrites);
+      __stats.add(kBytesOut, sent);
+      return sent;
+   }
+
+   Expected<size_t> write(const std::vector<uint8_t>& b)
+   {
+      return write(b, std::chrono::milliseconds(-1));
+   }
+
+private:
+   /**
+    * acknowledge retires what was acknowledged by `now`, with the flight
+    * lock held.
+    */
+   void acknowledge(const Clock::time_point& now) const
+   {
+      while (!__unacked.empty() && __unacked.front().first <= now) {
+         __in_flight -= __unacked.front().second;
+         __acked += __unacked.front().second;
+         __unacked.pop_front();
+      }
+   }
+
+   /**
+    * window waits until `n` more bytes fit the send buffer, indefinitely or
+    * until `deadline` when given. It returns false when the wait timed out.
+    */
+   bool window(size_t n, const Clock::time_point* deadline)
+   {
+      for (;;) {
+         Clock::time_point next;
+         {
+            std::lock_guard<std::mutex> lock(__flight_lock);
+            acknowledge(Clock::now());
+            size_t limit = __send_buffer;
+            if (limit == 0 || __in_flight == 0 || __in_flight + n <= limit)
+               return true;
+            next = __unacked.front().first;
+         }
+         if (deadline && next > *deadline)
+            return false;
+         std::this_thread::sleep_until(next);
+      }
+   }
+
+private:
+   std::string __local_addr;
+   std::string __remote_addr;
+   std::shared_ptr<Inbox> __in;
+   std::shared_ptr<Inbox> __out;
+   std::shared_ptr<Link> __link;
+   std::chrono::microseconds __read_timeout;
+   std::chrono::microseconds __write_timeout;
+   std::atomic<bool> __timestamping;
+   Clock::time_point __received;
+   Counters __stats;
+   std::atomic<size_t> __send_buffer;
+   mutable std::mutex __flight_lock;
+   mutable std::deque<std::pair<Clock::time_point, size_t>> __unacked;
+   mutable size_t __in_flight;
+   mutable uint64_t __acked;
+   std::atomic<bool> __write_closed;
+   std::atomic<bool> __read_closed;
+};
+
+struct SimulatedNetworkImpl
+   : SimulatedNetwork
+   , std::enable_shared_from_this<SimulatedNetworkImpl>
+{
+   SimulatedNetworkImpl(const Impairment& impairment, uint64_t seed)
+      : __impairment(impairment)
+      , __seed(seed)
+      , __ephemeral(kFirstEphemeralPort)
+   {}
+
+   std::unique_ptr<TCPListener> listen_tcp(const std::string& address);
+   std::shared_ptr<UDPConnection> listen_udp(const std::string& address);
+   std::shared_ptr<TCPConnection> dial_tcp(const std::string& address);
+   std::shared_ptr<UDPConnection> dial_udp(const std::string& address);
+
+   /**
+    * link returns a new link from `from` to `to`, seeded by their addresses.
+    */
+   std::shared_ptr<Link> link(const std::string& from, const std::string& to)
+   {
+      return std::make_shared<Link>(__impairment, splitmix64(__seed ^ fnv1a(from + ">" + to)));
+   }
+
+   std::shared_ptr<Inbox> udp(const std::string& at)
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      auto found = __udp.find(at);
+      return found == __udp.end() ? nullptr : found->second.lock();
+   }
+
+   template <typename T>
+   void unbind(std::unordered_map<std::string, std::weak_ptr<T>>& bound, const std::string& at, const std::shared_ptr<T>& by)
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      auto found = bound.find(at);
+      if (found != bound.end() && found->second.lock() == by)
+         bound.erase(found);
+   }
+
+   void unbind_udp(const std::string& at, const std::shared_ptr<Inbox>& by)
+   {
+      unbind(__udp, at, by);
+   }
+
+   void unbind_tcp(const std::string& at, const std::shared_ptr<Backlog>& by)
+   {
+      unbind(__tcp, at, by);
+   }
+
+private:
+   template <typename T>
+   bool bind(std::unordered_map<std::string, std::weak_ptr<T>>& bound, const std::string& at, const std::shared_ptr<T>& by)
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      auto found = bound.find(at);
+      if (found != bound.end() && !found->second.expired())
+         return false;
+      bound[at] = by;
+      return true;
+   }
+
+   std::string ephemeral()
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      unsigned port = __ephemeral;
+      __ephemeral = __ephemeral == 65535 ? kFirstEphemeralPort : __ephemeral + 1;
+      return std::string("127.0.0.1:") + std::to_string(port);
+   }
+
+private:
+   const Impairment __impairment;
+   const uint64_t __seed;
+   std::mutex __lock;
+   std::unordered_map<std::string, std::weak_ptr<Inbox>> __udp;
+   std::unordered_map<std::string, std::weak_ptr<Backlog>> __tcp;
+   unsigned __ephemeral;
+};
+
+struct SimulatedTCPListener
+   : TCPListener
+{
+   SimulatedTCPListener(const std::shared_ptr<SimulatedNetworkImpl>& network, const std::string& at, const std::shared_ptr<Backlog>& backlog)
+      : __network(network)
+      , __at(at)
+      , __backlog(backlog)
+      , __timeout(std::chrono::milliseconds(-1))
+   {}
+
+   ~SimulatedTCPListener()
+   {
+      __network->unbind_tcp(__at, __backlog);
+      __backlog->close();
+   }
+
+   Expected<std::shared_ptr<TCPConnection>> accept(const std::chrono::milliseconds& t)
+   {
+      Clock::time_point until;
+      bool bounded = deadline(t, std::chrono::microseconds(0), until);
+      std::shared_ptr<TCPConnection> conn;
+      bool taken = __backlog->take(bounded ? &until : NULL, [&](Backlog::Queue& q, const Clock::time_point&) {
+         conn = std::move(q.begin()->second);
+         q.erase(q.begin());
+      });
+      if (!taken) {
+         __stats.add(kTimeouts);
+         return Expected<std::shared_ptr<TCPConnection>>::unexpected(std::logic_error(
+            "TCPListener::accept: timeout whilst awaiting a connection"
+         ));
+      }
+      __stats.add(kAccepts);
+      return conn;
+   }
+
+   Expected<std::shared_ptr<TCPConnection>> accept()
+   {
+      return accept(__timeout);
+   }
+
+   void timeout(const std::chrono::milliseconds& t)
+   {
+      __timeout = t;
+   }
+
+   int fd() const noexcept
+   {
+      return -1;
+   }
+
+   IOCounters stats() const noexcept
+   {
+      return __stats.counters();
+   }
+
+private:
+   std::shared_ptr<SimulatedNetworkImpl> __network;
+   std::string __at;
+   std::shared_ptr<Backlog> __backlog;
+   std::chrono::milliseconds __timeout;
+   Counters __stats;
+};
+
+struct SimulatedUDPConnection
+   : UDPConnection
+{
+   SimulatedUDPConnection(
+      const std::shared_ptr<SimulatedNetworkImpl>& network,
+      const std::string& local,
+      const std::string& remote,
+      const std::shared_ptr<Inbox>& in
+   )
+      : __network(network)
+      , __local_addr(local)
+      , __remote_addr(remote.empty() ? unknown_addr : remote)
+      , __in(in)
+      , __read_timeout(0)
+      , __timestamping(false)
+   {}
+
+   ~SimulatedUDPConnection()
+   {
+      __network->unbind_udp(endpoint(__local_addr, "udp://"), __in);
+      __in->close();
+   }
+
+   void timeout(const std::chrono::microseconds& t)
+   {
+      read_timeout(t);
+      write_timeout(t);
+   }
+
+   void read_timeout(const std::chrono::microseconds& t)
+   {
+      __read_timeout = t;
+   }
+
+   // Datagrams are dropped rather than awaiting the link.
+   void write_timeout(const std::chrono::microseconds&)
+   {}
+
+   int fd() const noexcept
+   {
+      return -1;
+   }
+
+   IOCounters stats() const noexcept
+   {
+      return __stats.counters();
+   }
+
+   void timestamping(bool enable)
+   {
+      __timestamping = enable;
+   }
+
+   std::chrono::system_clock::time_point received_at() const
+   {
+      return __timestamping ? wall_clock(__received) : std::chrono::system_clock::time_point();
+   }
+
+   Expected<std::vector<SentTimestamp>> sent_at()
+   {
+      return std::vector<SentTimestamp>();
+   }
+
+   std::string local_addr() const noexcept
+   {
+      return __local_addr;
+   }
+
+   std::string remote_addr() const noexcept
+   {
+      return __remote_addr;
+   }
+
+   Expected<size_t> read(std::vector<uint8_t>& b, std::string& remote, const std::chrono::milliseconds& t)
+   {
+      if (b.empty())
+         return Expected<size_t>::unexpected(std::invalid_argument(
+            "UDPConnection::read: reading into an empty buffer"
+         ));
+      Clock::time_point until;
+      bool bounded = deadline(t, __read_timeout, until);
+      for (;;) {
+         Packet p;
+         Clock::time_point received;
+         bool taken = __in->take(bounded ? &until : NULL, [&](Inbox::Queue& q, const Clock::time_point&) {
+            received = q.begin()->first.first;
+            p = std::move(q.begin()->second);
+            q.erase(q.begin());
+         });
+         if (!taken) {
+            __stats.add(kTimeouts);
+            return Expected<size_t>::unexpected(std::logic_error(
+               "UDPConnection::read: timeout whilst awaiting a datagram"
+            ));
+         }
+         // A dialing connection only hears from whom it dialed.
+         if (__remote_addr != unknown_addr && p.from != __remote_addr)
+            continue;
+         size_t n = std::min(b.size(), p.data.size());
+         std::copy(p.data.begin(), p.data.begin() + n, b.begin());
+         remote = p.from;
+         __received = received;
+         __stats.add(kReads);
+         __stats.add(kBytesIn, n);
+         return n;
+      }
+   }
+
+   Expected<size_t> read(std::vector<uint8_t>& b, std::string& remote)
+   {
+      return read(b, remote, std::chrono::milliseconds(-1));
+   }
+
+   Expected<size_t> read(std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
+   {
+      std::string whom;
+      return read(b, whom, t);
+   }
+
+   Expected<size_t> read(std::vector<uint8_t>& b)
+   {
+      return read(b, std::chrono::milliseconds(-1));
+   }
+
+   Expected<size_t> write(const std::vector<uint8_t>& b, const std::string& remote, const std::chrono::milliseconds&)
+   {
+      const std::string to = endpoint(remote, "udp://");
+      if (to.empty())
+         return Expected<size_t>::unexpected(std::invalid_argument(
+            std::string("UDPConnection::write: unable to resolve the given remote \"") + remote + "\""
+         ));
+      Clock::time_point at;
+      if (__link(remote)->send(b.size(), false, Clock::now(), at)) {
+         auto in = __network->udp(to);
+         if (in) {
+            Packet p;
+            p.from = __local_addr;
+            p.data = b;
+            in->push(at, std::move(p));
+         }
+      }
+      __stats.add(kWrites);
+      __stats.add(kBytesOut, b.size());
+      return b.size();
+   }
+
+   Expected<size_t> write(const std::vector<uint8_t>& b, const std::string& remote)
+   {
+      return write(b, remote, std::chrono::milliseconds(-1));
+   }
+
+   Expected<size_t> write(const std::vector<uint8_t>& b, const std::chrono::milliseconds& t)
+   {
+      if (__remote_addr == unknown_addr)
+         return Expected<size_t>::unexpected(std::logic_error(
+            "UDPConnection::write: writing to receiving UDP connection without addressee"
+         ));
+      return write(b, __remote_addr, t);
+   }
+
+   Expected<size_t> write(const std::vector<uint8_t>& b)
+   {
+      return write(b, std::chrono::milliseconds(-1));
+   }
+
+private:
+   std::shared_ptr<Link> __link(const std::string& remote)
+   {
+      std::lock_guard<std::mutex> lock(__links_lock);
+      std::shared_ptr<Link>& link = __links[remote];
+      if (!link)
+         link = __network->link(__local_addr, remote);
+      return link;
+   }
+
+private:
+   std::shared_ptr<SimulatedNetworkImpl> __network;
+   std::string __local_addr;
+   std::string __remote_addr;
+   std::shared_ptr<Inbox> __in;
+   std::chrono::microseconds __read_timeout;
+   std::atomic<bool> __timestamping;
+   Clock::time_point __received;
+   Counters __stats;
+   std::unordered_map<std::string, std::shared_ptr<Link>> __links;
+   std::mutex __links_lock;
+};
+
+std::unique_ptr<TCPListener> SimulatedNetworkImpl::listen_tcp(const std::string& address)
+{
+   const std::string at = endpoint(address, "tcp://");
+   if (at.empty())
+      throw std::runtime_error(
+         std::string("SimulatedNetwork::listen_tcp: attempting to use a non-TCP address \"") + address + "\""
+      );
+   auto backlog = std::make_shared<Backlog>();
+   if (!bind(__tcp, at, backlog))
+      throw std::runtime_error(
+         std::string("TCPListener::TCPListener: unable to bind socket - ") + std::strerror(EADDRINUSE)
+      );
+   return std::unique_ptr<TCPListener>(new SimulatedTCPListener(shared_from_this(), at, backlog));
+}
+
+std::shared_ptr<UDPConnection> SimulatedNetworkImpl::listen_udp(const std::string& address)
+{
+   const std::string at = endpoint(address, "udp://");
+   if (at.empty())
+      throw std::runtime_error(
+         std::string("SimulatedNetwork::listen_udp: attempting to use a non-UDP address \"") + address + "\""
+      );
+   auto in = std::make_shared<Inbox>();
+   if (!bind(__udp, at, in))
+      throw std::runtime_error(
+         std::string("UDPConnection::UDPConnection: unable to bind socket - ") + std::strerror(EADDRINUSE)
+      );
+   return std::make_shared<SimulatedUDPConnection>(shared_from_this(), address, std::string(), in);
+}
+
+std::shared_ptr<TCPConnection> SimulatedNetworkImpl::dial_tcp(const std::string& address)
+{
+   const std::string to = endpoint(address, "tcp://");
+   if (to.empty())
+      throw std::runtime_error(
+         std::string("SimulatedNetwork::dial_tcp: attempting to use a non-TCP address \"") + address + "\""
+      );
+   std::shared_ptr<Backlog> backlog;
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      auto found = __tcp.find(to);
+      if (found != __tcp.end())
+         backlog = found->second.lock();
+   }
+   if (!backlog)
+      throw std::runtime_error(
+         std::string("TCPConnection::TCPConnection: unable to connect socket - ") + std::strerror(ECONNREFUSED)
+      );
+
+   const std::string local = std::string("tcp://") + ephemeral();
+   auto forward = link(local, address);
+   auto backward = link(address, local);
+   auto client_in = std::make_shared<Inbox>();
+   auto server_in = std::make_shared<Inbox>();
+   auto client = std::make_shared<SimulatedTCPConnection>(local, address, client_in, server_in, forward);
+   std::shared_ptr<TCPConnection> server = std::make_shared<SimulatedTCPConnection>(
+      address, local, server_in, client_in, backward
+   );
+
+   // The handshake takes a round trip, through which both links' segments
+   // are ordered after it.
+   Clock::time_point syn, synack;
+   forward->send(0, true, Clock::now(), syn);
+   backward->send(0, true, syn, synack);
+   if (!backlog->push(syn, std::move(server)))
+      throw std::runtime_error(
+         std::string("TCPConnection::TCPConnection: unable to connect socket - ") + std::strerror(ECONNREFUSED)
+      );
+   std::this_thread::sleep_until(synack);
+   return client;
+}
+
+std::shared_ptr<UDPConnection> SimulatedNetworkImpl::dial_udp(const std::string& address)
+{
+   if (endpoint(address, "udp://").empty())
+      throw std::runtime_error(
+         std::string("SimulatedNetwork::dial_udp: attempting to use a non-UDP address \"") + address + "\""
+      );
+   // Once every ephemeral port was tried, they're all bound.
+   for (unsigned tried = kFirstEphemeralPort; tried <= 65535; tried++) {
+      const std::string at = ephemeral();
+      auto in = std::make_shared<Inbox>();
+      if (bind(__udp, at, in))
+         return std::make_shared<SimulatedUDPConnection>(shared_from_this(), std::string("udp://") + at, address, in);
+   }
+   throw std::runtime_error(
+      std::string("UDPConnection::UDPConnection: unable to bind socket - ") + std::strerror(EADDRINUSE)
+   );
+}
+
+std::shared_ptr<SimulatedNetwork> simulate_network(const Impairment& impairment, uint64_t seed)
+{
+   return std::make_shared<SimulatedNetworkImpl>(impairment, seed);
+}
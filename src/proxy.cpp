@@ -0,0 +1,673 @@
+#include <proxy.hpp>
+#include <socket.hpp>
+#include <timer_wheel.hpp>
+#include <address.hpp>
+
+namespace sys {
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+}
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * set_nonblocking puts the given file descriptor into non-blocking mode.
+ */
+static bool set_nonblocking(int fd)
+{
+   int flags = sys::fcntl(fd, F_GETFL, 0);
+   return flags != -1 && sys::fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+/**
+ * QuietPipes blocks SIGPIPE on the calling thread for as long as it lives, and
+ * discards those raised meanwhile. Unlike send, splice can't be told not to
+ * raise it when writing to a connection which was reset. Left alone when the
+ * thread blocked SIGPIPE itself already.
+ */
+struct QuietPipes
+{
+   QuietPipes()
+   {
+      sys::sigemptyset(&__pipe);
+      sys::sigaddset(&__pipe, SIGPIPE);
+      sys::pthread_sigmask(SIG_BLOCK, &__pipe, &__restore);
+   }
+
+   ~QuietPipes()
+   {
+      if (sys::sigismember(&__restore, SIGPIPE))
+         return;
+      struct timespec now = {0, 0};
+      while (sys::sigtimedwait(&__pipe, NULL, &now) == SIGPIPE);
+      sys::pthread_sigmask(SIG_SETMASK, &__restore, NULL);
+   }
+
+private:
+   // <thread> declared sigset_t and timespec outside of `sys` already.
+   sigset_t __pipe;
+   sigset_t __restore;
+};
+
+/**
+ * ProxyLoop holds what both proxies share: the epoll instance, the keepalive
+ * tearing down idle sessions and the bookkeeping to stop serving. Both the
+ * keepalive's timer and the wakeup of `close` are watched along with the
+ * sessions, so that serving only wakes up when there's something to do.
+ */
+struct ProxyLoop
+   : Proxy
+{
+   const uint64_t kListenerToken = ~uint64_t(0);
+   const uint64_t kTimerToken = ~uint64_t(0) - 1;
+   const uint64_t kWakeToken = ~uint64_t(0) - 2;
+   static const int kMaxEvents = 64;
+
+   ProxyLoop()
+      : __next(0)
+      , __proxied(0)
+      , __closed(false)
+   {
+      __epoll = sys::epoll_create1(sys::EPOLL_CLOEXEC);
+      if (__epoll == -1)
+         throw std::runtime_error(
+            std::string("Proxy::Proxy: unable to create epoll instance - ") +
+            std::strerror(errno)
+         );
+      __wake = sys::eventfd(0, sys::EFD_NONBLOCK | sys::EFD_CLOEXEC);
+      if (__wake == -1 || !watch(__wake, EPOLL_CTL_ADD, sys::EPOLLIN, kWakeToken)) {
+         int err = errno;
+         if (__wake != -1)
+            sys::close(__wake);
+         sys::close(__epoll);
+         throw std::runtime_error(
+            std::string("Proxy::Proxy: unable to watch for wakeups - ") +
+            std::strerror(err)
+         );
+      }
+   }
+
+   ~ProxyLoop()
+   {
+      sys::close(__wake);
+      sys::close(__epoll);
+   }
+
+   void idle_timeout(const std::chrono::milliseconds& t)
+   {
+      if (__keepalive)
+         unwatch(__keepalive->fd());
+      __keepalive.reset();
+      if (t.count() < 0)
+         return;
+      __keepalive = keepalive(t, std::chrono::milliseconds(-1),
+         [this](uint64_t id){ teardown(id); },
+         [](uint64_t){}
+      );
+      if (!watch(__keepalive->fd(), EPOLL_CTL_ADD, sys::EPOLLIN, kTimerToken))
+         throw std::runtime_error(
+            std::string("Proxy::idle_timeout: unable to watch the timer - ") +
+            std::strerror(errno)
+         );
+   }
+
+   void close()
+   {
+      __closed = true;
+      sys::eventfd_write(__wake, 1);
+   }
+
+   Expected<size_t> serve()
+   {
+      QuietPipes quiet;
+      struct sys::epoll_event events[kMaxEvents];
+      while (!__closed) {
+         int n = sys::epoll_wait(__epoll, events, kMaxEvents, -1);
+         if (n == -1) {
+            if (errno == EINTR)
+               continue;
+            return Expected<size_t>::unexpected(std::runtime_error(
+               std::string("Proxy::serve: failed to wait for events - ") + std::strerror(errno)
+            ));
+         }
+         for (int i = 0; i < n; i++) {
+            uint64_t token = events[i].data.u64;
+            if (token == kWakeToken) {
+               sys::eventfd_t ignored;
+               sys::eventfd_read(__wake, &ignored);
+            } else if (token == kTimerToken) {
+               __keepalive->expire(std::chrono::steady_clock::now());
+            } else {
+               handle(token, events[i].events);
+            }
+         }
+      }
+      teardown_all();
+      return __proxied;
+   }
+
+protected:
+   /**
+    * handle processes the `events` reported for `token`.
+    */
+   virtual void handle(uint64_t token, uint32_t events) = 0;
+
+   virtual void teardown(uint64_t id) = 0;
+   virtual void teardown_all() = 0;
+
+   /**
+    * next_id hands out the id of a new session, which is only counted and
+    * timed once `started`, when all of it was set up.
+    */
+   uint64_t next_id()
+   {
+      return __next++;
+   }
+
+   void started(uint64_t id)
+   {
+      __proxied++;
+      if (__keepalive)
+         __keepalive->watch(id);
+   }
+
+   /**
+    * touched records activity on session `id`, and ended lets go of it.
+    */
+   void touched(uint64_t id)
+   {
+      if (__keepalive)
+         __keepalive->touch(id);
+   }
+
+   void ended(uint64_t id)
+   {
+      if (__keepalive)
+         __keepalive->forget(id);
+   }
+
+   bool watch(int fd, int op, uint32_t events, uint64_t token)
+   {
+      struct sys::epoll_event ev;
+      ev.events = events;
+      ev.data.u64 = token;
+      return sys::epoll_ctl(__epoll, op, fd, &ev) != -1;
+   }
+
+   void unwatch(int fd)
+   {
+      sys::epoll_ctl(__epoll, EPOLL_CTL_DEL, fd, NULL);
+   }
+
+private:
+   int __epoll;
+   int __wake;
+   std::unique_ptr<Keepalive> __keepalive;
+   uint64_t __next;
+   size_t __proxied;
+   std::atomic<bool> __closed;
+};
+
+const int ProxyLoop::kMaxEvents;
+
+struct TCPProxyImpl
+   : ProxyLoop
+{
+   /**
+    * kPipeSize is the amount of bytes a direction may have in flight, which
+    * matches the default capacity of a pipe.
+    */
+   static const size_t kPipeSize = 64 * 1024;
+
+   TCPProxyImpl(std::unique_ptr<TCPListener> listener, const std::string& upstream)
+      : __listener(std::move(listener))
+   {
+      auto resolved = resolve(upstream);
+      if (resolved.erred() || resolved.get()->ai_socktype != sys::SOCK_STREAM)
+         throw std::invalid_argument(
+            std::string("Proxy::Proxy: unable to resolve the upstream \"") + upstream + "\""
+         );
+      __upstream = resolved.get();
+      __remote = std::string("tcp://") + netaddr(__upstream->ai_addr).get();
+      if (!watch(__listener->fd(), EPOLL_CTL_ADD, sys::EPOLLIN, kListenerToken))
+         throw std::runtime_error(
+            std::string("Proxy::Proxy: unable to watch the listener - ") +
+            std::strerror(errno)
+         );
+   }
+
+   ~TCPProxyImpl()
+   {
+      teardown_all();
+   }
+
+protected:
+   void handle(uint64_t token, uint32_t events)
+   {
+      if (token == kListenerToken) {
+         pair();
+         return;
+      }
+      auto found = __pairs.find(token >> 1);
+      if (found == __pairs.end())
+         return;
+      Pair& p = found->second;
+      if (events & sys::EPOLLERR) {
+         teardown(p.id);
+         return;
+      }
+      touched(p.id);
+      if (p.connecting) {
+         if (!connected(p))
+            teardown(p.id);
+         return;
+      }
+      if (!pump(p.directions[0]) || !pump(p.directions[1])) {
+         teardown(p.id);
+         return;
+      }
+      if (p.directions[0].done && p.directions[1].done) {
+         teardown(p.id);
+         return;
+      }
+      rewatch(p);
+   }
+
+   void teardown(uint64_t id)
+   {
+      auto found = __pairs.find(id);
+      if (found == __pairs.end())
+         return;
+      Pair& p = found->second;
+      unwatch(p.down->fd());
+      unwatch(p.up->fd());
+      for (auto& d : p.directions) {
+         sys::close(d.pipe[0]);
+         sys::close(d.pipe[1]);
+      }
+      __pairs.erase(found);
+      ended(id);
+   }
+
+   void teardown_all()
+   {
+      while (!__pairs.empty())
+         teardown(__pairs.begin()->first);
+   }
+
+private:
+   struct Direction
+   {
+      int from;
+      int to;
+      int pipe[2];
+      size_t buffered;
+      bool eof;
+      bool done;
+   };
+
+   struct Pair
+   {
+      uint64_t id;
+      std::shared_ptr<TCPConnection> down;
+      std::shared_ptr<TCPConnection> up;
+      bool connecting;
+      Direction directions[2];
+      uint32_t watching[2];
+   };
+
+   /**
+    * pair accepts a connection and starts connecting upstream for it. The
+    * connect doesn't block, so that a slow upstream doesn't stall the pairs
+    * already established; the accepted side is only watched once `connected`.
+    */
+   void pair()
+   {
+      auto accepted = __listener->accept(std::chrono::milliseconds(0));
+      if (accepted.erred())
+         return;
+      std::shared_ptr<TCPConnection> down = accepted.get();
+      if (!set_nonblocking(down->fd()))
+         return;
+      int fd = sys::socket(__upstream->ai_family, __upstream->ai_socktype | sys::SOCK_NONBLOCK | sys::SOCK_CLOEXEC, __upstream->ai_protocol);
+      if (fd == -1)
+         return;
+      if (sys::connect(fd, __upstream->ai_addr, __upstream->ai_addrlen) == -1 && errno != EINPROGRESS) {
+         sys::close(fd);
+         return;
+      }
+      // The local address is bound by connect already, even when in progress.
+      auto local = netaddr(fd);
+      if (local.erred()) {
+         sys::close(fd);
+         return;
+      }
+      std::shared_ptr<TCPConnection> up = std::make_shared<TCPSocket>(fd, std::string("tcp://") + local.get(), __remote);
+
+      Pair p;
+      p.down = down;
+      p.up = up;
+      p.connecting = true;
+      p.directions[0] = Direction{down->fd(), up->fd(), {-1, -1}, 0, false, false};
+      p.directions[1] = Direction{up->fd(), down->fd(), {-1, -1}, 0, false, false};
+      if (sys::pipe2(p.directions[0].pipe, O_NONBLOCK | O_CLOEXEC) == -1)
+         return;
+      if (sys::pipe2(p.directions[1].pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+         sys::close(p.directions[0].pipe[0]);
+         sys::close(p.directions[0].pipe[1]);
+         return;
+      }
+      p.watching[0] = 0;
+      p.watching[1] = sys::EPOLLOUT;
+      p.id = next_id();
+      __pairs[p.id] = p;
+      if (!watch(up->fd(), EPOLL_CTL_ADD, sys::EPOLLOUT, (p.id << 1) | 1)) {
+         teardown(p.id);
+         return;
+      }
+      started(p.id);
+   }
+
+   /**
+    * connected finishes pairing `p` once its upstream connection became
+    * writable, returning `false` when the connection failed.
+    */
+   bool connected(Pair& p)
+   {
+      int err = 0;
+      sys::socklen_t len = sizeof(err);
+      if (sys::getsockopt(p.up->fd(), SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0)
+         return false;
+      p.connecting = false;
+      p.watching[0] = p.watching[1] = sys::EPOLLIN;
+      return watch(p.down->fd(), EPOLL_CTL_ADD, sys::EPOLLIN, p.id << 1) &&
+         watch(p.up->fd(), EPOLL_CTL_MOD, sys::EPOLLIN, (p.id << 1) | 1);
+   }
+
+   /**
+    * pump moves as many bytes as currently possible from one side, through
+    * the direction's pipe, to the other side. Once the reading side reached
+    * EOF and the pipe is drained, the writing side is shut down to propagate
+    * the half-close. It returns `false` when the direction failed.
+    */
+   bool pump(Direction& d)
+   {
+      for (;;) {
+         bool progressed = false;
+         if (!d.eof && d.buffered < kPipeSize) {
+            ssize_t n = sys::splice(d.from, NULL, d.pipe[1], NULL, kPipeSize - d.buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+               d.buffered += n;
+               progressed = true;
+            } else if (n == 0) {
+               d.eof = true;
+            } else if (errno != EAGAIN) {
+               return false;
+            }
+         }
+         if (d.buffered > 0) {
+            ssize_t n = sys::splice(d.pipe[0], NULL, d.to, NULL, d.buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+               d.buffered -= n;
+               progressed = true;
+            } else if (n == 0 || errno != EAGAIN) {
+               return false;
+            }
+         }
+         if (!progressed)
+            break;
+      }
+      if (d.eof && d.buffered == 0 && !d.done) {
+         sys::shutdown(d.to, sys::SHUT_WR);
+         d.done = true;
+      }
+      return true;
+   }
+
+   /**
+    * rewatch updates the events watched for both sides: readable while its
+    * direction has room in its pipe, and writable while the opposite
+    * direction has bytes waiting in its pipe.
+    */
+   void rewatch(Pair& p)
+   {
+      for (int side = 0; side < 2; side++) {
+         const Direction& reading = p.directions[side];
+         const Direction& writing = p.directions[1 - side];
+         uint32_t events = 0;
+         if (!reading.eof && reading.buffered < kPipeSize)
+            events |= sys::EPOLLIN;
+         if (writing.buffered > 0)
+            events |= sys::EPOLLOUT;
+         if (events == p.watching[side])
+            continue;
+         int fd = side == 0 ? p.down->fd() : p.up->fd();
+         watch(fd, EPOLL_CTL_MOD, events, (p.id << 1) | side);
+         p.watching[side] = events;
+      }
+   }
+
+private:
+   std::unique_ptr<TCPListener> __listener;
+   std::shared_ptr<struct sys::addrinfo> __upstream;
+   std::string __remote;
+   std::unordered_map<uint64_t, Pair> __pairs;
+};
+
+const size_t TCPProxyImpl::kPipeSize;
+
+struct UDPProxyImpl
+   : ProxyLoop
+{
+   static const size_t kBatch = 32;
+   static const size_t kMaxDatagram = 64 * 1024;
+
+   UDPProxyImpl(const std::shared_ptr<UDPConnection>& listener, const std::string& upstream)
+      : __listener(listener)
+      , __upstream(upstream)
+      , __buffers(kBatch * kMaxDatagram)
+   {
+      if (!set_nonblocking(__listener->fd()) ||
+          !watch(__listener->fd(), EPOLL_CTL_ADD, sys::EPOLLIN, kListenerToken))
+         throw std::runtime_error(
+            std::string("Proxy::Proxy: unable to watch the listener - ") +
+            std::strerror(errno)
+         );
+      for (size_t i = 0; i < kBatch; i++) {
+         __iovecs[i].iov_base = &__buffers[i * kMaxDatagram];
+         __iovecs[i].iov_len = kMaxDatagram;
+      }
+   }
+
+   ~UDPProxyImpl()
+   {
+      teardown_all();
+   }
+
+protected:
+   void handle(uint64_t token, uint32_t /* events */)
+   {
+      if (token == kListenerToken) {
+         relay_upstream();
+         return;
+      }
+      auto found = __sessions.find(token);
+      if (found == __sessions.end())
+         return;
+      relay_downstream(found->second);
+   }
+
+   void teardown(uint64_t id)
+   {
+      auto found = __sessions.find(id);
+      if (found == __sessions.end())
+         return;
+      unwatch(found->second.up->fd());
+      __clients.erase(found->second.key);
+      __sessions.erase(found);
+      ended(id);
+   }
+
+   void teardown_all()
+   {
+      while (!__sessions.empty())
+         teardown(__sessions.begin()->first);
+   }
+
+private:
+   struct Session
+   {
+      uint64_t id;
+      std::string key;
+      struct sys::sockaddr_storage client;
+      sys::socklen_t length;
+      std::shared_ptr<UDPConnection> up;
+   };
+
+   /**
+    * receive reads a batch of datagrams from `fd` into the shared buffers.
+    */
+   int receive(int fd, bool named)
+   {
+      for (size_t i = 0; i < kBatch; i++) {
+         std::memset(&__headers[i], 0, sizeof(__headers[i]));
+         __headers[i].msg_hdr.msg_iov = &__iovecs[i];
+         __headers[i].msg_hdr.msg_iovlen = 1;
+         if (named) {
+            __headers[i].msg_hdr.msg_name = &__names[i];
+            __headers[i].msg_hdr.msg_namelen = sizeof(__names[i]);
+         }
+      }
+      return sys::recvmmsg(fd, __headers, kBatch, sys::MSG_DONTWAIT, NULL);
+   }
+
+   /**
+    * send writes the `n` datagrams starting at `first` to `fd`, with the
+    * lengths they were received with.
+    */
+   void send(int fd, size_t first, size_t n)
+   {
+      struct sys::mmsghdr out[kBatch];
+      struct sys::iovec iovecs[kBatch];
+      for (size_t i = 0; i < n; i++) {
+         out[i].msg_hdr = __headers[first + i].msg_hdr;
+         iovecs[i].iov_base = __iovecs[first + i].iov_base;
+         iovecs[i].iov_len = __headers[first + i].msg_len;
+         out[i].msg_hdr.msg_iov = &iovecs[i];
+         out[i].msg_len = 0;
+      }
+      for (size_t sent = 0; sent < n;) {
+         int s = sys::sendmmsg(fd, out + sent, n - sent, 0);
+         if (s <= 0)
+            return;
+         sent += s;
+      }
+   }
+
+   void relay_upstream()
+   {
+      int n = receive(__listener->fd(), true);
+      if (n <= 0)
+         return;
+      // Consecutive datagrams of the same client are sent upstream in one go.
+      int first = 0;
+      Session* current = NULL;
+      for (int i = 0; i <= n; i++) {
+         Session* s = i < n ? session(i) : NULL;
+         if (i < n && s == current)
+            continue;
+         if (current != NULL) {
+            for (int j = first; j < i; j++) {
+               __headers[j].msg_hdr.msg_name = NULL;
+               __headers[j].msg_hdr.msg_namelen = 0;
+            }
+            send(current->up->fd(), first, i - first);
+         }
+         current = s;
+         first = i;
+      }
+   }
+
+   void relay_downstream(Session& s)
+   {
+      int n = receive(s.up->fd(), false);
+      if (n <= 0)
+         return;
+      touched(s.id);
+      for (int i = 0; i < n; i++) {
+         __headers[i].msg_hdr.msg_name = &s.client;
+         __headers[i].msg_hdr.msg_namelen = s.length;
+      }
+      send(__listener->fd(), 0, n);
+   }
+
+   /**
+    * session returns the session of the client the `i`th datagram came from,
+    * dialing upstream for clients not seen before.
+    */
+   Session* session(int i)
+   {
+      const std::string key(reinterpret_cast<const char*>(&__names[i]), __headers[i].msg_hdr.msg_namelen);
+      auto known = __clients.find(key);
+      if (known != __clients.end()) {
+         touched(known->second);
+         return &__sessions[known->second];
+      }
+      std::shared_ptr<UDPConnection> up;
+      try {
+         up = dial_udp(__upstream);
+      } catch (const std::exception&) {
+         return NULL;
+      }
+      if (!set_nonblocking(up->fd()))
+         return NULL;
+      Session s;
+      s.id = next_id();
+      s.key = key;
+      std::memcpy(&s.client, &__names[i], __headers[i].msg_hdr.msg_namelen);
+      s.length = __headers[i].msg_hdr.msg_namelen;
+      s.up = up;
+      if (!watch(up->fd(), EPOLL_CTL_ADD, sys::EPOLLIN, s.id))
+         return NULL;
+      started(s.id);
+      __clients[key] = s.id;
+      return &(__sessions[s.id] = s);
+   }
+
+private:
+   std::shared_ptr<UDPConnection> __listener;
+   std::string __upstream;
+   std::vector<uint8_t> __buffers;
+   struct sys::iovec __iovecs[kBatch];
+   struct sys::mmsghdr __headers[kBatch];
+   struct sys::sockaddr_storage __names[kBatch];
+   std::unordered_map<uint64_t, Session> __sessions;
+   std::unordered_map<std::string, uint64_t> __clients;
+};
+
+const size_t UDPProxyImpl::kBatch;
+const size_t UDPProxyImpl::kMaxDatagram;
+
+std::unique_ptr<Proxy> proxy_tcp(std::unique_ptr<TCPListener> listener, const std::string& upstream)
+{
+   return std::unique_ptr<Proxy>(new TCPProxyImpl(std::move(listener), upstream));
+}
+
+std::unique_ptr<Proxy> proxy_udp(const std::shared_ptr<UDPConnection>& listener, const std::string& upstream)
+{
+   return std::unique_ptr<Proxy>(new UDPProxyImpl(listener, upstream));
+}
@@ -0,0 +1,299 @@
+#include <resp.hpp>
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+/**
+ * kMaxBulkLength mirrors the largest bulk string a Redis server accepts.
+ */
+static const int64_t kMaxBulkLength = 512 * 1024 * 1024;
+
+/**
+ * parse_integer parses the signed decimal in [`b`, `e`) into `v`, refusing
+ * those which don't fit.
+ */
+static bool parse_integer(const uint8_t* b, const uint8_t* e, int64_t& v)
+{
+   bool negative = false;
+   if (b != e && *b == '-') {
+      negative = true;
+      b++;
+   }
+   if (b == e)
+      return false;
+   int64_t r = 0;
+   for (; b != e; b++) {
+      if (*b < '0' || *b > '9')
+         return false;
+      int d = *b - '0';
+      if (r > (std::numeric_limits<int64_t>::max() - d) / 10)
+         return false;
+      r = r * 10 + d;
+   }
+   v = negative ? -r : r;
+   return true;
+}
+
+RESPParser::RESPParser()
+   : __start(0)
+   , __pos(0)
+   , __complete(false)
+{}
+
+Expected<bool> RESPParser::parse(const uint8_t* b, size_t n)
+{
+   if (__complete) {
+      __values.clear();
+      __complete = false;
+   }
+   if (__values.empty())
+      __start = __pos;
+
+   while (__pos < n) {
+      const uint8_t* p = b + __pos;
+      const uint8_t* cr = static_cast<const uint8_t*>(std::memchr(p, '\r', n - __pos));
+      if (cr == NULL || cr + 1 == b + n)
+         return false;
+      if (cr[1] != '\n')
+         return Expected<bool>::unexpected(std::runtime_error(
+            "RESPParser::parse: expected a line feed after a carriage return"
+         ));
+      size_t next = (cr + 2) - b;
+
+      RESPValue v;
+      v.type = static_cast<RESPType>(*p);
+      v.null = false;
+      v.offset = __pos + 1;
+      v.length = cr - (p + 1);
+      v.integer = 0;
+      v.span = 1;
+      switch (v.type) {
+      case RESPType::simple_string:
+      case RESPType::error:
+         break;
+      case RESPType::integer:
+      case RESPType::bulk_string:
+      case RESPType::array:
+         if (!parse_integer(p + 1, cr, v.integer))
+            return Expected<bool>::unexpected(std::runtime_error(
+               "RESPParser::parse: malformed integer"
+            ));
+         break;
+      default:
+         return Expected<bool>::unexpected(std::runtime_error(
+            std::string("RESPParser::parse: unexpected type \"") + static_cast<char>(*p) + "\""
+         ));
+      }
+
+      if (v.type == RESPType::bulk_string || v.type == RESPType::array) {
+         if (v.integer == -1) {
+            v.null = true;
+            v.length = 0;
+         } else if (v.integer < 0 || v.integer > kMaxBulkLength) {
+            return Expected<bool>::unexpected(std::runtime_error(
+               "RESPParser::parse: invalid length"
+            ));
+         } else {
+            v.length = v.integer;
+         }
+      }
+      if (v.type == RESPType::bulk_string && !v.null) {
+         if (next + v.length + 2 > n)
+            return false;
+         if (b[next + v.length] != '\r' || b[next + v.length + 1] != '\n')
+            return Expected<bool>::unexpected(std::runtime_error(
+               "RESPParser::parse: bulk string is not terminated by CRLF"
+            ));
+         v.offset = next;
+         next += v.length + 2;
+      }
+
+      __pos = next;
+      __values.push_back(v);
+      if (v.type == RESPType::array && v.length > 0) {
+         __open.push_back(__values.size() - 1);
+         __remaining.push_back(v.length);
+         continue;
+      }
+
+      // A value was completed; which might complete the arrays containing it.
+      while (!__remaining.empty()) {
+         if (--__remaining.back() > 0)
+            break;
+         __values[__open.back()].span = __values.size() - __open.back();
+         __open.pop_back();
+         __remaining.pop_back();
+      }
+      if (__remaining.empty()) {
+         __complete = true;
+         return true;
+      }
+   }
+   return false;
+}
+
+const std::vector<RESPValue>& RESPParser::values() const
+{
+   return __values;
+}
+
+size_t RESPParser::position() const
+{
+   return __complete ? __pos : __start;
+}
+
+void RESPParser::discard(size_t n)
+{
+   if (n > position())
+      throw std::invalid_argument("RESPParser::discard: discarding unparsed data");
+   if (__complete) {
+      __values.clear();
+      __complete = false;
+      __start = __pos;
+   }
+   __start -= n;
+   __pos -= n;
+   for (auto& v : __values)
+      v.offset -= n;
+}
+
+RESPReply::RESPReply(const uint8_t* b, const RESPValue* v)
+   : __b(b)
+   , __v(v)
+{}
+
+RESPType RESPReply::type() const
+{
+   return __v->type;
+}
+
+bool RESPReply::null() const
+{
+   return __v->null;
+}
+
+bool RESPReply::error() const
+{
+   return __v->type == RESPType::error;
+}
+
+int64_t RESPReply::integer() const
+{
+   return __v->integer;
+}
+
+const char* RESPReply::data() const
+{
+   return reinterpret_cast<const char*>(__b + __v->offset);
+}
+
+size_t RESPReply::size() const
+{
+   return __v->type == RESPType::array ? 0 : __v->length;
+}
+
+std::string RESPReply::str() const
+{
+   return std::string(data(), size());
+}
+
+size_t RESPReply::elements() const
+{
+   return __v->type == RESPType::array ? __v->length : 0;
+}
+
+RESPReply RESPReply::at(size_t i) const
+{
+   if (i >= elements())
+      throw std::out_of_range("RESPReply::at: index out of range");
+   const RESPValue* v = __v + 1;
+   for (; i > 0; i--)
+      v += v->span;
+   return RESPReply(__b, v);
+}
+
+void resp_command(std::vector<uint8_t>& b, const std::vector<std::string>& args)
+{
+   const std::string header = std::string("*") + std::to_string(args.size()) + "\r\n";
+   b.insert(b.end(), header.begin(), header.end());
+   for (const auto& arg : args) {
+      const std::string length = std::string("$") + std::to_string(arg.size()) + "\r\n";
+      b.insert(b.end(), length.begin(), length.end());
+      b.insert(b.end(), arg.begin(), arg.end());
+      b.push_back('\r');
+      b.push_back('\n');
+   }
+}
+
+RESPClient::RESPClient(const std::shared_ptr<Connection>& conn)
+   : __conn(conn)
+   , __pending(0)
+{}
+
+void RESPClient::append(const std::vector<std::string>& args)
+{
+   resp_command(__wbuf, args);
+   __pending++;
+}
+
+size_t RESPClient::pending() const
+{
+   return __pending;
+}
+
+Expected<size_t> RESPClient::flush(const RESPHandler& h, const std::chrono::milliseconds& t)
+{
+   // Commands only stop pending once their reply was handled, so that the
+   // replies still in flight when a flush fails go to the right handler on
+   // the next.
+   while (!__wbuf.empty()) {
+      auto written = __conn->write(__wbuf, t);
+      if (written.erred())
+         return written.exception();
+      __wbuf.erase(__wbuf.begin(), __wbuf.begin() + written.get());
+   }
+
+   size_t replied = 0;
+   while (__pending > 0) {
+      auto parsed = __parser.parse(__rbuf.data(), __rbuf.size());
+      if (parsed.erred())
+         return parsed.exception();
+      if (parsed.get()) {
+         __pending--;
+         h(RESPReply(__rbuf.data(), &__parser.values()[0]));
+         replied++;
+         continue;
+      }
+
+      // Drop what was handled already before asking for more.
+      size_t handled = __parser.position();
+      __parser.discard(handled);
+      __rbuf.erase(__rbuf.begin(), __rbuf.begin() + handled);
+
+      __chunk.resize(kDefaultChunkSize);
+      auto read = __conn->read(__chunk, t);
+      if (read.erred())
+         return read.exception();
+      if (read.get() == 0)
+         return Expected<size_t>::unexpected(std::runtime_error(
+            "RESPClient::flush: connection closed whilst awaiting replies"
+         ));
+      if (__rbuf.empty()) {
+         __rbuf.swap(__chunk);
+         __rbuf.resize(read.get());
+      } else {
+         __rbuf.insert(__rbuf.end(), __chunk.begin(), __chunk.begin() + read.get());
+      }
+   }
+
+   size_t handled = __parser.position();
+   __parser.discard(handled);
+   __rbuf.erase(__rbuf.begin(), __rbuf.begin() + handled);
+   return replied;
+}
+
+Expected<size_t> RESPClient::flush(const RESPHandler& h)
+{
+   return flush(h, std::chrono::milliseconds(-1));
+}
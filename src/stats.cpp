@@ -0,0 +1,155 @@
+#include <instrument.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+bool io_stats_enabled()
+{
+#ifdef CPPSOCKET_STATS
+   return true;
+#else
+   return false;
+#endif
+}
+
+#ifdef CPPSOCKET_STATS
+
+const unsigned IOStats::kLatencySampling;
+
+ShardHistogram::ShardHistogram()
+{
+   for (auto& c : __counts)
+      c.store(0, std::memory_order_relaxed);
+   __sum.store(0, std::memory_order_relaxed);
+   __max.store(0, std::memory_order_relaxed);
+}
+
+void ShardHistogram::merge_into(Histogram& h) const
+{
+   // The count is that of the buckets seen, so that percentiles add up.
+   uint64_t count = 0;
+   for (int i = 0; i < Histogram::kBuckets; i++) {
+      uint64_t n = __counts[i].load(std::memory_order_relaxed);
+      h.__counts[i] += n;
+      count += n;
+   }
+   h.__count += count;
+   h.__sum += __sum.load(std::memory_order_relaxed);
+   uint64_t max = __max.load(std::memory_order_relaxed);
+   if (max > h.__max)
+      h.__max = max;
+}
+
+static void accumulate(IOStats& s, const StatsShard& shard)
+{
+   uint64_t* counters[kCounters] = {
+      &s.counters.bytes_in, &s.counters.bytes_out, &s.counters.reads, &s.counters.writes,
+      &s.counters.accepts, &s.counters.dials, &s.counters.syscalls, &s.counters.polls,
+      &s.counters.timeouts, &s.counters.eagains, &s.counters.errors,
+   };
+   for (int i = 0; i < kCounters; i++)
+      *counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+}
+
+/**
+ * Registry keeps track of the shards of live threads, and holds on to what
+ * the exited ones recorded.
+ */
+struct Registry
+{
+   std::mutex lock;
+   std::vector<StatsShard*> shards;
+   IOStats retired;
+
+   Registry()
+   {
+      retired.counters = IOCounters();
+   }
+};
+
+static Registry& registry()
+{
+   // Leaked on purpose, threads might exit after static destruction.
+   static Registry* r = new Registry();
+   return *r;
+}
+
+thread_local StatsShard stats_shard;
+
+StatsShard::StatsShard()
+{
+   for (auto& s : sampled)
+      s = 0;
+   for (auto& c : counters)
+      c.store(0, std::memory_order_relaxed);
+   Registry& r = registry();
+   std::lock_guard<std::mutex> guard(r.lock);
+   r.shards.push_back(this);
+}
+
+StatsShard::~StatsShard()
+{
+   Registry& r = registry();
+   std::lock_guard<std::mutex> guard(r.lock);
+   accumulate(r.retired, *this);
+   Histogram* retired[kLatencies] = {
+      &r.retired.read_latency, &r.retired.write_latency,
+      &r.retired.accept_latency, &r.retired.dial_latency,
+   };
+   for (int i = 0; i < kLatencies; i++)
+      latencies[i].merge_into(*retired[i]);
+   r.shards.erase(std::remove(r.shards.begin(), r.shards.end(), this), r.shards.end());
+}
+
+IOCounters IOStatsRecorder::counters() const
+{
+   return counters(IOStatsRecorder());
+}
+
+IOCounters IOStatsRecorder::counters(const IOStatsRecorder& other) const
+{
+   uint64_t sums[kCounters];
+   for (int i = 0; i < kCounters; i++)
+      sums[i] = __counters[i].load(std::memory_order_relaxed) + other.__counters[i].load(std::memory_order_relaxed);
+   IOCounters c;
+   c.bytes_in = sums[kBytesIn];
+   c.bytes_out = sums[kBytesOut];
+   c.reads = sums[kReads];
+   c.writes = sums[kWrites];
+   c.accepts = sums[kAccepts];
+   c.dials = sums[kDials];
+   c.syscalls = sums[kSyscalls];
+   c.polls = sums[kPolls];
+   c.timeouts = sums[kTimeouts];
+   c.eagains = sums[kEagains];
+   c.errors = sums[kErrors];
+   return c;
+}
+
+IOStats io_stats()
+{
+   Registry& r = registry();
+   std::lock_guard<std::mutex> guard(r.lock);
+   IOStats s = r.retired;
+   Histogram* latencies[kLatencies] = {
+      &s.read_latency, &s.write_latency, &s.accept_latency, &s.dial_latency,
+   };
+   for (StatsShard* shard : r.shards) {
+      accumulate(s, *shard);
+      for (int i = 0; i < kLatencies; i++)
+         shard->latencies[i].merge_into(*latencies[i]);
+   }
+   return s;
+}
+
+#else
+
+IOStats io_stats()
+{
+   IOStats s;
+   s.counters = IOCounters();
+   return s;
+}
+
+#endif
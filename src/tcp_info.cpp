@@ -0,0 +1,69 @@
+#include <tcp_info.hpp>
+
+TCPInfoCollector::TCPInfoCollector(size_t per_collect)
+   : __per_collect(per_collect)
+   , __next(0)
+{}
+
+void TCPInfoCollector::track(const std::shared_ptr<TCPConnection>& conn)
+{
+   std::lock_guard<std::mutex> lock(__lock);
+   __conns.push_back(conn);
+}
+
+size_t TCPInfoCollector::tracked()
+{
+   std::lock_guard<std::mutex> lock(__lock);
+   return __conns.size();
+}
+
+std::vector<TCPInfoSample> TCPInfoCollector::collect()
+{
+   std::vector<std::shared_ptr<TCPConnection>> sampling;
+   {
+      std::lock_guard<std::mutex> lock(__lock);
+      for (size_t visited = 0; visited < __conns.size() && sampling.size() < __per_collect;) {
+         if (__next >= __conns.size())
+            __next = 0;
+         auto conn = __conns[__next].lock();
+         if (!conn) {
+            // Swap in the last one, which is yet to be visited unless it is
+            // the one at hand.
+            __conns[__next] = __conns.back();
+            __conns.pop_back();
+            continue;
+         }
+         sampling.push_back(conn);
+         __next++;
+         visited++;
+      }
+   }
+
+   // The connections are sampled without holding the lock, so tracking new
+   // ones doesn't have to wait on a syscall per connection.
+   std::vector<TCPInfoSample> samples;
+   samples.reserve(sampling.size());
+   for (const auto& conn : sampling) {
+      auto info = conn->info();
+      if (info.erred())
+         continue;
+      samples.push_back(TCPInfoSample{conn->remote_addr(), info.get()});
+   }
+   return samples;
+}
+
+TCPInfoSummary TCPInfoCollector::summarize(const std::vector<TCPInfoSample>& samples)
+{
+   TCPInfoSummary summary;
+   summary.sampled = samples.size();
+   summary.retransmits = 0;
+   summary.lost = 0;
+   summary.bytes_retransmitted = 0;
+   for (const auto& sample : samples) {
+      summary.rtt.record(sample.info.rtt.count());
+      summary.retransmits += sample.info.total_retransmits;
+      summary.lost += sample.info.lost;
+      summary.bytes_retransmitted += sample.info.bytes_retransmitted;
+   }
+   return summary;
+}
@@ -0,0 +1,483 @@
+#include <timer_wheel.hpp>
+
+namespace sys {
+
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const size_t TimerWheel::kLevels;
+const size_t TimerWheel::kSlots;
+
+/**
+ * TimerWheelImpl keeps its timers in a slab of nodes, linked into a list per
+ * slot, so that neither scheduling nor cancelling allocates once the slab
+ * grew large enough. A timer's handle carries the generation of its node, to
+ * tell it apart from later timers reusing the node.
+ *
+ * Ticks are counted from the wheel's creation. A timer of tick `t` resides in
+ * the lowest level `l` at which `t` and the current tick share all digits
+ * above `l`, in the slot of its digit at `l`; once the current tick reaches
+ * that slot, its timers are cascaded into the levels below.
+ */
+struct TimerWheelImpl
+   : TimerWheel
+{
+   static const uint32_t kNil = ~uint32_t(0);
+   static const uint32_t kFree = ~uint32_t(0);
+   static const int kBits = 8;
+   static const int64_t kMask = kSlots - 1;
+   static const size_t kWords = kSlots / 64;
+
+   /**
+    * kMaxWait bounds how far ahead the timer file descriptor is armed, to
+    * keep the arithmetic clear of overflows. Waking up before anything came
+    * due merely rearms it.
+    */
+   const std::chrono::hours kMaxWait = std::chrono::hours(24);
+
+   struct Node
+   {
+      int64_t tick;
+      uint64_t data;
+      uint32_t prev;
+      uint32_t next;
+      uint32_t generation;
+      uint32_t slot;
+   };
+
+   TimerWheelImpl(const std::chrono::milliseconds& tick)
+      : __tick(tick)
+      , __epoch(std::chrono::steady_clock::now())
+      , __now(0)
+      , __armed(-1)
+      , __fires(-1)
+      , __size(0)
+      , __free(kNil)
+      , __heads(kLevels * kSlots, kNil)
+   {
+      if (tick.count() <= 0)
+         throw std::invalid_argument("TimerWheel::TimerWheel: the tick has to last at least a millisecond");
+      std::memset(__occupied, 0, sizeof(__occupied));
+      __fd = sys::timerfd_create(CLOCK_MONOTONIC, sys::TFD_NONBLOCK | sys::TFD_CLOEXEC);
+      if (__fd == -1)
+         throw std::runtime_error(
+            std::string("TimerWheel::TimerWheel: unable to create timer - ") +
+            std::strerror(errno)
+         );
+   }
+
+   ~TimerWheelImpl()
+   {
+      sys::close(__fd);
+   }
+
+   Timer schedule(const std::chrono::steady_clock::time_point& deadline, uint64_t data)
+   {
+      int64_t tick = ticks_until(deadline);
+      if (tick <= __now)
+         tick = __now + 1;
+      int64_t reach = ((__now >> (kBits * kLevels)) + 1) << (kBits * kLevels);
+      if (tick >= reach)
+         tick = reach - 1;
+
+      uint32_t index = __free;
+      if (index == kNil) {
+         index = static_cast<uint32_t>(__nodes.size());
+         Node n;
+         n.generation = 1;
+         __nodes.push_back(n);
+      } else {
+         __free = __nodes[index].next;
+      }
+      Node& n = __nodes[index];
+      n.tick = tick;
+      n.data = data;
+      link(index);
+      __size++;
+
+      rearm();
+      return (static_cast<uint64_t>(n.generation) << 32) | index;
+   }
+
+   bool cancel(Timer timer)
+   {
+      uint32_t index = static_cast<uint32_t>(timer);
+      if (index >= __nodes.size())
+         return false;
+      Node& n = __nodes[index];
+      if (n.slot == kFree || n.generation != static_cast<uint32_t>(timer >> 32))
+         return false;
+      unlink(index);
+      release(index);
+      return true;
+   }
+
+   size_t expire(const std::chrono::steady_clock::time_point& now, const TimerHandler& due)
+   {
+      int64_t target = ticks_since(now);
+      size_t expired = 0;
+      while (__now < target) {
+         int64_t next = next_tick();
+         if (next == -1 || next > target) {
+            __now = target;
+            break;
+         }
+         __now = next;
+         if ((__now & kMask) == 0)
+            cascade();
+         uint32_t slot = static_cast<uint32_t>(__now & kMask);
+         while (__heads[slot] != kNil) {
+            uint32_t index = __heads[slot];
+            uint64_t data = __nodes[index].data;
+            unlink(index);
+            release(index);
+            expired++;
+            due(data);
+         }
+      }
+      rearm();
+      return expired;
+   }
+
+   size_t size() const noexcept
+   {
+      return __size;
+   }
+
+   int fd() const noexcept
+   {
+      return __fd;
+   }
+
+private:
+   /**
+    * ticks_until returns the tick by which `t` passed, and ticks_since the
+    * last tick which passed by `t`.
+    */
+   int64_t ticks_until(const std::chrono::steady_clock::time_point& t) const
+   {
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t - __epoch).count();
+      auto tick = std::chrono::duration_cast<std::chrono::nanoseconds>(__tick).count();
+      if (elapsed <= 0)
+         return 0;
+      return elapsed / tick + (elapsed % tick != 0);
+   }
+
+   int64_t ticks_since(const std::chrono::steady_clock::time_point& t) const
+   {
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t - __epoch).count();
+      auto tick = std::chrono::duration_cast<std::chrono::nanoseconds>(__tick).count();
+      if (elapsed <= 0)
+         return 0;
+      return elapsed / tick;
+   }
+
+   /**
+    * link places node `index` into the slot its tick belongs to.
+    */
+   void link(uint32_t index)
+   {
+      Node& n = __nodes[index];
+      size_t level = 0;
+      while (level < kLevels - 1 && (n.tick >> (kBits * (level + 1))) != (__now >> (kBits * (level + 1))))
+         level++;
+      size_t digit = (n.tick >> (kBits * level)) & kMask;
+      uint32_t slot = static_cast<uint32_t>(level * kSlots + digit);
+
+      n.slot = slot;
+      n.prev = kNil;
+      n.next = __heads[slot];
+      if (n.next != kNil)
+         __nodes[n.next].prev = index;
+      __heads[slot] = index;
+      __occupied[level][digit / 64] |= uint64_t(1) << (digit % 64);
+   }
+
+   void unlink(uint32_t index)
+   {
+      Node& n = __nodes[index];
+      if (n.prev != kNil)
+         __nodes[n.prev].next = n.next;
+      else
+         __heads[n.slot] = n.next;
+      if (n.next != kNil)
+         __nodes[n.next].prev = n.prev;
+      if (__heads[n.slot] == kNil) {
+         size_t level = n.slot / kSlots;
+         size_t digit = n.slot % kSlots;
+         __occupied[level][digit / 64] &= ~(uint64_t(1) << (digit % 64));
+      }
+   }
+
+   /**
+    * release returns node `index` to the free list, invalidating the handle
+    * of the timer which held it.
+    */
+   void release(uint32_t index)
+   {
+      Node& n = __nodes[index];
+      n.slot = kFree;
+      n.generation++;
+      n.next = __free;
+      __free = index;
+      __size--;
+   }
+
+   /**
+    * cascade moves the timers of the slots the current tick just reached,
+    * in the levels above the first, into the levels below them.
+    */
+   void cascade()
+   {
+      for (size_t level = 1; level < kLevels; level++) {
+         size_t digit = (__now >> (kBits * level)) & kMask;
+         uint32_t slot = static_cast<uint32_t>(level * kSlots + digit);
+         uint32_t index = __heads[slot];
+         __heads[slot] = kNil;
+         __occupied[level][digit / 64] &= ~(uint64_t(1) << (digit % 64));
+         while (index != kNil) {
+            uint32_t next = __nodes[index].next;
+            link(index);
+            index = next;
+         }
+         if (digit != 0)
+            break;
+      }
+   }
+
+   /**
+    * next_tick returns the next tick at which there's something to do, be it
+    * expiring timers or cascading them, or -1 when there are no timers. As
+    * every timer's digit lies ahead of the current one at its level, the
+    * first level with an occupied slot ahead holds the nearest one.
+    */
+   int64_t next_tick() const
+   {
+      if (__size == 0)
+         return -1;
+      for (size_t level = 0; level < kLevels; level++) {
+         int digit = first_occupied(level, (__now >> (kBits * level)) & kMask);
+         if (digit == -1)
+            continue;
+         int64_t above = (__now >> (kBits * (level + 1))) << (kBits * (level + 1));
+         return above | (static_cast<int64_t>(digit) << (kBits * level));
+      }
+      return -1;
+   }
+
+   /**
+    * first_occupied returns the first occupied slot of `level` beyond
+    * `digit`, or -1 if there's none.
+    */
+   int first_occupied(size_t level, int64_t digit) const
+   {
+      size_t i = digit + 1;
+      while (i < kSlots) {
+         uint64_t word = __occupied[level][i / 64] >> (i % 64);
+         if (word != 0)
+            return static_cast<int>(i + __builtin_ctzll(word));
+         i = (i / 64 + 1) * 64;
+      }
+      return -1;
+   }
+
+   /**
+    * rearm arms the timer file descriptor anew when the next tick changed,
+    * or when the tick it fires at passed, as it does when it was armed short
+    * of the next tick for kMaxWait.
+    */
+   void rearm()
+   {
+      int64_t next = next_tick();
+      if (next != __armed || (__fires != -1 && __fires <= __now))
+         arm(next);
+   }
+
+   /**
+    * arm sets the timer file descriptor to fire at `tick`, or disarms it for
+    * -1. Setting it clears an expiration which wasn't read.
+    */
+   void arm(int64_t tick)
+   {
+      __armed = tick;
+      __fires = tick;
+      struct itimerspec spec;
+      std::memset(&spec, 0, sizeof(spec));
+      int flags = 0;
+      if (tick != -1) {
+         int64_t wait = std::max<int64_t>(1, kMaxWait / __tick);
+         __fires = std::min(tick, __now + wait);
+         auto at = __epoch + __tick * __fires;
+         auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(at.time_since_epoch()).count();
+         spec.it_value.tv_sec = ns / 1000000000;
+         spec.it_value.tv_nsec = ns % 1000000000;
+         flags = sys::TFD_TIMER_ABSTIME;
+      }
+      sys::timerfd_settime(__fd, flags, &spec, NULL);
+   }
+
+private:
+   std::chrono::milliseconds __tick;
+   std::chrono::steady_clock::time_point __epoch;
+   int64_t __now;
+   int64_t __armed;
+   int64_t __fires;
+   size_t __size;
+   uint32_t __free;
+   int __fd;
+   std::vector<Node> __nodes;
+   std::vector<uint32_t> __heads;
+   uint64_t __occupied[kLevels][kWords];
+};
+
+const uint32_t TimerWheelImpl::kNil;
+const uint32_t TimerWheelImpl::kFree;
+
+std::unique_ptr<TimerWheel> timer_wheel(const std::chrono::milliseconds& tick)
+{
+   return std::unique_ptr<TimerWheel>(new TimerWheelImpl(tick));
+}
+
+/**
+ * KeepaliveImpl keeps a single timer per connection, for whichever of its
+ * idle deadline and next heartbeat comes first. Activity doesn't touch the
+ * timer; once it comes due the deadlines are worked out from the recorded
+ * activity, and the timer is scheduled again if neither passed yet.
+ */
+struct KeepaliveImpl
+   : Keepalive
+{
+   struct Entry
+   {
+      std::chrono::steady_clock::time_point active;
+      std::chrono::steady_clock::time_point beat;
+      TimerWheel::Timer timer;
+   };
+
+   KeepaliveImpl(
+      const std::chrono::milliseconds& idle_timeout,
+      const std::chrono::milliseconds& heartbeat,
+      const TimerHandler& on_idle,
+      const TimerHandler& on_heartbeat
+   )
+      : __idle_timeout(idle_timeout)
+      , __heartbeat(heartbeat)
+      , __on_idle(on_idle)
+      , __on_heartbeat(on_heartbeat)
+      , __wheel(timer_wheel(tick(idle_timeout, heartbeat)))
+   {}
+
+   void watch(uint64_t id)
+   {
+      auto now = std::chrono::steady_clock::now();
+      auto found = __entries.find(id);
+      if (found != __entries.end())
+         __wheel->cancel(found->second.timer);
+      Entry& e = __entries[id];
+      e.active = now;
+      e.beat = now;
+      e.timer = schedule(id, e);
+   }
+
+   void touch(uint64_t id)
+   {
+      auto found = __entries.find(id);
+      if (found != __entries.end())
+         found->second.active = std::chrono::steady_clock::now();
+   }
+
+   void forget(uint64_t id)
+   {
+      auto found = __entries.find(id);
+      if (found == __entries.end())
+         return;
+      __wheel->cancel(found->second.timer);
+      __entries.erase(found);
+   }
+
+   size_t expire(const std::chrono::steady_clock::time_point& now)
+   {
+      size_t called = 0;
+      __wheel->expire(now, [this, &now, &called](uint64_t id){
+         auto found = __entries.find(id);
+         if (found == __entries.end())
+            return;
+         Entry& e = found->second;
+         if (__idle_timeout.count() >= 0 && now - e.active >= __idle_timeout) {
+            __entries.erase(found);
+            called++;
+            __on_idle(id);
+            return;
+         }
+         bool beat = __heartbeat.count() >= 0 && now - std::max(e.active, e.beat) >= __heartbeat;
+         if (beat)
+            e.beat = now;
+         e.timer = schedule(id, e);
+         if (beat) {
+            called++;
+            __on_heartbeat(id);
+         }
+      });
+      return called;
+   }
+
+   size_t size() const noexcept
+   {
+      return __entries.size();
+   }
+
+   int fd() const noexcept
+   {
+      return __wheel->fd();
+   }
+
+private:
+   static std::chrono::milliseconds tick(const std::chrono::milliseconds& a, const std::chrono::milliseconds& b)
+   {
+      std::chrono::milliseconds shortest = a.count() < 0 ? b : b.count() < 0 ? a : std::min(a, b);
+      return std::max(std::chrono::milliseconds(1), shortest / 16);
+   }
+
+   /**
+    * schedule sets the timer of connection `id` for whichever of its
+    * deadlines comes first.
+    */
+   TimerWheel::Timer schedule(uint64_t id, const Entry& e)
+   {
+      auto deadline = std::chrono::steady_clock::time_point::max();
+      if (__idle_timeout.count() >= 0)
+         deadline = e.active + __idle_timeout;
+      if (__heartbeat.count() >= 0)
+         deadline = std::min(deadline, std::max(e.active, e.beat) + __heartbeat);
+      return __wheel->schedule(deadline, id);
+   }
+
+private:
+   std::chrono::milliseconds __idle_timeout;
+   std::chrono::milliseconds __heartbeat;
+   TimerHandler __on_idle;
+   TimerHandler __on_heartbeat;
+   std::unique_ptr<TimerWheel> __wheel;
+   std::unordered_map<uint64_t, Entry> __entries;
+};
+
+std::unique_ptr<Keepalive> keepalive(
+   const std::chrono::milliseconds& idle_timeout,
+   const std::chrono::milliseconds& heartbeat,
+   const TimerHandler& on_idle,
+   const TimerHandler& on_heartbeat
+)
+{
+   return std::unique_ptr<Keepalive>(new KeepaliveImpl(idle_timeout, heartbeat, on_idle, on_heartbeat));
+}
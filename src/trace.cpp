@@ -0,0 +1,10 @@
+#include <trace.hpp>
+
+#ifdef CPPSOCKET_USDT
+
+#define CPPSOCKET_PROBE_DEFINE(name) \
+   volatile unsigned short CPPSOCKET_PROBE_SEMAPHORE(name) __attribute__((section(".probes"))) = 0;
+
+CPPSOCKET_PROBES(CPPSOCKET_PROBE_DEFINE)
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef _CPPSOCKET_TRACE
+#define _CPPSOCKET_TRACE
+
+/**
+ * CPPSOCKET_PROBES lists the statically defined tracepoints of the library,
+ * all of which are part of the `cppsocket` provider. The README documents
+ * their arguments.
+ */
+#define CPPSOCKET_PROBES(X) \
+   X(tcp_read_start) X(tcp_read_done) \
+   X(tcp_write_start) X(tcp_write_done) \
+   X(tcp_accept_start) X(tcp_accept_done) \
+   X(udp_read_start) X(udp_read_done) \
+   X(udp_send_start) X(udp_send_done) \
+   X(resolve_start) X(resolve_done)
+
+#ifdef CPPSOCKET_USDT
+
+// Have every probe site check a semaphore, which the kernel increments
+// whenever a tracer attaches to the probe, so that the arguments aren't
+// even computed when nobody is tracing.
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define CPPSOCKET_PROBE_SEMAPHORE(name) cppsocket_##name##_semaphore
+#define CPPSOCKET_PROBE_DECLARE(name) extern volatile unsigned short CPPSOCKET_PROBE_SEMAPHORE(name);
+
+CPPSOCKET_PROBES(CPPSOCKET_PROBE_DECLARE)
+
+#define CPPSOCKET_PROBE(name, ...) \
+   do { \
+      if (__builtin_expect(CPPSOCKET_PROBE_SEMAPHORE(name) != 0, 0)) \
+         STAP_PROBEV(cppsocket, name, __VA_ARGS__); \
+   } while (0)
+
+#else
+
+#define CPPSOCKET_PROBE(name, ...) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,152 @@
+#include <tuning.hpp>
+
+namespace sys {
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+}
+
+// Missing from the headers of kernels before 5.11.
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+SocketTuning::SocketTuning()
+   : send_buffer(0)
+   , receive_buffer(0)
+   , no_delay(false)
+   , quick_ack(false)
+   , keepalive_idle(0)
+   , keepalive_interval(0)
+   , keepalive_count(0)
+   , user_timeout(0)
+   , busy_poll(0)
+   , prefer_busy_poll(false)
+   , spin(0)
+   , priority(-1)
+{}
+
+Expected<SocketTuning> tuning_profile(const std::string& name)
+{
+   SocketTuning t;
+   if (name == "default")
+      return t;
+   if (name == "low-latency") {
+      t.no_delay = true;
+      t.quick_ack = true;
+      t.priority = 6;
+      return t;
+   }
+   if (name == "bulk") {
+      t.send_buffer = 4 << 20;
+      t.receive_buffer = 4 << 20;
+      return t;
+   }
+   if (name == "mobile") {
+      t.no_delay = true;
+      t.keepalive_idle = std::chrono::seconds(30);
+      t.keepalive_interval = std::chrono::seconds(10);
+      t.keepalive_count = 3;
+      t.user_timeout = std::chrono::seconds(30);
+      return t;
+   }
+   return Expected<SocketTuning>::unexpected(std::invalid_argument(
+      std::string("tuning_profile: unknown profile \"") + name + "\""
+   ));
+}
+
+/**
+ * Options sets socket options one after the other, skipping the rest once
+ * one of them couldn't be set.
+ */
+struct Options
+{
+   Options(int socket)
+      : syscalls(0)
+      , failed(NULL)
+      , error(0)
+      , __socket(socket)
+   {}
+
+   void set(int level, int option, const char* name, const void* value, size_t length)
+   {
+      if (failed != NULL)
+         return;
+      syscalls++;
+      if (sys::setsockopt(__socket, level, option, value, length) == -1) {
+         failed = name;
+         error = errno;
+      }
+   }
+
+   void set(int level, int option, const char* name, int value)
+   {
+      set(level, option, name, &value, sizeof(value));
+   }
+
+   Expected<bool> result(const char* who, size_t& made) const
+   {
+      made += syscalls;
+      if (failed != NULL)
+         return Expected<bool>::unexpected(std::runtime_error(
+            std::string(who) + ": unable to set " + failed + " - " + std::strerror(error)
+         ));
+      return true;
+   }
+
+   size_t syscalls;
+   const char* failed;
+   int error;
+
+private:
+   int __socket;
+};
+
+Expected<bool> tune(int socket, const SocketTuning& t, const char* who, size_t& syscalls)
+{
+   Options o(socket);
+   if (t.send_buffer > 0)
+      o.set(SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF", t.send_buffer);
+   if (t.receive_buffer > 0)
+      o.set(SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF", t.receive_buffer);
+   if (t.no_delay)
+      o.set(SOL_TCP, TCP_NODELAY, "TCP_NODELAY", 1);
+   if (t.quick_ack)
+      o.set(SOL_TCP, TCP_QUICKACK, "TCP_QUICKACK", 1);
+   if (t.keepalive_idle.count() > 0) {
+      o.set(SOL_SOCKET, SO_KEEPALIVE, "SO_KEEPALIVE", 1);
+      o.set(SOL_TCP, TCP_KEEPIDLE, "TCP_KEEPIDLE", t.keepalive_idle.count());
+      if (t.keepalive_interval.count() > 0)
+         o.set(SOL_TCP, TCP_KEEPINTVL, "TCP_KEEPINTVL", t.keepalive_interval.count());
+      if (t.keepalive_count > 0)
+         o.set(SOL_TCP, TCP_KEEPCNT, "TCP_KEEPCNT", t.keepalive_count);
+   }
+   if (t.user_timeout.count() > 0)
+      o.set(SOL_TCP, TCP_USER_TIMEOUT, "TCP_USER_TIMEOUT", t.user_timeout.count());
+   if (t.busy_poll.count() > 0)
+      o.set(SOL_SOCKET, SO_BUSY_POLL, "SO_BUSY_POLL", t.busy_poll.count());
+   if (t.prefer_busy_poll)
+      o.set(SOL_SOCKET, SO_PREFER_BUSY_POLL, "SO_PREFER_BUSY_POLL", 1);
+   if (!t.congestion.empty())
+      o.set(SOL_TCP, TCP_CONGESTION, "TCP_CONGESTION", t.congestion.data(), t.congestion.size());
+   if (t.priority >= 0)
+      o.set(SOL_SOCKET, SO_PRIORITY, "SO_PRIORITY", t.priority);
+   return o.result(who, syscalls);
+}
+
+Expected<bool> tune_accepted(int socket, const SocketTuning& t, const char* who, size_t& syscalls)
+{
+   Options o(socket);
+   if (t.quick_ack)
+      o.set(SOL_TCP, TCP_QUICKACK, "TCP_QUICKACK", 1);
+   if (t.priority >= 0)
+      o.set(SOL_SOCKET, SO_PRIORITY, "SO_PRIORITY", t.priority);
+   return o.result(who, syscalls);
+}
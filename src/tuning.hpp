@@ -0,0 +1,22 @@
+#ifndef _CPPSOCKET_TUNING
+#define _CPPSOCKET_TUNING
+
+#include <cppsocket.hpp>
+#include <expected.hpp>
+
+#include <string>
+
+/**
+ * tune sets the options of `tuning` on the freshly created `socket`, and adds
+ * the amount of syscalls it took to `syscalls`, whether or not it succeeded.
+ * Failures are reported as coming from `who`.
+ */
+Expected<bool> tune(int socket, const SocketTuning& tuning, const char* who, size_t& syscalls);
+
+/**
+ * tune_accepted sets the options of `tuning` which a socket accepted by a
+ * listener with that tuning didn't inherit from it.
+ */
+Expected<bool> tune_accepted(int socket, const SocketTuning& tuning, const char* who, size_t& syscalls);
+
+#endif
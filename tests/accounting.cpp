@@ -0,0 +1,91 @@
+#include <accounting.hpp>
+#include <cppsocket.hpp>
+#include <timer_wheel.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// The assertions are made after taking the accounting, as Catch allocates
+// whilst asserting.
+
+TEST_CASE("TCP operations are accounted for", "[accounting]") {
+   if (!accounting_enabled()) {
+      REQUIRE(accounting().syscalls == 0);
+      REQUIRE(accounting().allocations == 0);
+      return;
+   }
+
+   const std::string addr = "tcp://127.0.0.1:2901";
+   auto listener = listen_tcp(addr);
+   auto conn = dial_tcp(addr);
+   auto other = dial_tcp(addr);
+   auto first = listener->accept(std::chrono::seconds(1));
+   require_not_erred(first);
+
+   Accounting before = accounting();
+   auto accepted = listener->accept(std::chrono::seconds(1));
+   Accounting cost = accounting() - before;
+   require_not_erred(accepted);
+   // Awaiting it and accepting it; the connection's addresses are formatted
+   // from what accept returned.
+   REQUIRE(cost.syscalls == 2);
+   REQUIRE(cost.allocations <= 8);
+
+   // Connections are accepted in the order they were dialed.
+   auto peer = first.get();
+   const std::vector<uint8_t> data(64, 'x');
+   std::vector<uint8_t> buffer(data.size());
+   require_not_erred(conn->write(data));
+   require_not_erred(peer->read(buffer));
+
+   before = accounting();
+   auto written = conn->write(data);
+   auto read = peer->read(buffer);
+   cost = accounting() - before;
+   require_not_erred(written);
+   require_not_erred(read);
+   REQUIRE(cost.syscalls == 4);
+   REQUIRE(cost.allocations == 0);
+}
+
+TEST_CASE("UDP destinations are resolved once", "[accounting]") {
+   if (!accounting_enabled())
+      return;
+
+   auto sink = listen_udp("udp://127.0.0.1:2902");
+   auto conn = listen_udp("udp://127.0.0.1:2903");
+   const std::string to = "udp://127.0.0.1:2902";
+   const std::vector<uint8_t> data(64, 'x');
+   require_not_erred(conn->write(data, to));
+
+   const Accounting before = accounting();
+   auto written = conn->write(data, to);
+   const Accounting cost = accounting() - before;
+   require_not_erred(written);
+   REQUIRE(cost.syscalls == 2);
+   REQUIRE(cost.allocations == 0);
+}
+
+TEST_CASE("timer wheels are accounted for", "[accounting]") {
+   if (!accounting_enabled())
+      return;
+
+   Accounting before = accounting();
+   auto wheel = timer_wheel(std::chrono::milliseconds(1));
+   auto now = std::chrono::steady_clock::now();
+   wheel->schedule(now + std::chrono::seconds(1), 1);
+   Accounting cost = accounting() - before;
+   // Creating the timer and arming it.
+   REQUIRE(cost.syscalls == 2);
+
+   // A later deadline leaves the timer be.
+   before = accounting();
+   wheel->schedule(now + std::chrono::seconds(2), 2);
+   cost = accounting() - before;
+   REQUIRE(cost.syscalls == 0);
+}
@@ -0,0 +1,100 @@
+#include <cppsocket.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+extern char** environ;
+
+/**
+ * The child spawned below, running this one test case of the same
+ * executable, with the sockets it was passed.
+ */
+TEST_CASE("sockets passed through socket activation are adopted", "[.][activation-child]") {
+   REQUIRE(std::getenv("LISTEN_FDS") != nullptr);
+   // Matched by name, whatever the address.
+   auto web = listen_tcp_activated("tcp://127.0.0.1:0", "web");
+   REQUIRE(web->fd() == 3);
+   REQUIRE(std::getenv("LISTEN_FDS") == nullptr);
+   REQUIRE(std::getenv("LISTEN_PID") == nullptr);
+   REQUIRE((fcntl(3, F_GETFD) & FD_CLOEXEC) != 0);
+   // Matched by address.
+   auto dns = listen_udp_activated("udp://127.0.0.1:3451", "");
+   REQUIRE(dns->fd() == 4);
+   // Taken already, so bound anew.
+   auto fresh = listen_tcp_activated("tcp://127.0.0.1:3452", "web");
+   REQUIRE(fresh->fd() > 4);
+
+   auto accepted = web->accept(std::chrono::seconds(5));
+   require_not_erred(accepted);
+   require_not_erred(accepted.get()->write(std::vector<uint8_t>{'w', 'e', 'b'}));
+
+   std::string remote;
+   std::vector<uint8_t> b(16);
+   auto read = dns->read(b, remote, std::chrono::seconds(5));
+   require_not_erred(read);
+   require_not_erred(dns->write(std::vector<uint8_t>{'p', 'o', 'n', 'g'}, remote));
+}
+
+TEST_CASE("listeners are adopted from a supervisor through socket activation", "[activation]") {
+   auto web = listen_tcp("tcp://127.0.0.1:3450");
+   auto dns = listen_udp("udp://127.0.0.1:3451");
+
+   // What the child gets is set up before forking, as it may only make
+   // async-signal-safe calls until it executes.
+   std::vector<std::string> vars = {"LISTEN_FDS=2", "LISTEN_FDNAMES=web:dns"};
+   for (char** var = environ; *var != nullptr; var++)
+      vars.push_back(*var);
+   char pid[32];
+   std::vector<char*> env = {pid};
+   for (auto& var : vars)
+      env.push_back(&var[0]);
+   env.push_back(nullptr);
+   char exe[] = "/proc/self/exe";
+   char filter[] = "[activation-child]";
+   char* argv[] = {exe, filter, nullptr};
+
+   pid_t child = fork();
+   if (child == 0) {
+      int tcp = fcntl(web->fd(), F_DUPFD, 10);
+      int udp = fcntl(dns->fd(), F_DUPFD, 10);
+      dup2(tcp, 3);
+      dup2(udp, 4);
+      snprintf(pid, sizeof(pid), "LISTEN_PID=%d", int(getpid()));
+      execve(exe, argv, env.data());
+      _exit(127);
+   }
+   REQUIRE(child > 0);
+
+   std::vector<uint8_t> b(16);
+   auto conn = dial_tcp("tcp://127.0.0.1:3450");
+   auto read = conn->read(b, std::chrono::seconds(5));
+   require_not_erred(read);
+   REQUIRE(std::string(b.begin(), b.begin() + read.get()) == "web");
+
+   auto query = dial_udp("udp://127.0.0.1:3451");
+   require_not_erred(query->write(std::vector<uint8_t>{'p', 'i', 'n', 'g'}));
+   auto answer = query->read(b, std::chrono::seconds(5));
+   require_not_erred(answer);
+   REQUIRE(std::string(b.begin(), b.begin() + answer.get()) == "pong");
+
+   int status = 0;
+   REQUIRE(waitpid(child, &status, 0) == child);
+   REQUIRE(WIFEXITED(status));
+   REQUIRE(WEXITSTATUS(status) == 0);
+
+   // Without any sockets passed, they're bound anew.
+   auto fallback = listen_tcp_activated("tcp://127.0.0.1:3452", "web");
+   auto dialed = dial_tcp("tcp://127.0.0.1:3452");
+   require_not_erred(fallback->accept(std::chrono::seconds(1)));
+}
@@ -0,0 +1,178 @@
+#include <affinity.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <netinet/in.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+static int port(int socket)
+{
+   struct sockaddr_in sa;
+   socklen_t len = sizeof(sa);
+   getsockname(socket, reinterpret_cast<struct sockaddr*>(&sa), &len);
+   return ntohs(sa.sin_port);
+}
+
+TEST_CASE("threads are pinned to the given CPU", "[affinity]") {
+   auto allowed = cpus();
+   REQUIRE_FALSE(allowed.empty());
+   REQUIRE(std::is_sorted(allowed.begin(), allowed.end()));
+   REQUIRE(numa_node(allowed.back()) >= 0);
+   REQUIRE(numa_node(-1) == -1);
+   REQUIRE(numa_node(1 << 20) == -1);
+
+   int ran = -1;
+   std::thread worker([&](){
+      require_not_erred(pin_thread(allowed.back()));
+      ran = sched_getcpu();
+   });
+   worker.join();
+   REQUIRE(ran == allowed.back());
+
+   std::thread idle([](){ std::this_thread::sleep_for(std::chrono::milliseconds(10)); });
+   require_not_erred(pin_thread(idle, allowed.front()));
+   auto invalid = pin_thread(idle, -1);
+   idle.join();
+   REQUIRE(invalid.erred());
+   REQUIRE_THROWS_AS(invalid.get(), std::invalid_argument);
+}
+
+TEST_CASE("connections are routed to their CPU, else to its NUMA node", "[affinity]") {
+   // Workers on CPUs 0 and 1 of node 0, and 4 and 5 of node 1.
+   const std::vector<int> nodes = {0, 0, 0, 0, 1, 1, 1, 1};
+   CPURouter router({0, 1, 4, 5}, nodes);
+   REQUIRE(router.size() == 4);
+   REQUIRE(router.route(0) == 0);
+   REQUIRE(router.route(1) == 1);
+   REQUIRE(router.route(4) == 2);
+   REQUIRE(router.route(5) == 3);
+   REQUIRE(router.route(2) == 0);
+   REQUIRE(router.route(3) == 1);
+   REQUIRE(router.route(6) == 2);
+   REQUIRE(router.route(7) == 3);
+   REQUIRE(router.route(9) == 1);
+
+   std::vector<size_t> spread;
+   for (int i = 0; i < 4; i++)
+      spread.push_back(router.route(-1));
+   std::sort(spread.begin(), spread.end());
+   REQUIRE(spread == std::vector<size_t>({0, 1, 2, 3}));
+
+   REQUIRE_THROWS_AS(CPURouter(std::vector<int>()), std::invalid_argument);
+   REQUIRE_THROWS_AS(CPURouter({-1}), std::invalid_argument);
+}
+
+TEST_CASE("sharded listeners hand connections to the worker on their CPU", "[affinity]") {
+   auto allowed = cpus();
+   auto listeners = listen_tcp_sharded("tcp://127.0.0.1:0", 2, TCPListenOptions());
+   REQUIRE(listeners.size() == 2);
+   int bound = port(listeners[0]->fd());
+   REQUIRE(bound > 0);
+   REQUIRE(port(listeners[1]->fd()) == bound);
+
+   CPURouter router(allowed);
+   const std::string addr = "tcp://127.0.0.1:" + std::to_string(bound);
+   std::vector<std::shared_ptr<TCPSocket>> clients;
+   for (int i = 0; i < 8; i++)
+      clients.push_back(dial_tcp(addr));
+
+   size_t accepted = 0;
+   for (int round = 0; accepted < clients.size() && round < 100; round++)
+      for (auto& listener : listeners) {
+         auto conn = listener->accept_socket(std::chrono::milliseconds(10));
+         if (conn.erred())
+            continue;
+         accepted++;
+         auto cpu = conn.get()->incoming_cpu();
+         require_not_erred(cpu);
+         REQUIRE(std::count(allowed.begin(), allowed.end(), cpu.get()) == 1);
+         REQUIRE(allowed[router.route(*conn.get())] == cpu.get());
+      }
+   REQUIRE(accepted == clients.size());
+}
+
+/**
+ * accept_all accepts `n` connections from the `group` of listeners, and
+ * returns the remote ports of those accepted by each of them.
+ */
+static std::vector<std::vector<int>> accept_all(const std::vector<std::unique_ptr<TCPSocketListener>>& group, size_t n)
+{
+   std::vector<std::vector<int>> ports(group.size());
+   size_t accepted = 0;
+   for (int round = 0; accepted < n && round < 100; round++)
+      for (size_t i = 0; i < group.size(); i++) {
+         auto conn = group[i]->accept_socket(std::chrono::milliseconds(10));
+         if (conn.erred())
+            continue;
+         accepted++;
+         auto remote = conn.get()->remote_addr();
+         ports[i].push_back(std::stoi(remote.substr(remote.rfind(':') + 1)));
+      }
+   REQUIRE(accepted == n);
+   return ports;
+}
+
+static size_t steered(uint32_t key, uint32_t seed, size_t shards)
+{
+   return (uint32_t((key ^ seed) * 0x9E3779B1u) >> 16) % shards;
+}
+
+TEST_CASE("sharded listeners are steered by the remote port", "[affinity]") {
+   auto group = listen_tcp_sharded("tcp://127.0.0.1:0", 4, TCPListenOptions());
+   require_not_erred(steer_reuseport(group, Steering::remote_port, 7));
+   const std::string addr = "tcp://127.0.0.1:" + std::to_string(port(group[0]->fd()));
+   std::vector<std::shared_ptr<TCPSocket>> clients;
+   for (int i = 0; i < 64; i++)
+      clients.push_back(dial_tcp(addr));
+
+   auto ports = accept_all(group, clients.size());
+   for (size_t i = 0; i < ports.size(); i++) {
+      REQUIRE_FALSE(ports[i].empty());
+      for (int p : ports[i])
+         REQUIRE(steered(p, 7, group.size()) == i);
+   }
+}
+
+TEST_CASE("sharded listeners are steered by the remote address", "[affinity]") {
+   auto group = listen_tcp_sharded("tcp://127.0.0.1:0", 4, TCPListenOptions());
+   require_not_erred(steer_reuseport(group, Steering::remote_address));
+   const std::string addr = "tcp://127.0.0.1:" + std::to_string(port(group[0]->fd()));
+   std::vector<std::shared_ptr<TCPSocket>> clients;
+   for (int i = 0; i < 16; i++)
+      clients.push_back(dial_tcp(addr));
+
+   auto ports = accept_all(group, clients.size());
+   for (size_t i = 0; i < ports.size(); i++)
+      REQUIRE(ports[i].size() == (i == steered(0x7f000001, 0, group.size()) ? clients.size() : 0));
+}
+
+TEST_CASE("sharded listeners are steered by the CPU", "[affinity]") {
+   auto allowed = cpus();
+   auto group = listen_tcp_sharded("tcp://127.0.0.1:0", 2, TCPListenOptions());
+   require_not_erred(steer_reuseport(group, Steering::cpu));
+   const std::string addr = "tcp://127.0.0.1:" + std::to_string(port(group[0]->fd()));
+
+   // Loopback handles the SYN on the CPU which sent it.
+   std::vector<std::shared_ptr<TCPSocket>> clients;
+   std::thread dialing([&](){
+      require_not_erred(pin_thread(allowed.back()));
+      for (int i = 0; i < 16; i++)
+         clients.push_back(dial_tcp(addr));
+   });
+   dialing.join();
+
+   auto ports = accept_all(group, clients.size());
+   REQUIRE(ports[allowed.back() % group.size()].size() == clients.size());
+
+   std::vector<std::unique_ptr<TCPSocketListener>> none;
+   REQUIRE_THROWS_AS(steer_reuseport(none, Steering::cpu).get(), std::invalid_argument);
+}
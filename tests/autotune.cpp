@@ -0,0 +1,106 @@
+#include <autotune.hpp>
+#include <netsim.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+TEST_CASE("buffers are grown towards the bandwidth-delay product", "[autotune]") {
+   Impairment impairment;
+   impairment.latency = std::chrono::milliseconds(10);
+   impairment.bandwidth = 20000000;
+   auto net = simulate_network(impairment, 1);
+   auto listener = net->listen_tcp("tcp://10.0.0.1:80");
+   std::shared_ptr<TCPConnection> client = net->dial_tcp("tcp://10.0.0.1:80");
+   auto accepted = listener->accept(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   auto server = accepted.get();
+
+   BufferAutotuner tuner(64 << 20);
+   tuner.track(client);
+   REQUIRE(tuner.tune() == 1);
+   REQUIRE(tuner.committed() == 2 * BufferAutotuner::kMinBuffer);
+
+   std::atomic<bool> stopped(false);
+   std::thread writing([&](){
+      const std::vector<uint8_t> chunk(64 << 10, 'x');
+      while (!stopped)
+         client->write(chunk, std::chrono::milliseconds(50));
+   });
+   std::vector<uint8_t> b(1 << 20);
+   auto began = std::chrono::steady_clock::now();
+   auto tuned = began;
+   while (std::chrono::steady_clock::now() - began < std::chrono::milliseconds(800)) {
+      server->read(b, std::chrono::milliseconds(50));
+      if (std::chrono::steady_clock::now() - tuned >= std::chrono::milliseconds(50)) {
+         tuner.tune();
+         tuned = std::chrono::steady_clock::now();
+      }
+   }
+   stopped = true;
+   writing.join();
+
+   // The product is 400kB; twice that is granted to both buffers.
+   REQUIRE(tuner.committed() > 8 * BufferAutotuner::kMinBuffer);
+   REQUIRE(tuner.committed() <= 4 * 800000);
+
+   client.reset();
+   tuner.tune();
+   REQUIRE(tuner.tracked() == 0);
+   REQUIRE(tuner.committed() == 0);
+}
+
+TEST_CASE("buffers are kept within the budget", "[autotune]") {
+   auto net = simulate_network(Impairment(), 1);
+   auto listener = net->listen_tcp("tcp://10.0.0.1:80");
+   std::vector<std::shared_ptr<TCPConnection>> conns;
+   BufferAutotuner tuner(4 * BufferAutotuner::kMinBuffer);
+   for (int i = 0; i < 4; i++) {
+      conns.push_back(net->dial_tcp("tcp://10.0.0.1:80"));
+      tuner.track(conns.back());
+   }
+   REQUIRE(tuner.tracked() == 4);
+   REQUIRE(tuner.tune() == 4);
+   // None goes below the minimum, even when that exceeds the budget.
+   REQUIRE(tuner.committed() == 8 * BufferAutotuner::kMinBuffer);
+   REQUIRE(tuner.tune() == 0);
+}
+
+TEST_CASE("socket buffers are accounted as the kernel sized them", "[autotune]") {
+   const std::string addr = "tcp://127.0.0.1:3458";
+   auto listener = listen_tcp(addr);
+   std::shared_ptr<TCPConnection> conn = dial_tcp(addr);
+   BufferAutotuner tuner(1 << 30);
+   tuner.track(conn);
+   REQUIRE(tuner.tune() == 1);
+
+   int send = 0;
+   int receive = 0;
+   socklen_t length = sizeof(int);
+   REQUIRE(getsockopt(conn->fd(), SOL_SOCKET, SO_SNDBUF, &send, &length) == 0);
+   REQUIRE(getsockopt(conn->fd(), SOL_SOCKET, SO_RCVBUF, &receive, &length) == 0);
+   REQUIRE(tuner.committed() == size_t(send + receive));
+   REQUIRE(tuner.committed() == 4 * BufferAutotuner::kMinBuffer);
+}
+
+TEST_CASE("socket buffers are sized", "[autotune]") {
+   const std::string addr = "tcp://127.0.0.1:3446";
+   auto listener = listen_tcp(addr);
+   auto conn = dial_tcp(addr);
+   conn->buffer_sizes(100000, 100000);
+
+   // The kernel doubles the sizes for its bookkeeping.
+   int size = 0;
+   socklen_t length = sizeof(size);
+   REQUIRE(getsockopt(conn->fd(), SOL_SOCKET, SO_RCVBUF, &size, &length) == 0);
+   REQUIRE(size == 200000);
+   REQUIRE(getsockopt(conn->fd(), SOL_SOCKET, SO_SNDBUF, &size, &length) == 0);
+   REQUIRE(size == 200000);
+}
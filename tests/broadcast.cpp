@@ -0,0 +1,96 @@
+#include <broadcast.hpp>
+#include <cppsocket.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("a histogram reports percentiles within its precision", "[histogram]") {
+   Histogram h;
+   for (uint64_t v = 1; v <= 10000; v++)
+      h.record(v);
+   REQUIRE(h.count() == 10000);
+   REQUIRE(h.max() == 10000);
+   REQUIRE(h.percentile(50) >= 5000);
+   REQUIRE(h.percentile(50) <= 5000 + 5000 / 16);
+   REQUIRE(h.percentile(99) >= 9900);
+   REQUIRE(h.percentile(100) == 10000);
+
+   Histogram other;
+   other.record(Histogram::kMaxValue + 1);
+   h.merge(other);
+   REQUIRE(h.count() == 10001);
+   REQUIRE(h.max() == Histogram::kMaxValue);
+}
+
+TEST_CASE("a broadcaster writes published messages to all subscribers", "[broadcast_tcp]") {
+   const std::string addr = "tcp://127.0.0.1:2345";
+   auto listener = listen_tcp(addr);
+
+   SECTION("in order") {
+      auto broadcaster = broadcast_tcp(16, LagPolicy::disconnect);
+      std::vector<std::shared_ptr<TCPConnection>> clients;
+      for (int i = 0; i < 3; i++) {
+         clients.push_back(dial_tcp(addr));
+         auto accepted = listener->accept(std::chrono::seconds(1));
+         require_not_erred(accepted);
+         broadcaster->subscribe(accepted.get());
+      }
+      REQUIRE(broadcaster->subscribers() == 3);
+
+      std::string expected;
+      for (int i = 0; i < 100; i++) {
+         const std::string m = "message " + std::to_string(i) + "\n";
+         expected += m;
+         broadcaster->publish(make_message(std::vector<uint8_t>(m.begin(), m.end())));
+      }
+      for (auto& client : clients) {
+         std::string received;
+         std::vector<uint8_t> buffer(4096);
+         while (received.size() < expected.size()) {
+            auto read = client->read(buffer, std::chrono::seconds(1));
+            require_not_erred(read);
+            received.append(buffer.begin(), buffer.begin() + read.get());
+         }
+         REQUIRE(received == expected);
+      }
+
+      auto stats = broadcaster->stats();
+      REQUIRE(stats.published == 100);
+      REQUIRE(stats.delivered == 300);
+      REQUIRE(stats.latency.count() == 300);
+   }
+
+   SECTION("handling laggards by policy") {
+      const Message large = make_message(std::vector<uint8_t>(1024 * 1024, 'x'));
+
+      for (auto policy : {LagPolicy::disconnect, LagPolicy::drop_newest, LagPolicy::drop_oldest}) {
+         auto broadcaster = broadcast_tcp(2, policy);
+         std::thread serving([&](){ require_not_erred(broadcaster->serve()); });
+         auto laggard = dial_tcp(addr);
+         auto accepted = listener->accept(std::chrono::seconds(1));
+         require_not_erred(accepted);
+         broadcaster->subscribe(accepted.get());
+
+         // Nobody reads, so the socket buffers fill up and messages queue.
+         for (int i = 0; i < 32; i++)
+            broadcaster->publish(large);
+         auto stats = broadcaster->stats();
+         if (policy == LagPolicy::disconnect) {
+            REQUIRE(stats.disconnected == 1);
+            REQUIRE(broadcaster->subscribers() == 0);
+         } else {
+            REQUIRE(stats.dropped > 0);
+            REQUIRE(broadcaster->subscribers() == 1);
+         }
+
+         broadcaster->close();
+         serving.join();
+      }
+   }
+}
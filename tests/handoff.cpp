@@ -0,0 +1,241 @@
+#include <handoff.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("listeners and connections are handed over to a successor", "[handoff]") {
+   const std::string addr = "tcp://127.0.0.1:3449";
+   const std::string path = "@cppsocket-test-handoff";
+   auto listener = listen_tcp(addr);
+   auto client = dial_tcp(addr);
+   auto accepted = listener->accept_socket(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   auto conn = accepted.get();
+
+   // Dialed before the handover, but only accepted after it.
+   auto queued = dial_tcp(addr);
+
+   std::unique_ptr<Expected<Inheritance>> inherited;
+   std::thread successor([&](){
+      inherited.reset(new Expected<Inheritance>(take_over(path, std::chrono::seconds(2))));
+   });
+   auto handed = hand_over(path, {listener->fd()}, {conn->fd()}, std::chrono::seconds(2));
+   successor.join();
+   require_not_erred(handed);
+   REQUIRE(handed.get() == 2);
+   REQUIRE_NOTHROW(inherited->get());
+
+   // The predecessor drains, which leaves the sockets open in the successor.
+   auto local = conn->local_addr();
+   auto drained = drain(*listener, {}, std::chrono::steady_clock::now());
+   require_not_erred(drained);
+   REQUIRE(drained.get() == 0);
+   REQUIRE(listener->accept_socket(std::chrono::milliseconds(10)).erred());
+   listener.reset();
+   conn.reset();
+
+   auto& inheritance = inherited->get();
+   REQUIRE(inheritance.listeners.size() == 1);
+   REQUIRE(inheritance.connections.size() == 1);
+   auto& taken = inheritance.connections[0];
+   REQUIRE(taken->local_addr() == local);
+   REQUIRE(taken->remote_addr() == client->local_addr());
+
+   std::vector<uint8_t> b(16);
+   require_not_erred(client->write(std::vector<uint8_t>(3, 'a')));
+   auto read = taken->read(b, std::chrono::seconds(1));
+   require_not_erred(read);
+   REQUIRE(read.get() == 3);
+   require_not_erred(taken->write(std::vector<uint8_t>(5, 'b')));
+   auto answered = client->read(b, std::chrono::seconds(1));
+   require_not_erred(answered);
+   REQUIRE(answered.get() == 5);
+
+   auto& successor_listener = inheritance.listeners[0];
+   auto fresh = dial_tcp(addr);
+   for (auto& dialed : {queued, fresh}) {
+      auto taken_conn = successor_listener->accept_socket(std::chrono::seconds(1));
+      require_not_erred(taken_conn);
+      REQUIRE(taken_conn.get()->remote_addr() == dialed->local_addr());
+   }
+}
+
+TEST_CASE("handovers are made through named Unix sockets as well", "[handoff]") {
+   const std::string path = "/tmp/cppsocket-test-handoff." + std::to_string(getpid());
+   std::unique_ptr<Expected<Inheritance>> inherited;
+   std::thread successor([&](){
+      inherited.reset(new Expected<Inheritance>(take_over(path, std::chrono::seconds(2))));
+   });
+   auto handed = hand_over(path, {}, {}, std::chrono::seconds(2));
+   successor.join();
+   require_not_erred(handed);
+   REQUIRE(handed.get() == 0);
+   REQUIRE_NOTHROW(inherited->get());
+   REQUIRE(inherited->get().listeners.empty());
+   REQUIRE(access(path.c_str(), F_OK) == -1);
+}
+
+TEST_CASE("sockets are only handed over to the same user", "[handoff]") {
+   if (geteuid() != 0)
+      return;
+   const std::string path = "@cppsocket-test-impostor";
+   auto listener = listen_tcp("tcp://127.0.0.1:3461");
+
+   // The impostor connects first, as another user, and is to get nothing.
+   struct sockaddr_un sa;
+   std::memset(&sa, 0, sizeof(sa));
+   sa.sun_family = AF_UNIX;
+   std::memcpy(sa.sun_path + 1, path.data() + 1, path.size() - 1);
+   socklen_t len = offsetof(struct sockaddr_un, sun_path) + path.size();
+   pid_t impostor = fork();
+   if (impostor == 0) {
+      if (setuid(65534) == -1)
+         _exit(3);
+      for (int i = 0; i < 200; i++) {
+         int s = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+         if (connect(s, (struct sockaddr*)&sa, len) == 0) {
+            char b[16];
+            _exit(recv(s, b, sizeof(b), 0) == 0 ? 0 : 1);
+         }
+         close(s);
+         usleep(5000);
+      }
+      _exit(2);
+   }
+   REQUIRE(impostor > 0);
+
+   std::unique_ptr<Expected<Inheritance>> inherited;
+   std::thread successor([&](){
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      inherited.reset(new Expected<Inheritance>(take_over(path, std::chrono::seconds(2))));
+   });
+   auto handed = hand_over(path, {listener->fd()}, {}, std::chrono::seconds(2));
+   successor.join();
+   require_not_erred(handed);
+   REQUIRE(handed.get() == 1);
+   REQUIRE(inherited->get().listeners.size() == 1);
+   int flags = fcntl(inherited->get().listeners[0]->fd(), F_GETFD);
+   REQUIRE((flags & FD_CLOEXEC) != 0);
+
+   int status = 0;
+   REQUIRE(waitpid(impostor, &status, 0) == impostor);
+   REQUIRE(WIFEXITED(status));
+   REQUIRE(WEXITSTATUS(status) == 0);
+}
+
+TEST_CASE("sockets are only taken over from the same user", "[handoff]") {
+   if (geteuid() != 0)
+      return;
+   const std::string path = "@cppsocket-test-squatter";
+
+   // The squatter claims the name first, as another user.
+   struct sockaddr_un sa;
+   std::memset(&sa, 0, sizeof(sa));
+   sa.sun_family = AF_UNIX;
+   std::memcpy(sa.sun_path + 1, path.data() + 1, path.size() - 1);
+   socklen_t len = offsetof(struct sockaddr_un, sun_path) + path.size();
+   pid_t squatter = fork();
+   if (squatter == 0) {
+      alarm(5);
+      if (setuid(65534) == -1)
+         _exit(3);
+      int s = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+      if (bind(s, (struct sockaddr*)&sa, len) == -1 || listen(s, 1) == -1)
+         _exit(2);
+      int victim = accept(s, NULL, NULL);
+      char b[16];
+      _exit(victim != -1 && recv(victim, b, sizeof(b), 0) == 0 ? 0 : 1);
+   }
+   REQUIRE(squatter > 0);
+
+   auto inherited = take_over(path, std::chrono::seconds(2));
+   REQUIRE(inherited.erred());
+   REQUIRE_THROWS_AS(inherited.get(), std::runtime_error);
+
+   int status = 0;
+   REQUIRE(waitpid(squatter, &status, 0) == squatter);
+   REQUIRE(WIFEXITED(status));
+   REQUIRE(WEXITSTATUS(status) == 0);
+}
+
+TEST_CASE("sockets of unknown kinds aren't taken over", "[handoff]") {
+   const std::string path = "@cppsocket-test-garbled";
+   struct sockaddr_un sa;
+   std::memset(&sa, 0, sizeof(sa));
+   sa.sun_family = AF_UNIX;
+   std::memcpy(sa.sun_path + 1, path.data() + 1, path.size() - 1);
+   socklen_t len = offsetof(struct sockaddr_un, sun_path) + path.size();
+   int server = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+   REQUIRE(bind(server, (struct sockaddr*)&sa, len) == 0);
+   REQUIRE(listen(server, 1) == 0);
+
+   bool sent = false;
+   std::thread predecessor([&](){
+      int successor = accept(server, NULL, NULL);
+      // Connected, so that it would pass for a connection otherwise.
+      int passed = socket(AF_INET, SOCK_DGRAM, 0);
+      struct sockaddr_in to;
+      std::memset(&to, 0, sizeof(to));
+      to.sin_family = AF_INET;
+      to.sin_port = htons(3462);
+      to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      connect(passed, (struct sockaddr*)&to, sizeof(to));
+      char kind = 'X';
+      char control[CMSG_SPACE(sizeof(int))];
+      std::memset(control, 0, sizeof(control));
+      struct iovec iov = { &kind, 1 };
+      struct msghdr msg;
+      std::memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      std::memcpy(CMSG_DATA(cmsg), &passed, sizeof(int));
+      sent = sendmsg(successor, &msg, 0) == 1 && shutdown(successor, SHUT_WR) == 0;
+      char b[16];
+      while (recv(successor, b, sizeof(b), 0) > 0);
+      close(passed);
+      close(successor);
+   });
+
+   auto inherited = take_over(path, std::chrono::seconds(2));
+   predecessor.join();
+   close(server);
+   REQUIRE(sent);
+   REQUIRE(inherited.erred());
+   REQUIRE_THROWS_AS(inherited.get(), std::runtime_error);
+}
+
+TEST_CASE("handovers time out without a counterpart", "[handoff]") {
+   auto handed = hand_over("@cppsocket-test-nobody", {}, {}, std::chrono::milliseconds(50));
+   REQUIRE(handed.erred());
+   REQUIRE_THROWS_AS(handed.get(), std::logic_error);
+
+   auto inherited = take_over("@cppsocket-test-nobody", std::chrono::milliseconds(50));
+   REQUIRE(inherited.erred());
+   REQUIRE_THROWS_AS(inherited.get(), std::logic_error);
+
+   REQUIRE_THROWS_AS(hand_over("", {}, {}, std::chrono::milliseconds(50)).get(), std::invalid_argument);
+   REQUIRE_THROWS_AS(take_over(std::string(200, 'x'), std::chrono::milliseconds(50)).get(), std::invalid_argument);
+}
@@ -0,0 +1,29 @@
+#ifndef _CPPSOCKET_TESTS_HELPERS
+#define _CPPSOCKET_TESTS_HELPERS
+
+#include <cppsocket.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <iostream>
+#include <memory>
+
+inline void require_matching_addresses(const std::shared_ptr<Connection>& local, const std::shared_ptr<Connection>& remote)
+{
+   REQUIRE(local->remote_addr() == remote->local_addr());
+   REQUIRE(local->local_addr() == remote->remote_addr());
+}
+
+template <typename T>
+void require_not_erred(Expected<T> expectation)
+{
+   try {
+      expectation.get();
+   } catch (const std::exception& e) {
+      std::cerr << "expected not to err but did with: \"" << e.what() << "\"" << std::endl;
+   }
+   REQUIRE(expectation.erred() == false);
+   REQUIRE(expectation.exception() == nullptr);
+}
+
+#endif
@@ -2,6 +2,8 @@
 
 #include <cppsocket.hpp>
 
+#include "helpers.hpp"
+
 #include <catch2/catch.hpp>
 
 #include <chrono>
@@ -25,6 +27,7 @@ struct Scanner
    Scanner(std::shared_ptr<Reader> reader)
       : __reader(reader)
       , __split(&split_lines)
+      , __erred(false)
    {}
 
    ~Scanner()
@@ -74,30 +77,10 @@ private:
 
    std::string __buffer;
    bool __erred;
-   union {
-      std::string __scanned;
-      std::exception_ptr __exception;
-   };
+   std::string __scanned;
+   std::exception_ptr __exception;
 };
 
-void require_matching_addresses(const std::shared_ptr<Connection>& local, const std::shared_ptr<Connection>& remote)
-{
-   REQUIRE(local->remote_addr() == remote->local_addr());
-   REQUIRE(local->local_addr() == remote->remote_addr());
-}
-
-template <typename T>
-void require_not_erred(Expected<T> expectation)
-{
-   try {
-      expectation.get();
-   } catch (const std::exception& e) {
-      std::cerr << "expected not to err but did with: \"" << e.what() << "\"" << std::endl;
-   }
-   REQUIRE(expectation.erred() == false);
-   REQUIRE(expectation.exception() == nullptr);
-}
-
 TEST_CASE("a TCP listener accepts new TCP connections", "[listen_tcp]") {
    SECTION("which can be read from") {
       const std::string addr = "tcp://127.0.0.1:9876";
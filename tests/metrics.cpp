@@ -0,0 +1,82 @@
+#include <cppsocket.hpp>
+#include <metrics.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * scrape stands in for a Prometheus server: it requests `path` and returns
+ * the whole response.
+ */
+static std::string scrape(const std::string& addr, const std::string& path)
+{
+   auto conn = dial_tcp(addr);
+   std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nAccept: text/plain\r\n\r\n";
+   require_not_erred(conn->write(std::vector<uint8_t>(request.begin(), request.end())));
+   std::string response;
+   std::vector<uint8_t> buffer(4096);
+   for (;;) {
+      auto read = conn->read(buffer, std::chrono::seconds(1));
+      require_not_erred(read);
+      if (read.get() == 0)
+         break;
+      response.append(buffer.begin(), buffer.begin() + read.get());
+   }
+   return response;
+}
+
+TEST_CASE("the metrics endpoint serves Prometheus text", "[metrics_tcp]") {
+   const std::string addr = "tcp://127.0.0.1:2678";
+   auto endpoint = metrics_tcp(listen_tcp(addr));
+   std::thread serving([&](){ require_not_erred(endpoint->serve()); });
+
+   SECTION("on /metrics") {
+      std::string first = scrape(addr, "/metrics");
+      REQUIRE(first.compare(0, 15, "HTTP/1.0 200 OK") == 0);
+      REQUIRE(first.find("Content-Type: text/plain; version=0.0.4\r\n") != std::string::npos);
+      std::string body = first.substr(first.find("\r\n\r\n") + 4);
+      REQUIRE(first.find("Content-Length: " + std::to_string(body.size()) + "\r\n") != std::string::npos);
+      REQUIRE(body.find("# TYPE cppsocket_accepts_total counter\n") != std::string::npos);
+      REQUIRE(body.find("# TYPE cppsocket_read_duration_seconds histogram\n") != std::string::npos);
+      REQUIRE(body.find("cppsocket_read_duration_seconds_bucket{le=\"+Inf\"} ") != std::string::npos);
+      REQUIRE(body.back() == '\n');
+
+      if (io_stats_enabled()) {
+         // The second scrape sees the first one's accept.
+         std::string second = scrape(addr, "/metrics?x=1");
+         auto at = second.find("\ncppsocket_accepts_total ");
+         REQUIRE(at != std::string::npos);
+         REQUIRE(std::stoull(second.substr(at + 25)) >= 1);
+      }
+   }
+
+   SECTION("not elsewhere") {
+      REQUIRE(scrape(addr, "/").compare(0, 22, "HTTP/1.0 404 Not Found") == 0);
+   }
+
+   endpoint->close();
+   serving.join();
+}
+
+TEST_CASE("histograms are rendered cumulatively", "[metrics_tcp]") {
+   IOStats s;
+   s.counters = IOCounters();
+   s.read_latency.record(1500);
+   s.read_latency.record(3000);
+   s.read_latency.record(3000);
+   // Right on either side of a bound.
+   s.read_latency.record(2047);
+   s.read_latency.record(2048);
+   std::string text = prometheus_text(s);
+   REQUIRE(text.find("cppsocket_read_duration_seconds_bucket{le=\"1.023e-06\"} 0\n") != std::string::npos);
+   REQUIRE(text.find("cppsocket_read_duration_seconds_bucket{le=\"2.047e-06\"} 2\n") != std::string::npos);
+   REQUIRE(text.find("cppsocket_read_duration_seconds_bucket{le=\"4.095e-06\"} 5\n") != std::string::npos);
+   REQUIRE(text.find("cppsocket_read_duration_seconds_sum 1.1595e-05\n") != std::string::npos);
+   REQUIRE(text.find("cppsocket_read_duration_seconds_count 5\n") != std::string::npos);
+}
@@ -0,0 +1,83 @@
+#include <cppsocket.hpp>
+#include <mux.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::string read_all(const std::shared_ptr<TCPConnection>& conn, size_t n)
+{
+   std::string received;
+   std::vector<uint8_t> buffer(1024);
+   while (received.size() < n) {
+      auto read = conn->read(buffer, std::chrono::seconds(1));
+      require_not_erred(read);
+      REQUIRE(read.get() > 0);
+      received.append(buffer.begin(), buffer.begin() + read.get());
+   }
+   return received;
+}
+
+TEST_CASE("a mux listener routes connections by their first bytes", "[mux_tcp]") {
+   const std::string addr = "tcp://127.0.0.1:4321";
+   auto mux = mux_tcp(listen_tcp(addr));
+   auto http = mux->match(http1_prefixes());
+   auto rpc = mux->match({std::string("\xca\xfe", 2)});
+   auto admin = mux->match_any();
+   mux->sniff_timeout(std::chrono::milliseconds(200));
+   std::thread serving([&](){ require_not_erred(mux->serve()); });
+
+   SECTION("without consuming the sniffed bytes") {
+      const std::string request = "GET / HTTP/1.1\r\n\r\n";
+      const std::string call = std::string("\xca\xfe\x00\x01", 4);
+      const std::string command = "status\n";
+
+      auto to_http = dial_tcp(addr);
+      to_http->write(std::vector<uint8_t>(request.begin(), request.end()));
+      auto to_rpc = dial_tcp(addr);
+      to_rpc->write(std::vector<uint8_t>(call.begin(), call.end()));
+      auto to_admin = dial_tcp(addr);
+      to_admin->write(std::vector<uint8_t>(command.begin(), command.end()));
+
+      auto accepted_http = http->accept(std::chrono::seconds(1));
+      require_not_erred(accepted_http);
+      REQUIRE(read_all(accepted_http.get(), request.size()) == request);
+      auto accepted_rpc = rpc->accept(std::chrono::seconds(1));
+      require_not_erred(accepted_rpc);
+      REQUIRE(read_all(accepted_rpc.get(), call.size()) == call);
+      auto accepted_admin = admin->accept(std::chrono::seconds(1));
+      require_not_erred(accepted_admin);
+      REQUIRE(read_all(accepted_admin.get(), command.size()) == command);
+   }
+
+   SECTION("waiting for a prefix which arrives in pieces") {
+      auto conn = dial_tcp(addr);
+      conn->no_delay(true);
+      const std::string head = "PO";
+      conn->write(std::vector<uint8_t>(head.begin(), head.end()));
+      REQUIRE(http->accept(std::chrono::milliseconds(50)).erred());
+      const std::string rest = "ST /submit HTTP/1.1\r\n\r\n";
+      conn->write(std::vector<uint8_t>(rest.begin(), rest.end()));
+
+      auto accepted = http->accept(std::chrono::seconds(1));
+      require_not_erred(accepted);
+      REQUIRE(read_all(accepted.get(), head.size() + rest.size()) == head + rest);
+   }
+
+   SECTION("handing silent connections to the fallback after the sniff timeout") {
+      auto conn = dial_tcp(addr);
+      REQUIRE(admin->accept(std::chrono::milliseconds(50)).erred());
+      auto accepted = admin->accept(std::chrono::seconds(1));
+      require_not_erred(accepted);
+      REQUIRE(http->accept(std::chrono::milliseconds(0)).erred());
+   }
+
+   mux->close();
+   serving.join();
+   REQUIRE(http->accept().erred());
+}
@@ -0,0 +1,175 @@
+#include <netsim.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static Impairment lossy(double loss, double reorder)
+{
+   Impairment i;
+   i.latency = std::chrono::milliseconds(5);
+   i.loss = loss;
+   i.reorder = reorder;
+   return i;
+}
+
+static std::vector<uint8_t> received(const std::shared_ptr<SimulatedNetwork>& net, size_t n)
+{
+   auto server = net->listen_udp("udp://10.0.0.1:53");
+   auto client = net->dial_udp("udp://10.0.0.1:53");
+   for (size_t i = 0; i < n; i++)
+      require_not_erred(client->write(std::vector<uint8_t>(1, uint8_t(i))));
+   std::vector<uint8_t> ids;
+   std::vector<uint8_t> b(16);
+   std::string from;
+   for (;;) {
+      auto read = server->read(b, from, std::chrono::milliseconds(50));
+      if (read.erred())
+         break;
+      REQUIRE(read.get() == 1);
+      REQUIRE(from == client->local_addr());
+      ids.push_back(b[0]);
+   }
+   return ids;
+}
+
+TEST_CASE("simulated datagrams are impaired reproducibly", "[netsim]") {
+   const size_t n = 200;
+
+   SECTION("by dropping them") {
+      auto ids = received(simulate_network(lossy(0.25, 0), 42), n);
+      REQUIRE(ids.size() > n / 2);
+      REQUIRE(ids.size() < n);
+      REQUIRE(received(simulate_network(lossy(0.25, 0), 42), n) == ids);
+      REQUIRE(received(simulate_network(lossy(0.25, 0), 43), n) != ids);
+   }
+
+   SECTION("by reordering them") {
+      auto ids = received(simulate_network(lossy(0, 0.25), 42), n);
+      REQUIRE(ids.size() == n);
+      REQUIRE(!std::is_sorted(ids.begin(), ids.end()));
+   }
+}
+
+TEST_CASE("simulated datagrams are delayed", "[netsim]") {
+   Impairment i;
+   i.latency = std::chrono::milliseconds(20);
+   auto net = simulate_network(i, 1);
+   auto server = net->listen_udp("udp://10.0.0.1:53");
+   auto client = net->dial_udp("udp://10.0.0.1:53");
+   std::vector<uint8_t> b(16);
+
+   auto began = std::chrono::steady_clock::now();
+   require_not_erred(client->write(std::vector<uint8_t>(4, 'x')));
+   REQUIRE(server->read(b, std::chrono::milliseconds(0)).erred());
+   std::string from;
+   require_not_erred(server->read(b, from, std::chrono::seconds(1)));
+   require_not_erred(server->write(std::vector<uint8_t>(4, 'y'), from));
+   require_not_erred(client->read(b, std::chrono::seconds(1)));
+   REQUIRE(std::chrono::steady_clock::now() - began >= std::chrono::milliseconds(40));
+   REQUIRE(server->fd() == -1);
+}
+
+TEST_CASE("simulated streams are delivered whole and in order", "[netsim]") {
+   Impairment i;
+   i.latency = std::chrono::milliseconds(1);
+   i.jitter = std::chrono::milliseconds(1);
+   i.loss = 0.05;
+   i.bandwidth = 4 << 20;
+   i.queue = 64 << 10;
+   auto net = simulate_network(i, 7);
+   auto listener = net->listen_tcp("tcp://10.0.0.1:80");
+   REQUIRE_THROWS_AS(net->dial_tcp("tcp://10.0.0.1:81"), std::runtime_error);
+
+   auto client = net->dial_tcp("tcp://10.0.0.1:80");
+   auto accepted = listener->accept(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   auto server = accepted.get();
+   require_matching_addresses(client, server);
+
+   std::vector<uint8_t> sent(256 << 10);
+   for (size_t j = 0; j < sent.size(); j++)
+      sent[j] = uint8_t(j * 7);
+   auto began = std::chrono::steady_clock::now();
+   auto written = client->write(sent, std::chrono::seconds(5));
+   require_not_erred(written);
+   REQUIRE(written.get() == sent.size());
+   // The queue bounds how far ahead of the link the writer got.
+   REQUIRE(std::chrono::steady_clock::now() - began >= std::chrono::milliseconds(40));
+
+   std::vector<uint8_t> got;
+   std::vector<uint8_t> b(4096);
+   while (got.size() < sent.size()) {
+      auto read = server->read(b, std::chrono::seconds(5));
+      require_not_erred(read);
+      got.insert(got.end(), b.begin(), b.begin() + read.get());
+   }
+   REQUIRE(got == sent);
+   auto info = client->info();
+   require_not_erred(info);
+   REQUIRE(info.get().total_retransmits > 0);
+
+   client.reset();
+   auto eof = server->read(b, std::chrono::seconds(1));
+   require_not_erred(eof);
+   REQUIRE(eof.get() == 0);
+}
+
+TEST_CASE("simulated streams are closed for writing and reading separately", "[netsim]") {
+   auto net = simulate_network(lossy(0, 0), 3);
+   auto listener = net->listen_tcp("tcp://10.0.0.1:80");
+   auto client = net->dial_tcp("tcp://10.0.0.1:80");
+   auto accepted = listener->accept(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   auto server = accepted.get();
+
+   std::vector<uint8_t> none;
+   REQUIRE_THROWS_AS(server->read(none).get(), std::invalid_argument);
+
+   std::vector<uint8_t> b(16);
+   require_not_erred(client->write(std::vector<uint8_t>(3, 'q')));
+   require_not_erred(client->close_write());
+   REQUIRE_THROWS_AS(client->write(std::vector<uint8_t>(1, 'x')).get(), std::runtime_error);
+   auto request = server->read(b, std::chrono::seconds(1));
+   require_not_erred(request);
+   REQUIRE(request.get() == 3);
+   auto end = server->read(b, std::chrono::seconds(1));
+   require_not_erred(end);
+   REQUIRE(end.get() == 0);
+
+   require_not_erred(server->write(std::vector<uint8_t>(5, 'r')));
+   auto reply = client->read(b, std::chrono::seconds(1));
+   require_not_erred(reply);
+   REQUIRE(reply.get() == 5);
+   require_not_erred(client->close_read());
+   auto closed = client->read(b, std::chrono::seconds(1));
+   require_not_erred(closed);
+   REQUIRE(closed.get() == 0);
+}
+
+TEST_CASE("simulated datagrams run out of ephemeral ports", "[netsim]") {
+   auto net = simulate_network(Impairment(), 42);
+   std::vector<std::shared_ptr<UDPConnection>> dialed;
+   for (unsigned port = 49152; port <= 65535; port++)
+      dialed.push_back(net->dial_udp("udp://10.0.0.1:53"));
+   REQUIRE_THROWS_AS(net->dial_udp("udp://10.0.0.1:53"), std::runtime_error);
+
+   // Letting go of one frees its port up again.
+   const std::string freed = dialed[100]->local_addr();
+   dialed[100].reset();
+   REQUIRE(net->dial_udp("udp://10.0.0.1:53")->local_addr() == freed);
+}
+
+TEST_CASE("impairment profiles are looked up by name", "[netsim]") {
+   auto wan = impairment_profile("wan");
+   require_not_erred(wan);
+   REQUIRE(wan.get().latency > std::chrono::microseconds(0));
+   REQUIRE(impairment_profile("dialup").erred());
+}
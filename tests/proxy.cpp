@@ -0,0 +1,195 @@
+#include <cppsocket.hpp>
+#include <proxy.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * echo echoes everything read from `conn` and says "bye" once the peer shut
+ * down its side of the connection.
+ */
+static void echo(std::shared_ptr<TCPConnection> conn)
+{
+   std::vector<uint8_t> buffer(1024);
+   for (;;) {
+      buffer.resize(1024);
+      auto read = conn->read(buffer, std::chrono::seconds(2));
+      if (read.erred())
+         return;
+      if (read.get() == 0)
+         break;
+      buffer.resize(read.get());
+      conn->write(buffer);
+   }
+   const std::string bye = "bye";
+   conn->write(std::vector<uint8_t>(bye.begin(), bye.end()));
+}
+
+static std::string read_until_eof(const std::shared_ptr<TCPConnection>& conn)
+{
+   std::string received;
+   std::vector<uint8_t> buffer(1024);
+   for (;;) {
+      auto read = conn->read(buffer, std::chrono::seconds(2));
+      require_not_erred(read);
+      if (read.get() == 0)
+         return received;
+      received.append(buffer.begin(), buffer.begin() + read.get());
+   }
+}
+
+TEST_CASE("a TCP proxy relays between the accepted and the dialed connection", "[proxy_tcp]") {
+   const std::string upstream = "tcp://127.0.0.1:3210";
+   const std::string addr = "tcp://127.0.0.1:3211";
+   auto listener = listen_tcp(upstream);
+   auto proxy = proxy_tcp(listen_tcp(addr), upstream);
+
+   SECTION("propagating a half-close") {
+      std::thread serving([&](){ require_not_erred(proxy->serve()); });
+      std::thread echoing([&](){
+         auto accepted = listener->accept(std::chrono::seconds(1));
+         require_not_erred(accepted);
+         echo(accepted.get());
+      });
+
+      auto conn = dial_tcp(addr);
+      const std::string hello = "hello";
+      conn->write(std::vector<uint8_t>(hello.begin(), hello.end()));
+      ::shutdown(conn->fd(), SHUT_WR);
+      REQUIRE(read_until_eof(conn) == "hellobye");
+
+      echoing.join();
+      proxy->close();
+      serving.join();
+   }
+
+   SECTION("tearing down idle sessions") {
+      proxy->idle_timeout(std::chrono::milliseconds(100));
+      std::thread serving([&](){ require_not_erred(proxy->serve()); });
+
+      auto conn = dial_tcp(addr);
+      auto accepted = listener->accept(std::chrono::seconds(1));
+      require_not_erred(accepted);
+      auto begin = std::chrono::steady_clock::now();
+      REQUIRE(read_until_eof(conn) == "");
+      REQUIRE(std::chrono::steady_clock::now() - begin < std::chrono::seconds(1));
+
+      proxy->close();
+      serving.join();
+   }
+
+   SECTION("keeping active sessions") {
+      proxy->idle_timeout(std::chrono::milliseconds(100));
+      std::thread serving([&](){ require_not_erred(proxy->serve()); });
+      std::thread echoing([&](){
+         auto accepted = listener->accept(std::chrono::seconds(1));
+         if (!accepted.erred())
+            echo(accepted.get());
+      });
+
+      auto conn = dial_tcp(addr);
+      std::vector<uint8_t> b(16);
+      for (int i = 0; i < 8; i++) {
+         std::this_thread::sleep_for(std::chrono::milliseconds(40));
+         require_not_erred(conn->write(std::vector<uint8_t>(1, 'x')));
+         auto read = conn->read(b, std::chrono::seconds(1));
+         require_not_erred(read);
+         REQUIRE(read.get() == 1);
+      }
+      ::shutdown(conn->fd(), SHUT_WR);
+      REQUIRE(read_until_eof(conn) == "bye");
+
+      echoing.join();
+      proxy->close();
+      serving.join();
+   }
+
+   SECTION("surviving an upstream which resets mid-transfer") {
+      std::thread serving([&](){ require_not_erred(proxy->serve()); });
+      auto conn = dial_tcp(addr);
+      auto accepted = listener->accept(std::chrono::seconds(1));
+      require_not_erred(accepted);
+      // Writing on after the upstream closed has it reset the connection, of
+      // which the next write raises SIGPIPE.
+      accepted.get().reset();
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      const std::vector<uint8_t> chunk(1024 * 1024, 'x');
+
+      auto begin = std::chrono::steady_clock::now();
+      while (std::chrono::steady_clock::now() - begin < std::chrono::seconds(2))
+         if (conn->write(chunk, std::chrono::milliseconds(100)).erred())
+            break;
+      REQUIRE(std::chrono::steady_clock::now() - begin < std::chrono::seconds(2));
+
+      proxy->close();
+      serving.join();
+   }
+}
+
+TEST_CASE("a TCP proxy keeps relaying whilst the upstream is slow to connect", "[proxy_tcp]") {
+   const std::string upstream = "tcp://127.0.0.1:3456";
+   const std::string addr = "tcp://127.0.0.1:3457";
+   // With a backlog of 0, a single connection fills the accept queue, after
+   // which the SYNs of further connections are dropped.
+   TCPListenOptions options;
+   options.backlog = 0;
+   auto listener = listen_tcp(upstream, options);
+   auto proxy = proxy_tcp(listen_tcp(addr), upstream);
+   std::thread serving([&](){ require_not_erred(proxy->serve()); });
+
+   auto established = dial_tcp(addr);
+   auto accepted = listener->accept(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   auto filling = dial_tcp(upstream);
+   auto stalled = dial_tcp(addr);
+   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+   const std::string ping = "ping";
+   require_not_erred(established->write(std::vector<uint8_t>(ping.begin(), ping.end())));
+   std::vector<uint8_t> buffer(16);
+   auto read = accepted.get()->read(buffer, std::chrono::milliseconds(500));
+   require_not_erred(read);
+   REQUIRE(std::string(buffer.begin(), buffer.begin() + read.get()) == ping);
+
+   proxy->close();
+   serving.join();
+}
+
+TEST_CASE("a UDP proxy relays datagrams in both directions", "[proxy_udp]") {
+   const std::string upstream = "udp://127.0.0.1:3212";
+   const std::string addr = "udp://127.0.0.1:3213";
+   auto echoing = listen_udp(upstream);
+   auto proxy = proxy_udp(listen_udp(addr), upstream);
+   std::thread serving([&](){ require_not_erred(proxy->serve()); });
+
+   auto primero = dial_udp(addr);
+   auto segundo = dial_udp(addr);
+   for (auto& conn : {primero, segundo}) {
+      const std::string hola = "hola from " + conn->local_addr();
+      conn->write(std::vector<uint8_t>(hola.begin(), hola.end()));
+
+      std::string remote;
+      std::vector<uint8_t> buffer(1024);
+      auto read = echoing->read(buffer, remote, std::chrono::seconds(1));
+      require_not_erred(read);
+      buffer.resize(read.get());
+      echoing->write(buffer, remote);
+
+      std::vector<uint8_t> response(1024);
+      auto responded = conn->read(response, std::chrono::seconds(1));
+      require_not_erred(responded);
+      REQUIRE(std::string(response.begin(), response.begin() + responded.get()) == hola);
+   }
+
+   proxy->close();
+   serving.join();
+}
@@ -0,0 +1,147 @@
+#include <cppsocket.hpp>
+#include <resp.hpp>
+
+#include "helpers.hpp"
+#include "resp_server.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+TEST_CASE("a RESP parser parses replies incrementally", "[resp]") {
+   SECTION("even when fed a byte at a time") {
+      const std::string reply = "*3\r\n:42\r\n$5\r\nhello\r\n*2\r\n+OK\r\n$-1\r\n";
+      const std::vector<uint8_t> data(reply.begin(), reply.end());
+
+      RESPParser parser;
+      for (size_t n = 0; n < data.size(); n++) {
+         auto parsed = parser.parse(data.data(), n);
+         REQUIRE(parsed.erred() == false);
+         REQUIRE(parsed.get() == false);
+      }
+      auto parsed = parser.parse(data.data(), data.size());
+      REQUIRE(parsed.erred() == false);
+      REQUIRE(parsed.get() == true);
+      REQUIRE(parser.position() == data.size());
+
+      RESPReply root(data.data(), &parser.values()[0]);
+      REQUIRE(root.type() == RESPType::array);
+      REQUIRE(root.elements() == 3);
+      REQUIRE(root.at(0).integer() == 42);
+      REQUIRE(root.at(1).str() == "hello");
+      REQUIRE(root.at(2).elements() == 2);
+      REQUIRE(root.at(2).at(0).str() == "OK");
+      REQUIRE(root.at(2).at(1).null());
+   }
+
+   SECTION("one after the other from the same buffer") {
+      const std::string replies = "+OK\r\n-ERR nope\r\n:7\r\n";
+      const std::vector<uint8_t> data(replies.begin(), replies.end());
+
+      RESPParser parser;
+      REQUIRE(parser.parse(data.data(), data.size()).get());
+      REQUIRE(RESPReply(data.data(), &parser.values()[0]).str() == "OK");
+      REQUIRE(parser.parse(data.data(), data.size()).get());
+      REQUIRE(RESPReply(data.data(), &parser.values()[0]).error());
+      REQUIRE(RESPReply(data.data(), &parser.values()[0]).str() == "ERR nope");
+      REQUIRE(parser.parse(data.data(), data.size()).get());
+      REQUIRE(RESPReply(data.data(), &parser.values()[0]).integer() == 7);
+      REQUIRE(parser.parse(data.data(), data.size()).get() == false);
+   }
+
+   SECTION("and refuses malformed ones") {
+      const std::string reply = "?nope\r\n";
+      const std::vector<uint8_t> data(reply.begin(), reply.end());
+
+      RESPParser parser;
+      REQUIRE(parser.parse(data.data(), data.size()).erred());
+   }
+
+   SECTION("and refuses integers which don't fit") {
+      const std::string fits = ":9223372036854775807\r\n";
+      const std::vector<uint8_t> data(fits.begin(), fits.end());
+      RESPParser parser;
+      REQUIRE(parser.parse(data.data(), data.size()).get());
+      REQUIRE(RESPReply(data.data(), &parser.values()[0]).integer() == std::numeric_limits<int64_t>::max());
+
+      for (const std::string reply : {":9223372036854775808\r\n", "$99999999999999999999999\r\n"}) {
+         const std::vector<uint8_t> data(reply.begin(), reply.end());
+         RESPParser parser;
+         REQUIRE(parser.parse(data.data(), data.size()).erred());
+      }
+   }
+}
+
+TEST_CASE("a RESP client pipelines commands", "[resp]") {
+   const std::string addr = "tcp://127.0.0.1:6380";
+   RESPServer server(addr);
+   RESPClient client(dial_tcp(addr));
+
+   SECTION("and hands out the replies in order") {
+      constexpr int n = 1000;
+      for (int i = 0; i < n; i++)
+         client.append({"INCR", "counter"});
+      REQUIRE(client.pending() == n);
+
+      int64_t expected = 1;
+      auto flushed = client.flush([&](const RESPReply& reply){
+         REQUIRE(reply.type() == RESPType::integer);
+         REQUIRE(reply.integer() == expected++);
+      }, std::chrono::seconds(1));
+      require_not_erred(flushed);
+      REQUIRE(flushed.get() == n);
+      REQUIRE(client.pending() == 0);
+   }
+
+   SECTION("of mixed types") {
+      client.append({"SET", "key", std::string(40000, 'x')});
+      client.append({"GET", "key"});
+      client.append({"GET", "missing"});
+      client.append({"BOGUS"});
+
+      std::vector<RESPType> types;
+      std::vector<std::string> payloads;
+      auto flushed = client.flush([&](const RESPReply& reply){
+         types.push_back(reply.type());
+         payloads.push_back(reply.null() ? "(nil)" : reply.str());
+      }, std::chrono::seconds(1));
+      require_not_erred(flushed);
+      REQUIRE(types == std::vector<RESPType>{
+         RESPType::simple_string, RESPType::bulk_string, RESPType::bulk_string, RESPType::error
+      });
+      REQUIRE(payloads[0] == "OK");
+      REQUIRE(payloads[1] == std::string(40000, 'x'));
+      REQUIRE(payloads[2] == "(nil)");
+   }
+}
+
+TEST_CASE("a RESP client resumes the replies of a failed flush", "[resp]") {
+   const std::string addr = "tcp://127.0.0.1:3455";
+   auto listener = listen_tcp(addr);
+   RESPClient client(dial_tcp(addr));
+   auto server = listener->accept(std::chrono::seconds(1));
+   require_not_erred(server);
+   auto reply = [&](const std::string& r){
+      require_not_erred(server.get()->write(std::vector<uint8_t>(r.begin(), r.end())));
+   };
+
+   std::vector<int64_t> replies;
+   auto handle = [&](const RESPReply& r){ replies.push_back(r.integer()); };
+   client.append({"INCR", "a"});
+   client.append({"INCR", "b"});
+   reply(":1\r\n");
+   auto flushed = client.flush(handle, std::chrono::milliseconds(50));
+   REQUIRE(flushed.erred());
+   REQUIRE(replies == std::vector<int64_t>{1});
+   REQUIRE(client.pending() == 1);
+
+   client.append({"INCR", "c"});
+   reply(":2\r\n:3\r\n");
+   auto resumed = client.flush(handle, std::chrono::seconds(1));
+   require_not_erred(resumed);
+   REQUIRE(resumed.get() == 2);
+   REQUIRE(replies == std::vector<int64_t>({1, 2, 3}));
+   REQUIRE(client.pending() == 0);
+}
@@ -0,0 +1,116 @@
+#ifndef _CPPSOCKET_TESTS_RESP_SERVER
+#define _CPPSOCKET_TESTS_RESP_SERVER
+
+#include <cppsocket.hpp>
+#include <resp.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * RESPServer is a tiny stand-in for a Redis-compatible server. It understands
+ * PING, SET, GET and INCR, which is plenty to exercise a client.
+ */
+struct RESPServer
+{
+   RESPServer(const std::string& addr)
+      : __listener(listen_tcp(addr))
+      , __stopped(false)
+   {
+      __accepting = std::thread([this](){
+         while (!__stopped) {
+            auto accepted = __listener->accept(std::chrono::milliseconds(50));
+            if (accepted.erred())
+               continue;
+            std::shared_ptr<TCPConnection> conn = accepted.get();
+            conn->no_delay(true);
+            __serving.push_back(std::thread([this, conn](){ serve(conn); }));
+         }
+      });
+   }
+
+   ~RESPServer()
+   {
+      __stopped = true;
+      __accepting.join();
+      for (auto& serving : __serving)
+         serving.join();
+   }
+
+private:
+   void serve(std::shared_ptr<TCPConnection> conn)
+   {
+      RESPParser parser;
+      std::vector<uint8_t> buffer;
+      std::vector<uint8_t> chunk;
+      std::vector<uint8_t> out;
+      while (!__stopped) {
+         chunk.resize(16 * 1024);
+         auto read = conn->read(chunk, std::chrono::milliseconds(50));
+         if (read.erred())
+            continue;
+         if (read.get() == 0)
+            return;
+         buffer.insert(buffer.end(), chunk.begin(), chunk.begin() + read.get());
+         for (;;) {
+            auto parsed = parser.parse(buffer.data(), buffer.size());
+            if (parsed.erred())
+               return;
+            if (!parsed.get())
+               break;
+            respond(RESPReply(buffer.data(), &parser.values()[0]), out);
+         }
+         size_t handled = parser.position();
+         parser.discard(handled);
+         buffer.erase(buffer.begin(), buffer.begin() + handled);
+         while (!out.empty()) {
+            auto written = conn->write(out);
+            if (written.erred())
+               return;
+            out.erase(out.begin(), out.begin() + written.get());
+         }
+      }
+   }
+
+   void respond(const RESPReply& command, std::vector<uint8_t>& out)
+   {
+      std::string reply;
+      const std::string name = command.elements() > 0 ? command.at(0).str() : "";
+      std::lock_guard<std::mutex> lock(__lock);
+      if (name == "PING") {
+         reply = "+PONG\r\n";
+      } else if (name == "SET" && command.elements() == 3) {
+         __store[command.at(1).str()] = command.at(2).str();
+         reply = "+OK\r\n";
+      } else if (name == "GET" && command.elements() == 2) {
+         auto found = __store.find(command.at(1).str());
+         if (found == __store.end())
+            reply = "$-1\r\n";
+         else
+            reply = "$" + std::to_string(found->second.size()) + "\r\n" + found->second + "\r\n";
+      } else if (name == "INCR" && command.elements() == 2) {
+         auto& value = __store[command.at(1).str()];
+         value = std::to_string(value.empty() ? 1 : std::stoll(value) + 1);
+         reply = ":" + value + "\r\n";
+      } else {
+         reply = "-ERR unknown command\r\n";
+      }
+      out.insert(out.end(), reply.begin(), reply.end());
+   }
+
+private:
+   std::unique_ptr<TCPListener> __listener;
+   std::atomic<bool> __stopped;
+   std::thread __accepting;
+   std::vector<std::thread> __serving;
+   std::mutex __lock;
+   std::map<std::string, std::string> __store;
+};
+
+#endif
@@ -0,0 +1,374 @@
+#include <cppsocket.hpp>
+#include <socket.hpp>
+#include <stats.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("concrete sockets are handed out and can be adopted", "[socket]") {
+   SECTION("TCP") {
+      const std::string addr = "tcp://127.0.0.1:3440";
+      std::unique_ptr<TCPSocketListener> listener = listen_tcp(addr);
+      std::shared_ptr<TCPSocket> conn = dial_tcp(addr);
+      auto accepted = listener->accept_socket(std::chrono::seconds(1));
+      require_not_erred(accepted);
+      std::shared_ptr<TCPSocket> peer = accepted.get();
+      require_matching_addresses(conn, peer);
+      REQUIRE(listener->stats().accepts == (io_stats_enabled() ? 1 : 0));
+
+      TCPSocket adopted(dup(peer->fd()), peer->local_addr(), peer->remote_addr());
+      REQUIRE(adopted.remote_addr() == conn->local_addr());
+      const std::vector<uint8_t> data(16, 'x');
+      require_not_erred(conn->write(data));
+      std::vector<uint8_t> b(data.size());
+      auto read = adopted.read(b, std::chrono::seconds(1));
+      require_not_erred(read);
+      REQUIRE(read.get() == data.size());
+   }
+
+   SECTION("UDP") {
+      const std::string addr = "udp://127.0.0.1:3441";
+      std::shared_ptr<UDPSocket> listening = listen_udp(addr);
+      std::shared_ptr<UDPSocket> dialing = dial_udp(addr);
+      UDPSocket adopted(dup(listening->fd()), listening->local_addr());
+      REQUIRE(adopted.remote_addr() == adopted.unknown_addr);
+      REQUIRE(adopted.write(std::vector<uint8_t>(1, 'x')).erred());
+
+      require_not_erred(dialing->write(std::vector<uint8_t>(4, 'y')));
+      std::vector<uint8_t> b(16);
+      std::string from;
+      auto read = adopted.read(b, from, std::chrono::seconds(1));
+      require_not_erred(read);
+      REQUIRE(read.get() == 4);
+      REQUIRE(from == dialing->local_addr());
+   }
+}
+
+TEST_CASE("unique connections are handed to a single owner", "[socket]") {
+   SECTION("TCP") {
+      const std::string addr = "tcp://127.0.0.1:3442";
+      auto listener = listen_tcp(addr);
+      std::unique_ptr<TCPSocket> conn = dial_tcp_unique(addr);
+      auto accepted = listener->accept_unique(std::chrono::seconds(1));
+      REQUIRE(accepted.erred() == false);
+      std::unique_ptr<TCPSocket> peer = std::move(accepted.get());
+      REQUIRE(peer->remote_addr() == conn->local_addr());
+      REQUIRE(conn->stats().dials == (io_stats_enabled() ? 1 : 0));
+
+      // Handed off to another stage, which echoes once.
+      std::thread echoing([](std::unique_ptr<TCPSocket> c) {
+         std::vector<uint8_t> b(16);
+         auto read = c->read(b, std::chrono::seconds(1));
+         if (!read.erred())
+            c->write(std::vector<uint8_t>(b.begin(), b.begin() + read.get()));
+      }, std::move(peer));
+      REQUIRE(peer == nullptr);
+
+      const std::vector<uint8_t> data(8, 'x');
+      require_not_erred(conn->write(data));
+      std::vector<uint8_t> b(16);
+      auto read = conn->read(b, std::chrono::seconds(1));
+      echoing.join();
+      require_not_erred(read);
+      REQUIRE(read.get() == data.size());
+
+      std::shared_ptr<TCPConnection> shared = std::move(conn);
+      REQUIRE(shared.use_count() == 1);
+   }
+
+   SECTION("UDP") {
+      const std::string addr = "udp://127.0.0.1:3443";
+      std::unique_ptr<UDPSocket> listening = listen_udp_unique(addr);
+      std::unique_ptr<UDPSocket> dialing = dial_udp_unique(addr);
+      require_not_erred(dialing->write(std::vector<uint8_t>(4, 'y')));
+      std::vector<uint8_t> b(16);
+      std::string from;
+      auto read = listening->read(b, from, std::chrono::seconds(1));
+      require_not_erred(read);
+      REQUIRE(from == dialing->local_addr());
+   }
+}
+
+TEST_CASE("listeners defer accepting and take initial payloads", "[socket]") {
+   const std::string addr = "tcp://127.0.0.1:3444";
+   TCPListenOptions options;
+   options.fast_open = 16;
+   options.defer_accept = std::chrono::seconds(5);
+   auto listener = listen_tcp(addr, options);
+
+   // Without any data, the connection isn't handed out yet.
+   auto quiet = dial_tcp(addr);
+   REQUIRE(listener->accept_socket(std::chrono::milliseconds(200)).erred());
+   require_not_erred(quiet->write(std::vector<uint8_t>(1, 'q')));
+   auto accepted = listener->accept_socket(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   REQUIRE(accepted.get()->remote_addr() == quiet->local_addr());
+
+   // The first connection fetches a Fast Open cookie where the kernel allows
+   // it, the second one uses it; the payload arrives whole either way.
+   const std::vector<uint8_t> request(1000, 'r');
+   for (int i = 0; i < 2; i++) {
+      auto conn = dial_tcp(addr, request);
+      REQUIRE(conn->stats().bytes_out == (io_stats_enabled() ? request.size() : 0));
+      auto peer = listener->accept_socket(std::chrono::seconds(1));
+      require_not_erred(peer);
+      std::vector<uint8_t> got;
+      std::vector<uint8_t> b(4096);
+      while (got.size() < request.size()) {
+         auto read = peer.get()->read(b, std::chrono::seconds(1));
+         require_not_erred(read);
+         REQUIRE(read.get() > 0);
+         got.insert(got.end(), b.begin(), b.begin() + read.get());
+      }
+      REQUIRE(got == request);
+   }
+}
+
+static int option(int fd, int level, int name)
+{
+   int value = 0;
+   socklen_t length = sizeof(value);
+   REQUIRE(getsockopt(fd, level, name, &value, &length) == 0);
+   return value;
+}
+
+static std::string congestion(int fd)
+{
+   char name[16] = {0};
+   socklen_t length = sizeof(name);
+   REQUIRE(getsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, name, &length) == 0);
+   return name;
+}
+
+TEST_CASE("tuning is set on dialed sockets and inherited by accepted ones", "[socket]") {
+   const std::string addr = "tcp://127.0.0.1:3445";
+   SocketTuning tuning = tuning_profile("mobile").get();
+   tuning.receive_buffer = 64 << 10;
+   tuning.congestion = "reno";
+   tuning.priority = 5;
+   TCPListenOptions options;
+   options.tuning = tuning;
+   auto listener = listen_tcp(addr, options);
+
+   auto conn = dial_tcp(addr, tuning);
+   auto accepted = listener->accept_socket(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   for (int fd : {conn->fd(), accepted.get()->fd()}) {
+      // The kernel doubles buffer sizes for its bookkeeping.
+      REQUIRE(option(fd, SOL_SOCKET, SO_RCVBUF) == 2 * tuning.receive_buffer);
+      REQUIRE(option(fd, IPPROTO_TCP, TCP_NODELAY) == 1);
+      REQUIRE(option(fd, SOL_SOCKET, SO_KEEPALIVE) == 1);
+      REQUIRE(option(fd, IPPROTO_TCP, TCP_KEEPIDLE) == 30);
+      REQUIRE(option(fd, IPPROTO_TCP, TCP_KEEPINTVL) == 10);
+      REQUIRE(option(fd, IPPROTO_TCP, TCP_KEEPCNT) == 3);
+      REQUIRE(option(fd, IPPROTO_TCP, TCP_USER_TIMEOUT) == 30000);
+      REQUIRE(option(fd, SOL_SOCKET, SO_PRIORITY) == 5);
+      REQUIRE(congestion(fd) == "reno");
+   }
+
+   REQUIRE(tuning_profile("low-latency").get().no_delay);
+   REQUIRE(tuning_profile("bulk").get().send_buffer > 0);
+   REQUIRE(tuning_profile("default").get().priority < 0);
+   REQUIRE(tuning_profile("turbo").erred());
+
+   SocketTuning unknown;
+   unknown.no_delay = true;
+   unknown.congestion = "no-such-algorithm";
+   unknown.priority = 5;
+   const IOCounters before = io_stats().counters;
+   REQUIRE_THROWS_AS(dial_tcp(addr, unknown), std::runtime_error);
+   if (io_stats_enabled()) {
+      // The socket, TCP_NODELAY and the failed TCP_CONGESTION.
+      const IOCounters after = io_stats().counters;
+      REQUIRE(after.syscalls - before.syscalls == 3);
+      REQUIRE(after.errors - before.errors == 1);
+   }
+}
+
+TEST_CASE("reads spin before waiting on the socket", "[socket]") {
+   const std::string addr = "tcp://127.0.0.1:3447";
+   TCPListenOptions options;
+   options.tuning.spin = std::chrono::microseconds(200);
+   options.tuning.no_delay = true;
+   auto listener = listen_tcp(addr, options);
+   auto conn = dial_tcp(addr, options.tuning);
+   auto accepted = listener->accept_socket(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   auto peer = accepted.get();
+
+   std::vector<uint8_t> b(16);
+   auto began = std::chrono::steady_clock::now();
+   auto timedout = conn->read(b, std::chrono::milliseconds(50));
+   REQUIRE(timedout.erred());
+   REQUIRE_THROWS_AS(timedout.get(), std::logic_error);
+   REQUIRE(std::chrono::steady_clock::now() - began >= std::chrono::milliseconds(50));
+
+   // Once spun out, reads wait on the socket as usual.
+   std::thread answering([&](){
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      peer->write(std::vector<uint8_t>(4, 'a'));
+   });
+   auto read = conn->read(b, std::chrono::seconds(1));
+   answering.join();
+   require_not_erred(read);
+   REQUIRE(read.get() == 4);
+
+   for (int i = 0; i < 100; i++) {
+      require_not_erred(conn->write(std::vector<uint8_t>(1, 'p')));
+      auto pinged = peer->read(b, std::chrono::seconds(1));
+      require_not_erred(pinged);
+      REQUIRE(pinged.get() == 1);
+      require_not_erred(peer->write(std::vector<uint8_t>(1, 'q')));
+      auto ponged = conn->read(b, std::chrono::seconds(1));
+      require_not_erred(ponged);
+      REQUIRE(ponged.get() == 1);
+   }
+
+   conn.reset();
+   auto eof = peer->read(b, std::chrono::seconds(1));
+   require_not_erred(eof);
+   REQUIRE(eof.get() == 0);
+}
+
+TEST_CASE("connections are closed for writing and reading separately", "[socket]") {
+   const std::string addr = "tcp://127.0.0.1:3453";
+   auto listener = listen_tcp(addr);
+   auto client = dial_tcp(addr);
+   auto accepted = listener->accept_socket(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   auto server = accepted.get();
+
+   std::vector<uint8_t> none;
+   REQUIRE_THROWS_AS(server->read(none, std::chrono::seconds(1)).get(), std::invalid_argument);
+   std::vector<uint8_t> b(16);
+
+   // The request ends where the client stops writing; the reply still gets
+   // through.
+   require_not_erred(client->write(std::vector<uint8_t>(3, 'q')));
+   require_not_erred(client->close_write());
+   auto request = server->read(b, std::chrono::seconds(1));
+   require_not_erred(request);
+   REQUIRE(request.get() == 3);
+   auto end = server->read(b, std::chrono::seconds(1));
+   require_not_erred(end);
+   REQUIRE(end.get() == 0);
+   require_not_erred(server->write(std::vector<uint8_t>(5, 'r')));
+   auto reply = client->read(b, std::chrono::seconds(1));
+   require_not_erred(reply);
+   REQUIRE(reply.get() == 5);
+
+   auto written = client->write(std::vector<uint8_t>(1, 'x'));
+   REQUIRE(written.erred());
+   REQUIRE_THROWS_AS(written.get(), std::runtime_error);
+
+   require_not_erred(client->close_read());
+   auto closed = client->read(b, std::chrono::seconds(1));
+   require_not_erred(closed);
+   REQUIRE(closed.get() == 0);
+}
+
+TEST_CASE("empty datagrams are read as zero bytes", "[socket]") {
+   const std::string addr = "udp://127.0.0.1:3459";
+   auto listener = listen_udp(addr);
+   auto conn = dial_udp(addr);
+
+   std::vector<uint8_t> none;
+   std::string remote;
+   REQUIRE_THROWS_AS(listener->read(none, remote, std::chrono::seconds(1)).get(), std::invalid_argument);
+
+   require_not_erred(conn->write(none));
+   std::vector<uint8_t> b(16);
+   auto empty = listener->read(b, remote, std::chrono::seconds(1));
+   require_not_erred(empty);
+   REQUIRE(empty.get() == 0);
+   REQUIRE(remote == conn->local_addr());
+}
+
+TEST_CASE("servers drain until their connections are done with", "[socket]") {
+   const std::string addr = "tcp://127.0.0.1:3454";
+   auto listener = listen_tcp(addr);
+   std::vector<std::shared_ptr<TCPSocket>> clients;
+   std::vector<std::shared_ptr<TCPSocket>> served;
+   for (int i = 0; i < 3; i++) {
+      clients.push_back(dial_tcp(addr));
+      auto accepted = listener->accept_socket(std::chrono::seconds(1));
+      require_not_erred(accepted);
+      served.push_back(accepted.get());
+   }
+   std::vector<std::weak_ptr<TCPConnection>> conns(served.begin(), served.end());
+
+   // One is replying at length, one was handled already, and one idles.
+   const std::vector<uint8_t> response(4 << 20, 'r');
+   auto replying = served[0];
+   std::thread replied([&](){
+      size_t sent = 0;
+      while (sent < response.size()) {
+         auto w = replying->write(std::vector<uint8_t>(response.begin() + sent, response.end()), std::chrono::seconds(5));
+         require_not_erred(w);
+         sent += w.get();
+      }
+      require_not_erred(replying->close_write());
+   });
+   served[1].reset();
+   std::thread reading([&](){
+      std::vector<uint8_t> b(1 << 16);
+      size_t got = 0;
+      for (;;) {
+         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         auto r = clients[0]->read(b, std::chrono::seconds(5));
+         require_not_erred(r);
+         if (r.get() == 0)
+            break;
+         got += r.get();
+      }
+      REQUIRE(got == response.size());
+   });
+
+   auto began = std::chrono::steady_clock::now();
+   auto busy = drain(*listener, conns, began + std::chrono::milliseconds(500));
+   replied.join();
+   reading.join();
+   require_not_erred(busy);
+   REQUIRE(busy.get() == 1);
+   REQUIRE(std::chrono::steady_clock::now() - began >= std::chrono::milliseconds(500));
+
+   REQUIRE(listener->accept_socket(std::chrono::milliseconds(10)).erred());
+   REQUIRE_THROWS_AS(dial_tcp(addr), std::runtime_error);
+}
+
+TEST_CASE("listeners stop in every process sharing them", "[socket]") {
+   const std::string addr = "tcp://127.0.0.1:3460";
+   auto listener = listen_tcp(addr);
+   TCPSocketListener copy(dup(listener->fd()));
+   auto queued = dial_tcp(addr);
+
+   SECTION("closing leaves the copy accepting") {
+      require_not_erred(listener->close());
+      REQUIRE(listener->fd() == -1);
+      REQUIRE(listener->accept_socket(std::chrono::milliseconds(10)).erred());
+      auto accepted = copy.accept_socket(std::chrono::seconds(1));
+      require_not_erred(accepted);
+      REQUIRE(accepted.get()->remote_addr() == queued->local_addr());
+   }
+
+   SECTION("stopping stops the copy along") {
+      require_not_erred(listener->stop());
+      REQUIRE(copy.accept_socket(std::chrono::milliseconds(10)).erred());
+      std::vector<uint8_t> b(16);
+      REQUIRE(queued->read(b, std::chrono::seconds(1)).erred());
+      REQUIRE_THROWS_AS(dial_tcp(addr), std::runtime_error);
+   }
+}
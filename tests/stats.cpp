@@ -0,0 +1,102 @@
+#include <cppsocket.hpp>
+#include <stats.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("I/O is counted per connection and per process", "[stats]") {
+   if (!io_stats_enabled()) {
+      auto conn = listen_udp("udp://127.0.0.1:2567");
+      REQUIRE(conn->stats().reads == 0);
+      REQUIRE(io_stats().counters.reads == 0);
+      return;
+   }
+
+   const IOStats before = io_stats();
+   const std::string addr = "tcp://127.0.0.1:2567";
+   auto listener = listen_tcp(addr);
+   auto conn = dial_tcp(addr);
+   auto accepted = listener->accept(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   auto peer = accepted.get();
+
+   const size_t rounds = 4 * IOStats::kLatencySampling;
+   std::vector<uint8_t> data(100, 'x');
+   std::vector<uint8_t> buffer(data.size());
+   for (size_t i = 0; i < rounds; i++) {
+      require_not_erred(conn->write(data));
+      auto read = peer->read(buffer, std::chrono::seconds(1));
+      require_not_erred(read);
+      REQUIRE(read.get() == data.size());
+   }
+
+   SECTION("per connection") {
+      REQUIRE(conn->stats().dials == 1);
+      REQUIRE(conn->stats().writes == rounds);
+      REQUIRE(conn->stats().bytes_out == rounds * data.size());
+      REQUIRE(conn->stats().reads == 0);
+      REQUIRE(peer->stats().reads == rounds);
+      REQUIRE(peer->stats().bytes_in == rounds * data.size());
+      REQUIRE(peer->stats().polls == rounds);
+      REQUIRE(listener->stats().accepts == 1);
+   }
+
+   SECTION("per process") {
+      const IOStats after = io_stats();
+      REQUIRE(after.counters.writes - before.counters.writes >= rounds);
+      REQUIRE(after.counters.reads - before.counters.reads >= rounds);
+      REQUIRE(after.counters.bytes_in - before.counters.bytes_in >= rounds * data.size());
+      REQUIRE(after.counters.syscalls > after.counters.polls);
+      REQUIRE(after.read_latency.count() - before.read_latency.count() >= rounds / IOStats::kLatencySampling - 1);
+      REQUIRE(after.write_latency.count() > before.write_latency.count());
+   }
+
+   SECTION("timeouts") {
+      auto read = peer->read(buffer, std::chrono::milliseconds(1));
+      REQUIRE(read.erred());
+      REQUIRE(peer->stats().timeouts == 1);
+   }
+
+   SECTION("whilst being scraped") {
+      const IOStats prior = io_stats();
+      std::atomic<bool> done(false);
+      std::atomic<size_t> scrapes(0);
+      bool consistent = true;
+      std::thread scraping([&](){
+         while (!done) {
+            const IOStats s = io_stats();
+            uint64_t buckets = 0;
+            for (int i = 0; i < Histogram::kBuckets; i++)
+               buckets += s.read_latency.bucket(i);
+            consistent = consistent && buckets == s.read_latency.count();
+            scrapes++;
+         }
+      });
+      while (scrapes == 0)
+         std::this_thread::yield();
+      for (size_t i = 0; i < rounds; i++) {
+         require_not_erred(conn->write(data));
+         require_not_erred(peer->read(buffer, std::chrono::seconds(1)));
+      }
+      done = true;
+      scraping.join();
+      REQUIRE(consistent);
+      REQUIRE(io_stats().read_latency.count() - prior.read_latency.count() >= rounds / IOStats::kLatencySampling - 1);
+   }
+
+   SECTION("of exited threads") {
+      const IOStats prior = io_stats();
+      std::thread([&](){
+         require_not_erred(conn->write(data));
+      }).join();
+      REQUIRE(io_stats().counters.writes == prior.counters.writes + 1);
+      require_not_erred(peer->read(buffer, std::chrono::seconds(1)));
+   }
+}
@@ -0,0 +1,71 @@
+#include <cppsocket.hpp>
+#include <tcp_info.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <netinet/tcp.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+TEST_CASE("a TCP connection reports its transport metrics", "[tcp_info]") {
+   const std::string addr = "tcp://127.0.0.1:2456";
+   auto listener = listen_tcp(addr);
+   auto conn = dial_tcp(addr);
+   auto accepted = listener->accept(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   auto peer = accepted.get();
+
+   const std::vector<uint8_t> data(10000, 'x');
+   require_not_erred(conn->write(data));
+   std::vector<uint8_t> buffer(data.size());
+   for (size_t received = 0; received < data.size();) {
+      auto read = peer->read(buffer, std::chrono::seconds(1));
+      require_not_erred(read);
+      received += read.get();
+   }
+
+   SECTION("through info") {
+      auto info = conn->info();
+      require_not_erred(info);
+      REQUIRE(info.get().state == TCP_ESTABLISHED);
+      REQUIRE(info.get().mss > 0);
+      REQUIRE(info.get().cwnd > 0);
+      REQUIRE(info.get().rtt.count() > 0);
+      REQUIRE(info.get().bytes_acked >= data.size());
+
+      auto received = peer->info();
+      require_not_erred(received);
+      REQUIRE(received.get().bytes_received >= data.size());
+   }
+
+   SECTION("which can be collected in samples") {
+      TCPInfoCollector collector(1);
+      collector.track(conn);
+      collector.track(peer);
+      {
+         auto gone = dial_tcp(addr);
+         collector.track(gone);
+      }
+      REQUIRE(collector.tracked() == 3);
+
+      auto first = collector.collect();
+      REQUIRE(first.size() == 1);
+      auto second = collector.collect();
+      REQUIRE(second.size() == 1);
+      REQUIRE(first[0].remote_addr != second[0].remote_addr);
+      // The third one comes across the connection which is gone, and wraps
+      // around.
+      auto third = collector.collect();
+      REQUIRE(third.size() == 1);
+      REQUIRE(third[0].remote_addr == first[0].remote_addr);
+      REQUIRE(collector.tracked() == 2);
+
+      auto summary = TCPInfoCollector::summarize(first);
+      REQUIRE(summary.sampled == 1);
+      REQUIRE(summary.rtt.count() == 1);
+   }
+}
@@ -0,0 +1,144 @@
+#include <timer_wheel.hpp>
+
+#include <catch2/catch.hpp>
+
+#include <poll.h>
+#include <sys/timerfd.h>
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+static bool readable(int fd, int timeout)
+{
+   struct pollfd pfd = { fd, POLLIN, 0 };
+   return poll(&pfd, 1, timeout) == 1;
+}
+
+TEST_CASE("timers come due in order of their deadlines", "[timer_wheel]") {
+   const auto tick = std::chrono::milliseconds(1);
+   auto wheel = timer_wheel(tick);
+   auto base = std::chrono::steady_clock::now();
+
+   // Spread over every level but the last, up to about a day ahead.
+   std::mt19937_64 rng(42);
+   std::vector<std::chrono::steady_clock::time_point> deadlines;
+   std::vector<TimerWheel::Timer> timers;
+   for (uint64_t i = 0; i < 200000; i++) {
+      auto ahead = std::chrono::microseconds(rng() % (uint64_t(1) << (10 + 4 * (i % 7))));
+      deadlines.push_back(base + ahead);
+      timers.push_back(wheel->schedule(deadlines.back(), i));
+   }
+   for (size_t i = 0; i < timers.size(); i += 3)
+      REQUIRE(wheel->cancel(timers[i]));
+   REQUIRE_FALSE(wheel->cancel(timers[0]));
+   REQUIRE(wheel->size() == timers.size() - (timers.size() + 2) / 3);
+
+   std::vector<bool> fired(timers.size(), false);
+   auto now = base;
+   auto previous = base;
+   size_t expired = 0;
+   for (auto step = std::chrono::microseconds(700); wheel->size() > 0; step *= 2) {
+      now += step;
+      expired += wheel->expire(now, [&](uint64_t i){
+         REQUIRE(i % 3 != 0);
+         REQUIRE_FALSE(fired[i]);
+         REQUIRE(deadlines[i] <= now);
+         REQUIRE(deadlines[i] > previous - tick);
+         fired[i] = true;
+      });
+      previous = now;
+   }
+   REQUIRE(expired == timers.size() - (timers.size() + 2) / 3);
+   REQUIRE_FALSE(wheel->cancel(timers[1]));
+}
+
+TEST_CASE("timers may be scheduled whilst expiring", "[timer_wheel]") {
+   auto wheel = timer_wheel(std::chrono::milliseconds(10));
+   auto base = std::chrono::steady_clock::now();
+   std::vector<uint64_t> order;
+   wheel->schedule(base + std::chrono::milliseconds(5), 1);
+   auto cancelled = wheel->schedule(base + std::chrono::milliseconds(15), 2);
+
+   REQUIRE(wheel->expire(base + std::chrono::milliseconds(20), [&](uint64_t i){
+      order.push_back(i);
+      if (i == 1) {
+         REQUIRE(wheel->cancel(cancelled));
+         wheel->schedule(base, 3);
+      }
+   }) == 2);
+   REQUIRE(order == std::vector<uint64_t>({1, 3}));
+   REQUIRE(wheel->size() == 0);
+}
+
+TEST_CASE("the timer's file descriptor signals the next deadline", "[timer_wheel]") {
+   auto wheel = timer_wheel(std::chrono::milliseconds(5));
+   REQUIRE(wheel->fd() >= 0);
+   REQUIRE_FALSE(readable(wheel->fd(), 20));
+
+   auto began = std::chrono::steady_clock::now();
+   wheel->schedule(began + std::chrono::seconds(30), 1);
+   wheel->schedule(began + std::chrono::milliseconds(30), 2);
+   REQUIRE(readable(wheel->fd(), 1000));
+   auto now = std::chrono::steady_clock::now();
+   REQUIRE(now - began >= std::chrono::milliseconds(30));
+
+   std::vector<uint64_t> due;
+   REQUIRE(wheel->expire(now, [&](uint64_t i){ due.push_back(i); }) == 1);
+   REQUIRE(due == std::vector<uint64_t>({2}));
+   REQUIRE_FALSE(readable(wheel->fd(), 0));
+}
+
+TEST_CASE("the timer's file descriptor is rearmed past a far deadline", "[timer_wheel]") {
+   auto wheel = timer_wheel(std::chrono::milliseconds(5));
+   auto began = std::chrono::steady_clock::now();
+   wheel->schedule(began + std::chrono::hours(48), 1);
+
+   // Armed no further than a day ahead, at first.
+   struct itimerspec spec;
+   REQUIRE(timerfd_gettime(wheel->fd(), &spec) == 0);
+   REQUIRE(spec.it_value.tv_sec <= 24 * 3600);
+   REQUIRE(spec.it_value.tv_sec > 23 * 3600);
+
+   // Once that passed, it's armed further ahead rather than left firing.
+   REQUIRE(wheel->expire(began + std::chrono::hours(25), [](uint64_t){}) == 0);
+   REQUIRE(timerfd_gettime(wheel->fd(), &spec) == 0);
+   REQUIRE(spec.it_value.tv_sec > 24 * 3600);
+   REQUIRE(spec.it_value.tv_sec <= 48 * 3600);
+
+   REQUIRE(wheel->expire(began + std::chrono::hours(48) + std::chrono::milliseconds(5), [](uint64_t){}) == 1);
+   REQUIRE(timerfd_gettime(wheel->fd(), &spec) == 0);
+   REQUIRE(spec.it_value.tv_sec == 0);
+   REQUIRE(spec.it_value.tv_nsec == 0);
+}
+
+TEST_CASE("keepalives detect idle connections and pace heartbeats", "[timer_wheel]") {
+   std::map<uint64_t, int> beats;
+   std::vector<uint64_t> idle;
+   auto k = keepalive(
+      std::chrono::milliseconds(200),
+      std::chrono::milliseconds(50),
+      [&](uint64_t id){ idle.push_back(id); },
+      [&](uint64_t id){ beats[id]++; }
+   );
+   k->watch(1);
+   k->watch(2);
+   k->watch(3);
+   k->forget(3);
+   REQUIRE(k->size() == 2);
+
+   auto began = std::chrono::steady_clock::now();
+   while (std::chrono::steady_clock::now() - began < std::chrono::milliseconds(400)) {
+      readable(k->fd(), 5);
+      k->touch(1);
+      k->expire(std::chrono::steady_clock::now());
+   }
+
+   REQUIRE(idle == std::vector<uint64_t>({2}));
+   REQUIRE(beats[1] == 0);
+   REQUIRE(beats[2] >= 2);
+   REQUIRE(beats[2] <= 4);
+   REQUIRE(beats[3] == 0);
+   REQUIRE(k->size() == 1);
+}
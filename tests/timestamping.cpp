@@ -0,0 +1,124 @@
+#include <cppsocket.hpp>
+
+#include "helpers.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * settle gives the kernel time to enable timestamping system wide, which it
+ * does in the background once the first socket asks for it.
+ */
+static void settle()
+{
+   std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+/**
+ * await_sent collects transmit timestamps until `n` were collected, as the
+ * kernel queues them asynchronously.
+ */
+static std::vector<SentTimestamp> await_sent(const std::shared_ptr<Connection>& conn, size_t n)
+{
+   std::vector<SentTimestamp> sent;
+   for (int i = 0; i < 100 && sent.size() < n; i++) {
+      auto collected = conn->sent_at();
+      require_not_erred(collected);
+      sent.insert(sent.end(), collected.get().begin(), collected.get().end());
+      if (sent.size() < n)
+         std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   }
+   return sent;
+}
+
+TEST_CASE("UDP connections report kernel timestamps", "[timestamping]") {
+   const std::string addr = "udp://127.0.0.1:2789";
+   auto listener = listen_udp(addr);
+   auto conn = dial_udp(addr);
+   listener->timestamping(true);
+   conn->timestamping(true);
+   settle();
+
+   const auto before = std::chrono::system_clock::now();
+   const std::vector<uint8_t> data(100, 'x');
+   for (int i = 0; i < 3; i++)
+      require_not_erred(conn->write(data, std::chrono::seconds(1)));
+
+   std::vector<uint8_t> buffer(data.size());
+   std::string remote;
+   for (int i = 0; i < 3; i++) {
+      auto read = listener->read(buffer, remote, std::chrono::seconds(1));
+      require_not_erred(read);
+      REQUIRE(read.get() == data.size());
+      REQUIRE(listener->received_at() >= before);
+      REQUIRE(listener->received_at() <= std::chrono::system_clock::now());
+   }
+
+   auto sent = await_sent(conn, 3);
+   REQUIRE(sent.size() == 3);
+   for (uint32_t i = 0; i < sent.size(); i++) {
+      REQUIRE(sent[i].id == i);
+      REQUIRE(sent[i].at >= before);
+   }
+
+   SECTION("without blocking reads on the error queue") {
+      require_not_erred(conn->write(data, std::chrono::seconds(1)));
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      // Only the error queue is pending now, which isn't to be mistaken
+      // for an error nor for data.
+      auto read = conn->read(buffer, std::chrono::milliseconds(50));
+      REQUIRE(read.erred());
+      REQUIRE_THROWS_AS(read.get(), std::logic_error);
+      auto collected = conn->sent_at();
+      require_not_erred(collected);
+      REQUIRE(collected.get().size() == 1);
+      REQUIRE(collected.get()[0].id == 3);
+   }
+
+   SECTION("within the timeout whilst timestamps keep arriving") {
+      std::thread writing([&](){
+         for (int i = 0; i < 30; i++) {
+            conn->write(data, std::chrono::seconds(1));
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+         }
+      });
+      auto begin = std::chrono::steady_clock::now();
+      auto read = conn->read(buffer, std::chrono::milliseconds(100));
+      auto took = std::chrono::steady_clock::now() - begin;
+      writing.join();
+      REQUIRE(read.erred());
+      REQUIRE_THROWS_AS(read.get(), std::logic_error);
+      REQUIRE(took < std::chrono::milliseconds(300));
+   }
+}
+
+TEST_CASE("TCP connections report kernel timestamps", "[timestamping]") {
+   const std::string addr = "tcp://127.0.0.1:2789";
+   auto listener = listen_tcp(addr);
+   auto conn = dial_tcp(addr);
+   auto accepted = listener->accept(std::chrono::seconds(1));
+   require_not_erred(accepted);
+   auto peer = accepted.get();
+   peer->timestamping(true);
+   conn->timestamping(true);
+   settle();
+   REQUIRE(peer->received_at() == std::chrono::system_clock::time_point());
+
+   const auto before = std::chrono::system_clock::now();
+   const std::vector<uint8_t> data(100, 'x');
+   require_not_erred(conn->write(data, std::chrono::seconds(1)));
+   std::vector<uint8_t> buffer(data.size());
+   auto read = peer->read(buffer, std::chrono::seconds(1));
+   require_not_erred(read);
+   REQUIRE(peer->received_at() >= before);
+
+   auto sent = await_sent(conn, 1);
+   REQUIRE(sent.size() == 1);
+   REQUIRE(sent[0].id == data.size() - 1);
+   REQUIRE(sent[0].at >= before);
+   REQUIRE(sent[0].at <= peer->received_at());
+}
@@ -0,0 +1,586 @@
+#include <cppsocket.hpp>
+#include <histogram.hpp>
+
+namespace sys {
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * cppsocket-load drives TCP connections or UDP flows, dialed with the
+ * library itself, against echoing targets and reports the throughput and
+ * latency percentiles it observed.
+ *
+ * With a rate, requests are scheduled open-loop: each one has an intended
+ * send time, independent of how fast earlier ones were answered, and its
+ * latency is measured from that moment. A target which stalls therefore
+ * shows up in the percentiles in full, instead of merely delaying the
+ * requests which would have revealed it (coordinated omission).
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* kUsage =
+   "usage: cppsocket-load [options] <address>...\n"
+   "\n"
+   "Addresses are tcp://host:port or udp://host:port; connections are spread\n"
+   "over them round-robin.\n"
+   "\n"
+   "  -c, --connections N  connections or UDP flows to open (1)\n"
+   "  -r, --rate N         requests per second over all connections, or 0\n"
+   "                       to await each response before the next request (0)\n"
+   "  -d, --duration S     seconds to generate load for (10)\n"
+   "  -w, --warmup S       seconds at the start not to report on (0)\n"
+   "  -s, --size N[:M]     message size in bytes, or a range to pick from (64)\n"
+   "  -p, --pattern P      message contents: ascii, zeros or random (ascii)\n"
+   "  -t, --threads N      threads to spread the connections over (1)\n"
+   "      --timeout MS     UDP responses later than this count as lost (1000)\n"
+   "      --sink           don't await responses, only count what was sent\n";
+
+struct Options
+{
+   std::vector<std::string> targets;
+   size_t connections = 1;
+   double rate = 0;
+   double duration = 10;
+   double warmup = 0;
+   size_t min_size = 64;
+   size_t max_size = 64;
+   std::string pattern = "ascii";
+   size_t threads = 1;
+   std::chrono::milliseconds timeout = std::chrono::milliseconds(1000);
+   bool sink = false;
+};
+
+struct Results
+{
+   uint64_t dialed = 0;
+   uint64_t sent = 0;
+   uint64_t completed = 0;
+   uint64_t lost = 0;
+   uint64_t failed = 0;
+   uint64_t bytes_out = 0;
+   uint64_t bytes_in = 0;
+   /**
+    * latency is measured from a request's intended send time, service from
+    * its actual send time; both in nanoseconds.
+    */
+   Histogram latency;
+   Histogram service;
+
+   void merge(const Results& r)
+   {
+      dialed += r.dialed;
+      sent += r.sent;
+      completed += r.completed;
+      lost += r.lost;
+      failed += r.failed;
+      bytes_out += r.bytes_out;
+      bytes_in += r.bytes_in;
+      latency.merge(r.latency);
+      service.merge(r.service);
+   }
+};
+
+struct Request
+{
+   Clock::time_point intended;
+   Clock::time_point sent;
+   size_t size;
+};
+
+struct Flow
+{
+   std::shared_ptr<Connection> conn;
+   bool udp;
+   bool dead;
+   std::deque<Request> inflight;
+   /**
+    * received is the amount of bytes of the oldest request's response which
+    * were received so far.
+    */
+   size_t received;
+   std::vector<uint8_t> pending;
+   /**
+    * blocked tells that a closed-loop datagram flow lost its request to a
+    * full send buffer, and is to send the next once writable.
+    */
+   bool blocked;
+};
+
+static std::vector<std::vector<uint8_t>> messages(const Options& o)
+{
+   const size_t kDistinct = 64;
+   std::mt19937_64 rng(42);
+   std::uniform_int_distribution<size_t> size(o.min_size, o.max_size);
+   std::vector<std::vector<uint8_t>> m(o.min_size == o.max_size ? 1 : kDistinct);
+   for (auto& b : m) {
+      b.resize(size(rng));
+      for (size_t i = 0; i < b.size(); i++) {
+         if (o.pattern == "zeros")
+            b[i] = 0;
+         else if (o.pattern == "random")
+            b[i] = static_cast<uint8_t>(rng());
+         else
+            b[i] = 'a' + i % 26;
+      }
+   }
+   return m;
+}
+
+struct Worker
+{
+   const size_t kMaxEvents = 256;
+   const size_t kMaxBurst = 1024;
+
+   Worker(const Options& o, const std::vector<std::vector<uint8_t>>& m, size_t first, size_t count)
+      : __o(o)
+      , __messages(m)
+      , __first(first)
+      , __count(count)
+      , __next_message(0)
+      , __buffer(256 * 1024)
+   {
+      __epoll = sys::epoll_create1(sys::EPOLL_CLOEXEC);
+      if (__epoll == -1)
+         throw std::runtime_error(std::string("unable to create epoll instance - ") + std::strerror(errno));
+   }
+
+   ~Worker()
+   {
+      sys::close(__epoll);
+   }
+
+   void dial()
+   {
+      for (size_t i = __first; i < __first + __count; i++) {
+         const std::string& target = __o.targets[i % __o.targets.size()];
+         Flow f;
+         f.udp = target.compare(0, 6, "udp://") == 0;
+         f.dead = false;
+         f.received = 0;
+         f.blocked = false;
+         try {
+            if (f.udp) {
+               f.conn = dial_udp(target);
+            } else {
+               auto conn = dial_tcp(target);
+               conn->no_delay(true);
+               f.conn = conn;
+            }
+         } catch (const std::exception& e) {
+            std::cerr << "cppsocket-load: dialing " << target << " failed: " << e.what() << std::endl;
+            __results.failed++;
+            continue;
+         }
+         int fd = f.conn->fd();
+         int flags = sys::fcntl(fd, F_GETFL, 0);
+         sys::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+         struct sys::epoll_event ev;
+         ev.events = sys::EPOLLIN;
+         ev.data.u64 = __flows.size();
+         sys::epoll_ctl(__epoll, EPOLL_CTL_ADD, fd, &ev);
+         __flows.push_back(std::move(f));
+         __results.dialed++;
+      }
+   }
+
+   void run(Clock::time_point start)
+   {
+      __warm = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(__o.warmup));
+      const Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(
+         std::chrono::duration<double>(__o.warmup + __o.duration)
+      );
+      if (__flows.empty())
+         return;
+
+      // Each worker schedules its share of the rate, spread evenly over its
+      // flows.
+      const bool open = __o.rate > 0;
+      std::chrono::duration<double> interval(open ? __o.connections / (__o.rate * __count) : 0);
+      uint64_t scheduled = 0;
+      Clock::time_point next = start;
+      if (!open)
+         for (size_t i = 0; i < __flows.size(); i++)
+            send(i, start, start);
+
+      std::vector<struct sys::epoll_event> events(kMaxEvents);
+      for (;;) {
+         Clock::time_point now = Clock::now();
+         if (now >= end)
+            break;
+         for (size_t burst = 0; open && next <= now && burst < kMaxBurst; burst++) {
+            size_t i = scheduled % __flows.size();
+            if (!__flows[i].dead)
+               send(i, next, now);
+            scheduled++;
+            next = start + std::chrono::duration_cast<Clock::duration>(interval * scheduled);
+         }
+
+         auto wait = std::chrono::duration_cast<std::chrono::milliseconds>((open ? std::min(next, end) : end) - now);
+         if (open && next <= now)
+            wait = std::chrono::milliseconds(0);
+         int n = sys::epoll_wait(__epoll, events.data(), events.size(), std::min<long>(wait.count(), 100));
+         if (n == -1 && errno != EINTR)
+            throw std::runtime_error(std::string("unable to wait for events - ") + std::strerror(errno));
+         for (int e = 0; e < n; e++) {
+            size_t i = events[e].data.u64;
+            if (events[e].events & sys::EPOLLOUT)
+               flush(i);
+            if (events[e].events & (sys::EPOLLIN | sys::EPOLLERR | sys::EPOLLHUP))
+               receive(i);
+         }
+         if (!__o.sink)
+            expire(Clock::now());
+      }
+   }
+
+   const Results& results() const
+   {
+      return __results;
+   }
+
+private:
+   bool counts(const Request& r) const
+   {
+      return r.intended >= __warm;
+   }
+
+   void send(size_t i, Clock::time_point intended, Clock::time_point now)
+   {
+      Flow& f = __flows[i];
+      const std::vector<uint8_t>& m = __messages[__next_message++ % __messages.size()];
+      Request r{intended, now, m.size()};
+      if (counts(r))
+         __results.sent++;
+      if (!f.pending.empty()) {
+         f.pending.insert(f.pending.end(), m.begin(), m.end());
+         if (!__o.sink)
+            f.inflight.push_back(r);
+         return;
+      }
+
+      auto written = f.conn->write(m, std::chrono::milliseconds(0));
+      size_t w = 0;
+      if (written.erred()) {
+         try {
+            written.get();
+         } catch (const std::logic_error&) {
+            // Not writable; a datagram is simply lost, a stream is to be
+            // continued once writable.
+            if (f.udp) {
+               if (counts(r))
+                  __results.lost++;
+               if (__o.rate <= 0 && !__o.sink) {
+                  f.blocked = true;
+                  watch(i, true);
+               }
+               return;
+            }
+         } catch (const std::exception&) {
+            kill(i);
+            return;
+         }
+      } else {
+         w = written.get();
+      }
+      __results.bytes_out += w;
+      if (!__o.sink)
+         f.inflight.push_back(r);
+      else if (w == m.size() && counts(r))
+         __results.completed++;
+      if (w < m.size()) {
+         f.pending.assign(m.begin() + w, m.end());
+         watch(i, true);
+      }
+   }
+
+   void flush(size_t i)
+   {
+      Flow& f = __flows[i];
+      if (!f.dead && f.blocked) {
+         f.blocked = false;
+         watch(i, false);
+         Clock::time_point now = Clock::now();
+         send(i, now, now);
+         return;
+      }
+      if (f.dead || f.pending.empty())
+         return;
+      auto written = f.conn->write(f.pending, std::chrono::milliseconds(0));
+      if (written.erred()) {
+         try {
+            written.get();
+         } catch (const std::logic_error&) {
+            return;
+         } catch (const std::exception&) {
+            kill(i);
+         }
+         return;
+      }
+      __results.bytes_out += written.get();
+      f.pending.erase(f.pending.begin(), f.pending.begin() + written.get());
+      if (f.pending.empty())
+         watch(i, false);
+   }
+
+   void receive(size_t i)
+   {
+      Flow& f = __flows[i];
+      while (!f.dead) {
+         auto read = f.conn->read(__buffer, std::chrono::milliseconds(0));
+         if (read.erred()) {
+            try {
+               read.get();
+            } catch (const std::logic_error&) {
+               return;
+            } catch (const std::exception&) {
+               kill(i);
+            }
+            return;
+         }
+         size_t n = read.get();
+         if (n == 0 && !f.udp) {
+            kill(i);
+            return;
+         }
+         __results.bytes_in += n;
+         if (f.udp) {
+            if (!f.inflight.empty())
+               complete(i);
+            continue;
+         }
+         while (n > 0 && !f.inflight.empty()) {
+            size_t take = std::min(n, f.inflight.front().size - f.received);
+            f.received += take;
+            n -= take;
+            if (f.received == f.inflight.front().size)
+               complete(i);
+         }
+      }
+   }
+
+   void complete(size_t i)
+   {
+      Flow& f = __flows[i];
+      Clock::time_point now = Clock::now();
+      Request r = f.inflight.front();
+      f.inflight.pop_front();
+      f.received = 0;
+      if (counts(r)) {
+         __results.completed++;
+         __results.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - r.intended).count());
+         __results.service.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - r.sent).count());
+      }
+      if (__o.rate <= 0)
+         send(i, now, now);
+   }
+
+   /**
+    * expire gives up on datagrams of which the response is overdue.
+    */
+   void expire(Clock::time_point now)
+   {
+      for (size_t i = 0; i < __flows.size(); i++) {
+         Flow& f = __flows[i];
+         while (f.udp && !f.inflight.empty() && now - f.inflight.front().sent > __o.timeout) {
+            if (counts(f.inflight.front()))
+               __results.lost++;
+            f.inflight.pop_front();
+            if (__o.rate <= 0)
+               send(i, now, now);
+         }
+      }
+   }
+
+   void watch(size_t i, bool writable)
+   {
+      struct sys::epoll_event ev;
+      ev.events = sys::EPOLLIN | (writable ? static_cast<uint32_t>(sys::EPOLLOUT) : 0);
+      ev.data.u64 = i;
+      sys::epoll_ctl(__epoll, EPOLL_CTL_MOD, __flows[i].conn->fd(), &ev);
+   }
+
+   void kill(size_t i)
+   {
+      Flow& f = __flows[i];
+      if (f.dead)
+         return;
+      f.dead = true;
+      __results.failed++;
+      for (const Request& r : f.inflight)
+         if (counts(r))
+            __results.lost++;
+      f.inflight.clear();
+      sys::epoll_ctl(__epoll, EPOLL_CTL_DEL, f.conn->fd(), NULL);
+   }
+
+private:
+   const Options& __o;
+   const std::vector<std::vector<uint8_t>>& __messages;
+   size_t __first;
+   size_t __count;
+   size_t __next_message;
+   int __epoll;
+   std::vector<Flow> __flows;
+   std::vector<uint8_t> __buffer;
+   Clock::time_point __warm;
+   Results __results;
+};
+
+static bool parse(int argc, char** argv, Options& o)
+{
+   for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      auto value = [&]() -> std::string {
+         if (i + 1 >= argc)
+            throw std::invalid_argument(arg + " requires a value");
+         return argv[++i];
+      };
+      if (arg == "-h" || arg == "--help")
+         return false;
+      else if (arg == "-c" || arg == "--connections")
+         o.connections = std::stoul(value());
+      else if (arg == "-r" || arg == "--rate")
+         o.rate = std::stod(value());
+      else if (arg == "-d" || arg == "--duration")
+         o.duration = std::stod(value());
+      else if (arg == "-w" || arg == "--warmup")
+         o.warmup = std::stod(value());
+      else if (arg == "-s" || arg == "--size") {
+         std::string v = value();
+         size_t colon = v.find(':');
+         o.min_size = std::stoul(v.substr(0, colon));
+         o.max_size = colon == std::string::npos ? o.min_size : std::stoul(v.substr(colon + 1));
+      } else if (arg == "-p" || arg == "--pattern")
+         o.pattern = value();
+      else if (arg == "-t" || arg == "--threads")
+         o.threads = std::stoul(value());
+      else if (arg == "--timeout")
+         o.timeout = std::chrono::milliseconds(std::stol(value()));
+      else if (arg == "--sink")
+         o.sink = true;
+      else if (!arg.empty() && arg[0] == '-')
+         throw std::invalid_argument("unknown option " + arg);
+      else
+         o.targets.push_back(arg);
+   }
+   if (o.targets.empty())
+      return false;
+   if (o.connections == 0 || o.threads == 0 || o.min_size == 0 || o.min_size > o.max_size)
+      throw std::invalid_argument("connections, threads and sizes are to be positive");
+   if (o.pattern != "ascii" && o.pattern != "zeros" && o.pattern != "random")
+      throw std::invalid_argument("unknown pattern " + o.pattern);
+   o.threads = std::min(o.threads, o.connections);
+   return true;
+}
+
+/**
+ * raise_fd_limit lifts the limit on open files as far as allowed, as every
+ * connection takes one.
+ */
+static void raise_fd_limit(size_t needed)
+{
+   struct sys::rlimit rl;
+   if (sys::getrlimit(sys::RLIMIT_NOFILE, &rl) == -1)
+      return;
+   rl.rlim_cur = rl.rlim_max;
+   sys::setrlimit(sys::RLIMIT_NOFILE, &rl);
+   if (rl.rlim_cur < needed)
+      std::cerr << "cppsocket-load: only " << rl.rlim_cur << " files may be opened, "
+                << needed << " connections will likely fail" << std::endl;
+}
+
+static void report(const Options& o, const Results& r)
+{
+   const double kMiB = 1024 * 1024;
+   std::printf("connections\t%llu\n", (unsigned long long)r.dialed);
+   std::printf("duration_s\t%.2f\n", o.duration);
+   std::printf("sent\t%llu\n", (unsigned long long)r.sent);
+   std::printf("completed\t%llu\n", (unsigned long long)r.completed);
+   std::printf("lost\t%llu\n", (unsigned long long)r.lost);
+   std::printf("failed\t%llu\n", (unsigned long long)r.failed);
+   std::printf("throughput_rps\t%.0f\n", r.completed / o.duration);
+   std::printf("throughput_out_mib_s\t%.2f\n", r.bytes_out / kMiB / o.duration);
+   std::printf("throughput_in_mib_s\t%.2f\n", r.bytes_in / kMiB / o.duration);
+   if (o.sink)
+      return;
+   const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+   const Histogram* histograms[] = {&r.latency, &r.service};
+   const char* names[] = {"latency", "service"};
+   for (int h = 0; h < 2; h++) {
+      for (double p : percentiles)
+         std::printf("%s_p%g_us\t%.1f\n", names[h], p, histograms[h]->percentile(p) / 1e3);
+      std::printf("%s_max_us\t%.1f\n", names[h], histograms[h]->max() / 1e3);
+   }
+}
+
+int main(int argc, char** argv)
+{
+   Options o;
+   try {
+      if (!parse(argc, argv, o)) {
+         std::cerr << kUsage;
+         return 2;
+      }
+   } catch (const std::exception& e) {
+      std::cerr << "cppsocket-load: " << e.what() << "\n\n" << kUsage;
+      return 2;
+   }
+   raise_fd_limit(o.connections + 64);
+   auto m = messages(o);
+
+   std::vector<std::unique_ptr<Worker>> workers;
+   for (size_t t = 0, first = 0; t < o.threads; t++) {
+      size_t count = o.connections / o.threads + (t < o.connections % o.threads ? 1 : 0);
+      workers.push_back(std::unique_ptr<Worker>(new Worker(o, m, first, count)));
+      first += count;
+   }
+
+   // All connections are dialed before the clock starts, so that dialing
+   // doesn't count towards the latencies.
+   std::promise<Clock::time_point> go;
+   std::shared_future<Clock::time_point> start = go.get_future().share();
+   std::vector<std::future<void>> dialed;
+   std::vector<std::thread> threads;
+   for (auto& w : workers) {
+      auto ready = std::make_shared<std::promise<void>>();
+      dialed.push_back(ready->get_future());
+      Worker* worker = w.get();
+      threads.push_back(std::thread([worker, ready, start](){
+         worker->dial();
+         ready->set_value();
+         worker->run(start.get());
+      }));
+   }
+   for (auto& d : dialed)
+      d.wait();
+   go.set_value(Clock::now());
+   for (auto& t : threads)
+      t.join();
+
+   Results total;
+   for (auto& w : workers)
+      total.merge(w->results());
+   report(o, total);
+   return total.dialed > 0 ? 0 : 1;
+}